@@ -0,0 +1,299 @@
+#!/usr/bin/env python3
+"""Generate a synthetic pacman database for benchmarking expac.
+
+Writes, under OUTPUT:
+
+  pacman.conf             points expac at everything below
+  db/local/               the local DB, one directory per installed package
+  db/sync/<repo>.db       sync DB tarballs
+  db/sync/<repo>.files    the same, with file lists
+  pkgs/                   package files, for -p
+
+The same arguments and seed always produce the same databases.
+"""
+
+import argparse
+import hashlib
+import io
+import os
+import random
+import shutil
+import tarfile
+
+PREFIXES = ['', '', '', 'lib', 'python-', 'perl-', 'ruby-', 'haskell-']
+WORDS = '''
+    library tool utility daemon client server bindings for the and with
+    fast small simple portable secure modern graphical terminal network
+    audio video image font compression parser protocol framework toolkit
+    '''.split()
+LICENSES = ['GPL2', 'GPL3', 'LGPL2.1', 'MIT', 'BSD', 'Apache', 'MPL2']
+BUILDDATE = 1500000000
+
+
+class Package:
+    def __init__(self, rng, index, repo, args):
+        self.index = index
+        self.repo = repo
+        self.name = '{}pkg{:05d}'.format(rng.choice(PREFIXES), index)
+        self.version = '{}.{}.{}-{}'.format(rng.randint(0, 9),
+                                            rng.randint(0, 30),
+                                            rng.randint(0, 99),
+                                            rng.randint(1, 3))
+        self.desc = ' '.join(rng.choice(WORDS)
+                             for _ in range(rng.randint(3, 10)))
+        self.builddate = BUILDDATE + rng.randint(0, 200000000)
+        self.installdate = self.builddate + rng.randint(0, 5000000)
+        self.isize = rng.randint(1024, 200 * 1024 * 1024)
+        self.csize = self.isize // rng.randint(2, 5)
+        self.licenses = rng.sample(LICENSES, rng.randint(1, 2))
+        self.groups = ['group{}'.format(index % 20)] if index % 3 == 0 else []
+        self.provides = (['virtual{}=1.0'.format(index % 50)]
+                         if index % 10 == 0 else [])
+        self.depends = []
+        self.optdepends = []
+        self.files = ['usr/', 'usr/share/', 'usr/share/{}/'.format(self.name)]
+        self.files += ['usr/share/{}/file{:04d}'.format(self.name, i)
+                       for i in range(args.files)]
+        self.backup = ['etc/{}.conf'.format(self.name)] if index % 7 == 0 else []
+
+    @property
+    def dirname(self):
+        return '{}-{}'.format(self.name, self.version)
+
+    @property
+    def filename(self):
+        return '{}-x86_64.pkg.tar.gz'.format(self.dirname)
+
+    def link(self, rng, earlier, fanout):
+        # depending only on earlier packages keeps it a DAG, except for the
+        # odd provision pulled in below
+        for dep in rng.sample(earlier, min(len(earlier), fanout)):
+            if rng.random() < 0.3:
+                self.depends.append('{}>={}'.format(
+                    dep.name, dep.version.split('-')[0]))
+            else:
+                self.depends.append(dep.name)
+        if self.index % 13 == 0:
+            self.depends.append('virtual{}'.format(self.index % 50))
+        for dep in rng.sample(earlier, min(len(earlier), fanout // 2)):
+            self.optdepends.append('{}: for extra {}'.format(
+                dep.name, rng.choice(WORDS)))
+
+
+def section(name, values):
+    values = [str(v) for v in values if v is not None and v != '']
+    if not values:
+        return ''
+    return '%{}%\n{}\n\n'.format(name, '\n'.join(values))
+
+
+def checksum(pkg, algorithm):
+    return hashlib.new(algorithm, pkg.dirname.encode()).hexdigest()
+
+
+def common_fields(pkg):
+    return [
+        ('LICENSE', pkg.licenses),
+        ('ARCH', ['x86_64']),
+        ('BUILDDATE', [pkg.builddate]),
+        ('PACKAGER', ['Bench Packager <bench@example.org>']),
+    ]
+
+
+def relation_fields(pkg):
+    return [
+        ('DEPENDS', pkg.depends),
+        ('OPTDEPENDS', pkg.optdepends),
+        ('PROVIDES', pkg.provides),
+    ]
+
+
+def local_desc(pkg):
+    fields = [
+        ('NAME', [pkg.name]),
+        ('VERSION', [pkg.version]),
+        ('BASE', [pkg.name]),
+        ('DESC', [pkg.desc]),
+        ('URL', ['https://example.org/{}'.format(pkg.name)]),
+        ('GROUPS', pkg.groups),
+    ] + common_fields(pkg) + [
+        ('INSTALLDATE', [pkg.installdate]),
+        ('SIZE', [pkg.isize]),
+        ('REASON', [1] if pkg.index % 4 else []),
+        ('VALIDATION', ['pgp']),
+    ] + relation_fields(pkg)
+    return ''.join(section(k, v) for k, v in fields)
+
+
+def local_files(pkg):
+    backup = ['{}\t{}'.format(path, checksum(pkg, 'md5'))
+              for path in pkg.backup]
+    return section('FILES', pkg.files) + section('BACKUP', backup)
+
+
+def sync_desc(pkg):
+    fields = [
+        ('FILENAME', [pkg.filename]),
+        ('NAME', [pkg.name]),
+        ('BASE', [pkg.name]),
+        ('VERSION', [pkg.version]),
+        ('DESC', [pkg.desc]),
+        ('GROUPS', pkg.groups),
+        ('CSIZE', [pkg.csize]),
+        ('ISIZE', [pkg.isize]),
+        ('MD5SUM', [checksum(pkg, 'md5')]),
+        ('SHA256SUM', [checksum(pkg, 'sha256')]),
+        ('URL', ['https://example.org/{}'.format(pkg.name)]),
+    ] + common_fields(pkg) + relation_fields(pkg)
+    return ''.join(section(k, v) for k, v in fields)
+
+
+def pkginfo(pkg):
+    lines = [
+        ('pkgname', [pkg.name]),
+        ('pkgbase', [pkg.name]),
+        ('pkgver', [pkg.version]),
+        ('pkgdesc', [pkg.desc]),
+        ('url', ['https://example.org/{}'.format(pkg.name)]),
+        ('builddate', [pkg.builddate]),
+        ('packager', ['Bench Packager <bench@example.org>']),
+        ('size', [pkg.isize]),
+        ('arch', ['x86_64']),
+        ('license', pkg.licenses),
+        ('group', pkg.groups),
+        ('depend', pkg.depends),
+        ('optdepend', pkg.optdepends),
+        ('provides', pkg.provides),
+        ('backup', pkg.backup),
+    ]
+    return ''.join('{} = {}\n'.format(k, v) for k, vs in lines for v in vs)
+
+
+def add_file(tar, name, data=b'', mtime=BUILDDATE):
+    info = tarfile.TarInfo(name)
+    info.size = len(data)
+    info.mtime = mtime
+    info.mode = 0o644
+    tar.addfile(info, io.BytesIO(data))
+
+
+def add_dir(tar, name, mtime=BUILDDATE):
+    info = tarfile.TarInfo(name)
+    info.type = tarfile.DIRTYPE
+    info.mtime = mtime
+    info.mode = 0o755
+    tar.addfile(info)
+
+
+def write_local(dbpath, pkgs):
+    local = os.path.join(dbpath, 'local')
+    os.makedirs(local)
+    with open(os.path.join(local, 'ALPM_DB_VERSION'), 'w') as f:
+        f.write('9\n')
+
+    for pkg in pkgs:
+        pkgdir = os.path.join(local, pkg.dirname)
+        os.mkdir(pkgdir)
+        with open(os.path.join(pkgdir, 'desc'), 'w') as f:
+            f.write(local_desc(pkg))
+        with open(os.path.join(pkgdir, 'files'), 'w') as f:
+            f.write(local_files(pkg))
+
+
+def write_sync(dbpath, repo, pkgs):
+    sync = os.path.join(dbpath, 'sync')
+    os.makedirs(sync, exist_ok=True)
+
+    for ext, with_files in (('db', False), ('files', True)):
+        path = os.path.join(sync, '{}.{}'.format(repo, ext))
+        with tarfile.open(path, 'w:gz') as tar:
+            for pkg in pkgs:
+                add_dir(tar, pkg.dirname)
+                add_file(tar, pkg.dirname + '/desc', sync_desc(pkg).encode())
+                if with_files:
+                    add_file(tar, pkg.dirname + '/files',
+                             section('FILES', pkg.files).encode())
+
+
+def write_pkgfile(pkgdir, pkg):
+    with tarfile.open(os.path.join(pkgdir, pkg.filename), 'w:gz') as tar:
+        add_file(tar, '.PKGINFO', pkginfo(pkg).encode())
+        for path in pkg.files:
+            if path.endswith('/'):
+                add_dir(tar, path.rstrip('/'))
+            else:
+                add_file(tar, path, pkg.dirname.encode())
+
+
+def write_config(output, repos):
+    with open(os.path.join(output, 'pacman.conf'), 'w') as f:
+        f.write('[options]\n')
+        f.write('RootDir = {}\n'.format(os.path.join(output, 'root')))
+        f.write('DBPath = {}\n'.format(os.path.join(output, 'db')))
+        f.write('CacheDir = {}\n'.format(os.path.join(output, 'cache')))
+        f.write('Architecture = x86_64\n')
+        for repo in repos:
+            f.write('\n[{}]\n'.format(repo))
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--output', required=True,
+                        help='directory to write the databases to')
+    parser.add_argument('--packages', type=int, default=5000,
+                        help='packages in each sync repo (default: %(default)s)')
+    parser.add_argument('--repos', type=int, default=3,
+                        help='number of sync repos (default: %(default)s)')
+    parser.add_argument('--installed', type=float, default=0.5,
+                        help='share of sync packages installed locally '
+                             '(default: %(default)s)')
+    parser.add_argument('--files', type=int, default=50,
+                        help='files in each package (default: %(default)s)')
+    parser.add_argument('--fanout', type=int, default=4,
+                        help='dependencies of each package '
+                             '(default: %(default)s)')
+    parser.add_argument('--pkgfiles', type=int, default=200,
+                        help='package files to write for -p '
+                             '(default: %(default)s)')
+    parser.add_argument('--seed', type=int, default=1,
+                        help='random seed (default: %(default)s)')
+    return parser.parse_args()
+
+
+def main():
+    args = parse_args()
+    rng = random.Random(args.seed)
+
+    if os.path.exists(args.output):
+        for name in ('pacman.conf', 'db', 'pkgs', 'root', 'cache'):
+            path = os.path.join(args.output, name)
+            if os.path.isdir(path):
+                shutil.rmtree(path)
+            elif os.path.exists(path):
+                os.unlink(path)
+    os.makedirs(os.path.join(args.output, 'root'), exist_ok=True)
+    os.makedirs(os.path.join(args.output, 'cache'), exist_ok=True)
+
+    repos = ['repo{}'.format(i) for i in range(args.repos)]
+    everything = []
+    for r, repo in enumerate(repos):
+        pkgs = [Package(rng, r * args.packages + i, repo, args)
+                for i in range(args.packages)]
+        for pkg in pkgs:
+            pkg.link(rng, everything[-1000:], args.fanout)
+            everything.append(pkg)
+        write_sync(os.path.join(args.output, 'db'), repo, pkgs)
+
+    installed = [pkg for pkg in everything if rng.random() < args.installed]
+    write_local(os.path.join(args.output, 'db'), installed)
+
+    pkgdir = os.path.join(args.output, 'pkgs')
+    os.makedirs(pkgdir)
+    for pkg in everything[:args.pkgfiles]:
+        write_pkgfile(pkgdir, pkg)
+
+    write_config(args.output, repos)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,82 @@
+#!/usr/bin/env python3
+"""Run expac against a generated database and report its throughput.
+
+Any argument after -- is passed to expac, with {dbdir} replaced by the
+directory holding the database. Each line of output counts as a record.
+"""
+
+import argparse
+import os
+import statistics
+import subprocess
+import sys
+import time
+
+
+def run_once(cmd):
+    start = time.monotonic()
+    proc = subprocess.Popen(cmd, stdout=subprocess.PIPE)
+
+    records = 0
+    while True:
+        chunk = proc.stdout.read(1 << 16)
+        if not chunk:
+            break
+        records += chunk.count(b'\n')
+    proc.stdout.close()
+
+    # wait4 rather than wait, for the child's resource usage
+    _, status, usage = os.wait4(proc.pid, 0)
+    elapsed = time.monotonic() - start
+    proc.returncode = os.waitstatus_to_exitcode(status)
+
+    # ru_maxrss is in KiB on Linux
+    return proc.returncode, records, elapsed, usage.ru_maxrss
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--expac', required=True,
+                        help='the expac binary to run')
+    parser.add_argument('--config', required=True,
+                        help='the pacman.conf written by gendb.py')
+    parser.add_argument('--repeat', type=int, default=5,
+                        help='runs to take the median of (default: %(default)s)')
+    parser.add_argument('--name', help='what to call this in the report')
+    parser.add_argument('args', nargs=argparse.REMAINDER,
+                        help='arguments for expac, after --')
+    args = parser.parse_args()
+
+    if args.args and args.args[0] == '--':
+        args.args = args.args[1:]
+
+    return args
+
+
+def main():
+    args = parse_args()
+    dbdir = os.path.dirname(os.path.abspath(args.config))
+    cmd = [args.expac, '--config', args.config]
+    cmd += [arg.replace('{dbdir}', dbdir) for arg in args.args]
+    name = args.name or ' '.join(args.args)
+
+    times, peaks = [], []
+    for _ in range(args.repeat):
+        code, records, elapsed, peak = run_once(cmd)
+        # 1 only means nothing matched, which makes for a useless benchmark
+        if code != 0 or records == 0:
+            print('{}: expac exited with {} after {} records'.format(
+                name, code, records), file=sys.stderr)
+            return 1
+        times.append(elapsed)
+        peaks.append(peak)
+
+    elapsed = statistics.median(times)
+    print('{}: {} records in {:.3f}s ({:.0f} records/s), peak RSS {} KiB'.format(
+        name, records, elapsed, records / elapsed, max(peaks)))
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
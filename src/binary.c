@@ -0,0 +1,206 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "binary.h"
+#include "field.h"
+
+/* per package, or near enough, so not worth remembering */
+static const char unique_tokens[] = "BdfFghMnsuv";
+
+int binary_init(binary_t *binary)
+{
+  int r;
+
+  memset(binary, 0, sizeof(*binary));
+
+  r = hashmap_init(&binary->dict, 1024);
+  if(r < 0) {
+    return r;
+  }
+
+  r = outbuf_init(&binary->record, -1, 4096);
+  if(r < 0) {
+    hashmap_reset(&binary->dict);
+    return r;
+  }
+
+  return 0;
+}
+
+void binary_reset(binary_t *binary)
+{
+  for(size_t i = 0; i < binary->size; ++i) {
+    free(binary->strings[i]);
+  }
+  free(binary->strings);
+  hashmap_reset(&binary->dict);
+  outbuf_reset(&binary->record);
+
+  memset(binary, 0, sizeof(*binary));
+}
+
+binary_type_t binary_token_type(char token)
+{
+  switch (token) {
+    case 'b':
+    case 'l':
+    case 'k':
+    case 'm':
+    case 'x':
+    case 'y':
+    case '!':
+      return BINARY_UINT;
+    case 'B':
+    case 'C':
+    case 'D':
+    case 'E':
+    case 'F':
+    case 'G':
+    case 'H':
+    case 'J':
+    case 'K':
+    case 'L':
+    case 'M':
+    case 'N':
+    case 'O':
+    case 'o':
+    case 'P':
+    case 'R':
+    case 'S':
+    case 'T':
+    case 'V':
+    case 'W':
+    case 'X':
+    case 'Y':
+      return BINARY_LIST;
+    default:
+      return BINARY_STRING;
+  }
+}
+
+/* unsigned LEB128 */
+int binary_put_uint(outbuf_t *out, uint64_t n)
+{
+  unsigned char bytes[10];
+  size_t len = 0;
+
+  do {
+    bytes[len] = n & 0x7f;
+    n >>= 7;
+    if(n) {
+      bytes[len] |= 0x80;
+    }
+    ++len;
+  } while(n);
+
+  return outbuf_write(out, bytes, len);
+}
+
+static int put_bytes(outbuf_t *out, const char *s, size_t len)
+{
+  return binary_put_uint(out, (uint64_t)len << 1 | 1) + outbuf_write(out, s, len);
+}
+
+void binary_header(outbuf_t *out, const format_t *format)
+{
+  size_t nfields = 0;
+
+  for(size_t i = 0; i < format->size; ++i) {
+    nfields += format->ops[i].type == FORMAT_OP_FIELD;
+  }
+
+  outbuf_write(out, BINARY_MAGIC, 4);
+  outbuf_putc(out, BINARY_VERSION);
+  binary_put_uint(out, BINARY_DICT_MAX);
+  binary_put_uint(out, nfields);
+
+  for(size_t i = 0; i < format->size; ++i) {
+    const format_op_t *op = &format->ops[i];
+    const char *name;
+
+    if(op->type != FORMAT_OP_FIELD) {
+      continue;
+    }
+
+    name = field_key(op->token);
+
+    outbuf_putc(out, op->token);
+    outbuf_putc(out, binary_token_type(op->token));
+    outbuf_putc(out, binary_token_type(op->token) != BINARY_UINT &&
+        strchr(unique_tokens, op->token) == NULL ? BINARY_FLAG_INTERNED : 0);
+    put_bytes(out, name, strlen(name));
+  }
+}
+
+void binary_begin_field(binary_t *binary, char token)
+{
+  binary->intern = strchr(unique_tokens, token) == NULL;
+}
+
+void binary_end_record(binary_t *binary, outbuf_t *out)
+{
+  binary_put_uint(out, binary->record.len);
+  outbuf_write(out, binary->record.buf, binary->record.len);
+  binary->record.len = 0;
+}
+
+static int dict_add(binary_t *binary, const char *s, uintptr_t id)
+{
+  char *copy;
+
+  if(binary->size == binary->capacity) {
+    size_t newcap = binary->capacity ? binary->capacity * 2 : 1024;
+    char **ptr = realloc(binary->strings, newcap * sizeof(char *));
+    if(ptr == NULL) {
+      return -ENOMEM;
+    }
+    binary->strings = ptr;
+    binary->capacity = newcap;
+  }
+
+  copy = strdup(s);
+  if(copy == NULL) {
+    return -ENOMEM;
+  }
+
+  if(hashmap_put(&binary->dict, copy, (void *)id) < 0) {
+    free(copy);
+    return -ENOMEM;
+  }
+  binary->strings[binary->size++] = copy;
+
+  return 0;
+}
+
+/* 0 for NULL. Otherwise an odd number for a string that follows, of half
+ * its value in length, or an even one for the dictionary entry numbered
+ * half of it, less one. */
+int binary_put_str(binary_t *binary, outbuf_t *out, const char *s)
+{
+  uintptr_t id;
+
+  if(s == NULL) {
+    return binary_put_uint(out, 0);
+  }
+
+  if(!binary->intern) {
+    return put_bytes(out, s, strlen(s));
+  }
+
+  id = (uintptr_t)hashmap_get(&binary->dict, s);
+  if(id > 0) {
+    return binary_put_uint(out, (uint64_t)id << 1);
+  }
+
+  /* the reader adds each string it's sent for these fields, up to the
+   * limit, so the writer counts them all the same. Failing to remember one
+   * only means sending it again. */
+  if(binary->count < BINARY_DICT_MAX) {
+    dict_add(binary, s, ++binary->count);
+  }
+
+  return put_bytes(out, s, strlen(s));
+}
+
+/* vim: set et ts=2 sw=2: */
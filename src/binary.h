@@ -0,0 +1,57 @@
+#ifndef _BINARY_H
+#define _BINARY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "format.h"
+#include "hashmap.h"
+#include "output.h"
+
+#define BINARY_MAGIC      "XPAC"
+#define BINARY_VERSION    1
+#define BINARY_DICT_MAX   65536
+
+typedef enum binary_type_t {
+  BINARY_STRING = 1,
+  BINARY_UINT = 2,
+  BINARY_LIST = 3,
+} binary_type_t;
+
+#define BINARY_FLAG_INTERNED  (1 << 0)
+
+/* the state of a --output=binary stream: strings of the fields which repeat
+ * a lot are sent once and referred to by number after that, and each
+ * record is staged so it can be prefixed by its length. See expac(1) for
+ * the layout. */
+typedef struct binary_t {
+  hashmap_t dict;
+  size_t count;
+
+  /* the dictionary's keys */
+  char **strings;
+  size_t size;
+  size_t capacity;
+
+  /* whether strings of the field being written go in the dictionary */
+  bool intern;
+
+  outbuf_t record;
+} binary_t;
+
+int binary_init(binary_t *binary);
+void binary_reset(binary_t *binary);
+
+binary_type_t binary_token_type(char token);
+void binary_header(outbuf_t *out, const format_t *format);
+
+void binary_begin_field(binary_t *binary, char token);
+void binary_end_record(binary_t *binary, outbuf_t *out);
+
+int binary_put_uint(outbuf_t *out, uint64_t n);
+int binary_put_str(binary_t *binary, outbuf_t *out, const char *s);
+
+#endif  /* _BINARY_H */
+
+/* vim: set et ts=2 sw=2: */
@@ -43,6 +43,13 @@ static int is_section(const char *s, int n)
 
 static int config_add_repo(config_t *config, char *reponame)
 {
+  /* a repo given twice is only registered once anyway */
+  for(int i = 0; i < config->size; ++i) {
+    if(strcmp(config->repos[i], reponame) == 0) {
+      return 0;
+    }
+  }
+
   /* first time setup */
   if(config->repos == NULL) {
     config->repos = calloc(10, sizeof(char*));
@@ -76,10 +83,48 @@ static int config_add_repo(config_t *config, char *reponame)
 
 static int parse_one_file(config_t *config, const char *filename, char **section);
 
+static bool is_inert(const config_t *config, const char *include)
+{
+  for(int i = 0; i < config->ninert; ++i) {
+    if(strcmp(config->inert[i], include) == 0) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static int add_inert(config_t *config, const char *include)
+{
+  char **ptr;
+
+  ptr = realloc(config->inert, (config->ninert + 1) * sizeof(char *));
+  if(ptr == NULL) {
+    return -ENOMEM;
+  }
+  config->inert = ptr;
+
+  config->inert[config->ninert] = strdup(include);
+  if(config->inert[config->ninert] == NULL) {
+    return -ENOMEM;
+  }
+  ++config->ninert;
+
+  return 0;
+}
+
 static int parse_include(config_t *config, const char *include, char **section) {
+  const bool in_options = *section && strcmp(*section, "options") == 0;
+  const int nsections = config->nsections;
   glob_t globbuf;
   int r = 0;
 
+  /* nothing outside of [options] is read from an Include, unless it starts
+   * a section */
+  if(!in_options && (config->options_only || is_inert(config, include))) {
+    return 0;
+  }
+
   if(glob(include, GLOB_NOCHECK, NULL, &globbuf) != 0) {
     fprintf(stderr, "warning: globbing failed on '%s': out of memory\n",
             include);
@@ -94,6 +139,11 @@ static int parse_include(config_t *config, const char *include, char **section)
   }
 
   globfree(&globbuf);
+
+  if(r == 0 && config->nsections == nsections && !is_inert(config, include)) {
+    r = add_inert(config, include);
+  }
+
   return r;
 }
 
@@ -132,6 +182,7 @@ static int parse_one_file(config_t *config, const char *filename, char **section
     }
 
     if(is_section(line, len)) {
+      config->nsections++;
       free(*section);
       *section = strndup(&line[1], len - 2);
       if(*section == NULL) {
@@ -139,7 +190,7 @@ static int parse_one_file(config_t *config, const char *filename, char **section
       }
 
       in_options = strcmp(*section, "options") == 0;
-      if(!in_options) {
+      if(!in_options && !config->options_only) {
         int r;
 
         r = config_add_repo(config, *section);
@@ -159,6 +210,7 @@ static int parse_one_file(config_t *config, const char *filename, char **section
     if(strcmp(line, "Include") == 0) {
       int k;
 
+      config->nsections++;
       k = parse_include(config, val, section);
       if(k < 0) {
         return k;
@@ -192,16 +244,25 @@ void config_reset(config_t *config)
   for(int i = 0; i < config->size; ++i) {
     free(config->repos[i]);
   }
+  for(int i = 0; i < config->ninert; ++i) {
+    free(config->inert[i]);
+  }
+  free(config->inert);
 
   free(config->dbroot);
   free(config->dbpath);
   free(config->repos);
 }
 
-int config_parse(config_t *config, const char *filename)
+/* reads the root and DB path from filename, along with the repos unless
+ * they aren't needed, in which case Includes outside of [options] are
+ * skipped */
+int config_parse(config_t *config, const char *filename, bool repos)
 {
   _cleanup_free_ char *section = NULL;
 
+  config->options_only = !repos;
+
   return parse_one_file(config, filename, &section);
 }
 
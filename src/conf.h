@@ -1,6 +1,8 @@
 #ifndef _CONF_H
 #define _CONF_H
 
+#include <stdbool.h>
+
 typedef struct config_t {
   char **repos;
   int size;
@@ -8,9 +10,21 @@ typedef struct config_t {
 
   char *dbroot;
   char *dbpath;
+
+  /* without repos, only [options] is read */
+  bool options_only;
+
+  /* Includes which held neither sections nor Includes of their own, and
+   * so mean nothing outside of [options]. Mirror lists, mostly, which are
+   * included by every repo. */
+  char **inert;
+  int ninert;
+
+  /* sections and Includes seen so far */
+  int nsections;
 } config_t;
 
-int config_parse(config_t *config, const char *filename);
+int config_parse(config_t *config, const char *filename, bool repos);
 void config_reset(config_t *config);
 
 #endif  /* _CONF_H */
@@ -0,0 +1,794 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "deps.h"
+#include "util.h"
+
+static bool version_satisfies(const char *version, alpm_depmod_t mod,
+    const char *wanted)
+{
+  int cmp;
+
+  if(mod == ALPM_DEP_MOD_ANY) {
+    return true;
+  }
+
+  cmp = alpm_pkg_vercmp(version, wanted);
+  switch (mod) {
+    case ALPM_DEP_MOD_EQ:
+      return cmp == 0;
+    case ALPM_DEP_MOD_GE:
+      return cmp >= 0;
+    case ALPM_DEP_MOD_LE:
+      return cmp <= 0;
+    case ALPM_DEP_MOD_LT:
+      return cmp < 0;
+    case ALPM_DEP_MOD_GT:
+      return cmp > 0;
+    default:
+      return true;
+  }
+}
+
+/* assuming the names match. An unversioned provision only satisfies
+ * unversioned dependencies. */
+static bool provision_satisfies(const alpm_depend_t *provision,
+    const alpm_depend_t *dep)
+{
+  if(dep->mod == ALPM_DEP_MOD_ANY) {
+    return true;
+  }
+
+  return provision->mod == ALPM_DEP_MOD_EQ &&
+    version_satisfies(provision->version, dep->mod, dep->version);
+}
+
+/* whether pkg satisfies dep, either by itself or by one of its provisions.
+ * This has to agree with libalpm's _alpm_depcmp. */
+bool deps_satisfies(alpm_pkg_t *pkg, const alpm_depend_t *dep)
+{
+  if(strcmp(alpm_pkg_get_name(pkg), dep->name) == 0 &&
+      version_satisfies(alpm_pkg_get_version(pkg), dep->mod, dep->version)) {
+    return true;
+  }
+
+  for(alpm_list_t *i = alpm_pkg_get_provides(pkg); i; i = i->next) {
+    const alpm_depend_t *provision = i->data;
+
+    if(strcmp(provision->name, dep->name) == 0 &&
+        provision_satisfies(provision, dep)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static int node_add_edge(revdeps_node_t *node, uint32_t pkg,
+    const alpm_depend_t *dep)
+{
+  if(node->size == node->capacity) {
+    void *ptr;
+    const size_t newcap = node->capacity ? node->capacity * 2 : 4;
+
+    ptr = realloc(node->edges, newcap * sizeof(revdeps_edge_t));
+    if(ptr == NULL) {
+      return -ENOMEM;
+    }
+
+    node->edges = ptr;
+    node->capacity = newcap;
+  }
+
+  node->edges[node->size++] = (revdeps_edge_t){ pkg, dep };
+
+  return 0;
+}
+
+static revdeps_node_t *revdeps_node(revdeps_t *revdeps, const char *name)
+{
+  uintptr_t n;
+
+  /* nodes move when growing, so the index holds their position plus one */
+  n = (uintptr_t)hashmap_get(&revdeps->index, name);
+  if(n > 0) {
+    return &revdeps->nodes[n - 1];
+  }
+
+  if(revdeps->nnodes == revdeps->capacity) {
+    void *ptr;
+    const size_t newcap = revdeps->capacity ? revdeps->capacity * 2 : 256;
+
+    ptr = realloc(revdeps->nodes, newcap * sizeof(revdeps_node_t));
+    if(ptr == NULL) {
+      return NULL;
+    }
+
+    revdeps->nodes = ptr;
+    revdeps->capacity = newcap;
+  }
+
+  if(hashmap_put(&revdeps->index, name,
+        (void *)(uintptr_t)(revdeps->nnodes + 1)) < 0) {
+    return NULL;
+  }
+
+  memset(&revdeps->nodes[revdeps->nnodes], 0, sizeof(revdeps_node_t));
+
+  return &revdeps->nodes[revdeps->nnodes++];
+}
+
+/* indexes the depends, or optdepends, of every package in dbs */
+int revdeps_build(revdeps_t *revdeps, alpm_list_t *dbs, bool optional,
+    bool sort_by_name)
+{
+  size_t count = 0;
+  int r;
+
+  memset(revdeps, 0, sizeof(*revdeps));
+  revdeps->sort_by_name = sort_by_name;
+
+  for(alpm_list_t *i = dbs; i; i = i->next) {
+    count += alpm_list_count(alpm_db_get_pkgcache(i->data));
+  }
+
+  revdeps->pkgs = malloc((count + 1) * sizeof(alpm_pkg_t *));
+  if(revdeps->pkgs == NULL) {
+    return -ENOMEM;
+  }
+
+  r = hashmap_init(&revdeps->index, count);
+  if(r < 0) {
+    goto fail;
+  }
+
+  for(alpm_list_t *i = dbs; i; i = i->next) {
+    for(alpm_list_t *j = alpm_db_get_pkgcache(i->data); j; j = j->next) {
+      alpm_pkg_t *pkg = j->data;
+      const uint32_t idx = revdeps->npkgs++;
+      alpm_list_t *deps;
+
+      revdeps->pkgs[idx] = pkg;
+
+      deps = optional ? alpm_pkg_get_optdepends(pkg) : alpm_pkg_get_depends(pkg);
+      for(; deps; deps = deps->next) {
+        const alpm_depend_t *dep = deps->data;
+        revdeps_node_t *node;
+
+        node = revdeps_node(revdeps, dep->name);
+        if(node == NULL || node_add_edge(node, idx, dep) < 0) {
+          r = -ENOMEM;
+          goto fail;
+        }
+      }
+    }
+  }
+
+  return 0;
+
+fail:
+  revdeps_reset(revdeps);
+  return r;
+}
+
+void revdeps_reset(revdeps_t *revdeps)
+{
+  if(revdeps == NULL) {
+    return;
+  }
+
+  for(size_t i = 0; i < revdeps->nnodes; ++i) {
+    free(revdeps->nodes[i].edges);
+  }
+
+  free(revdeps->nodes);
+  free(revdeps->pkgs);
+  hashmap_reset(&revdeps->index);
+
+  memset(revdeps, 0, sizeof(*revdeps));
+}
+
+static int cmp_index(const void *a, const void *b)
+{
+  const uint32_t ia = *(const uint32_t *)a, ib = *(const uint32_t *)b;
+
+  return (ia > ib) - (ia < ib);
+}
+
+static int cmp_name(const void *a, const void *b)
+{
+  return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+static const revdeps_node_t *revdeps_find(const revdeps_t *revdeps,
+    const char *name)
+{
+  uintptr_t n = (uintptr_t)hashmap_get(&revdeps->index, name);
+
+  return n > 0 ? &revdeps->nodes[n - 1] : NULL;
+}
+
+static int collect(const revdeps_t *revdeps, const char *name,
+    alpm_pkg_t *pkg, uint32_t **found, size_t *nfound, size_t *capacity)
+{
+  const revdeps_node_t *node;
+
+  node = revdeps_find(revdeps, name);
+  if(node == NULL) {
+    return 0;
+  }
+
+  for(size_t i = 0; i < node->size; ++i) {
+    if(!deps_satisfies(pkg, node->edges[i].dep)) {
+      continue;
+    }
+
+    if(*nfound == *capacity) {
+      void *ptr;
+      const size_t newcap = *capacity ? *capacity * 2 : 16;
+
+      ptr = realloc(*found, newcap * sizeof(uint32_t));
+      if(ptr == NULL) {
+        return -ENOMEM;
+      }
+
+      *found = ptr;
+      *capacity = newcap;
+    }
+
+    (*found)[(*nfound)++] = node->edges[i].pkg;
+  }
+
+  return 0;
+}
+
+/* the names of the packages which depend on pkg, in the order libalpm would
+ * give them. The list must be freed, but not its contents. */
+alpm_list_t *revdeps_lookup(const revdeps_t *revdeps, alpm_pkg_t *pkg)
+{
+  _cleanup_free_ uint32_t *found = NULL;
+  _cleanup_free_ const char **names = NULL;
+  alpm_list_t *result = NULL;
+  size_t nfound = 0, capacity = 0, nnames = 0;
+
+  /* a dependency can only be satisfied by something of the same name */
+  if(collect(revdeps, alpm_pkg_get_name(pkg), pkg, &found, &nfound,
+        &capacity) < 0) {
+    return NULL;
+  }
+  for(alpm_list_t *i = alpm_pkg_get_provides(pkg); i; i = i->next) {
+    const alpm_depend_t *provision = i->data;
+
+    if(collect(revdeps, provision->name, pkg, &found, &nfound, &capacity) < 0) {
+      return NULL;
+    }
+  }
+
+  if(nfound == 0) {
+    return NULL;
+  }
+
+  /* each dependent is named once, in the order it was seen */
+  qsort(found, nfound, sizeof(uint32_t), cmp_index);
+
+  names = malloc(nfound * sizeof(char *));
+  if(names == NULL) {
+    return NULL;
+  }
+
+  for(size_t i = 0; i < nfound; ++i) {
+    if(i > 0 && found[i] == found[i - 1]) {
+      continue;
+    }
+    names[nnames++] = alpm_pkg_get_name(revdeps->pkgs[found[i]]);
+  }
+
+  if(revdeps->sort_by_name) {
+    qsort(names, nnames, sizeof(char *), cmp_name);
+  }
+
+  for(size_t i = 0; i < nnames; ++i) {
+    /* the same package may be in more than one sync DB */
+    if(revdeps->sort_by_name && i > 0 && strcmp(names[i], names[i - 1]) == 0) {
+      continue;
+    }
+    result = alpm_list_add(result, (void *)names[i]);
+  }
+
+  return result;
+}
+
+#define NO_SCC  UINT32_MAX
+
+/* scratch space for Tarjan's algorithm, run without recursion */
+typedef struct tarjan_t {
+  uint32_t *index;
+  uint32_t *low;
+  bool *onstack;
+  uint32_t *stack;
+  size_t sp;
+  uint32_t *calls;
+  uint32_t *pos;
+  size_t cp;
+  uint32_t counter;
+} tarjan_t;
+
+/* the package picked for dep: the first one of that name and a suitable
+ * version, otherwise the first suitable provider, as libalpm would */
+static ssize_t depgraph_resolve(const depgraph_t *graph,
+    const alpm_depend_t *dep)
+{
+  const revdeps_node_t *node;
+
+  node = revdeps_find(&graph->providers, dep->name);
+  if(node == NULL) {
+    return -1;
+  }
+
+  for(size_t i = 0; i < node->size; ++i) {
+    const revdeps_edge_t *e = &node->edges[i];
+
+    if(e->dep == NULL && version_satisfies(
+          alpm_pkg_get_version(graph->providers.pkgs[e->pkg]),
+          dep->mod, dep->version)) {
+      return e->pkg;
+    }
+  }
+
+  for(size_t i = 0; i < node->size; ++i) {
+    const revdeps_edge_t *e = &node->edges[i];
+
+    if(e->dep != NULL && provision_satisfies(e->dep, dep)) {
+      return e->pkg;
+    }
+  }
+
+  return -1;
+}
+
+static ssize_t depgraph_node(const depgraph_t *graph, alpm_pkg_t *pkg)
+{
+  const revdeps_node_t *node;
+
+  node = revdeps_find(&graph->providers, alpm_pkg_get_name(pkg));
+  if(node == NULL) {
+    return -1;
+  }
+
+  for(size_t i = 0; i < node->size; ++i) {
+    if(node->edges[i].dep == NULL &&
+        graph->providers.pkgs[node->edges[i].pkg] == pkg) {
+      return node->edges[i].pkg;
+    }
+  }
+
+  return -1;
+}
+
+static int depgraph_add_provider(depgraph_t *graph, const char *name,
+    uint32_t pkg, const alpm_depend_t *provision)
+{
+  revdeps_node_t *node = revdeps_node(&graph->providers, name);
+
+  if(node == NULL) {
+    return -ENOMEM;
+  }
+
+  return node_add_edge(node, pkg, provision);
+}
+
+static int depgraph_add_nodes(depgraph_t *graph, alpm_list_t *dbs)
+{
+  revdeps_t *providers = &graph->providers;
+  size_t count = 0;
+  int r;
+
+  for(alpm_list_t *i = dbs; i; i = i->next) {
+    count += alpm_list_count(alpm_db_get_pkgcache(i->data));
+  }
+
+  providers->pkgs = malloc((count + 1) * sizeof(alpm_pkg_t *));
+  if(providers->pkgs == NULL) {
+    return -ENOMEM;
+  }
+
+  r = hashmap_init(&providers->index, count);
+  if(r < 0) {
+    return r;
+  }
+
+  for(alpm_list_t *i = dbs; i; i = i->next) {
+    for(alpm_list_t *j = alpm_db_get_pkgcache(i->data); j; j = j->next) {
+      alpm_pkg_t *pkg = j->data;
+      const uint32_t idx = providers->npkgs++;
+
+      providers->pkgs[idx] = pkg;
+
+      r = depgraph_add_provider(graph, alpm_pkg_get_name(pkg), idx, NULL);
+      for(alpm_list_t *p = alpm_pkg_get_provides(pkg); r == 0 && p; p = p->next) {
+        const alpm_depend_t *provision = p->data;
+        r = depgraph_add_provider(graph, provision->name, idx, provision);
+      }
+      if(r < 0) {
+        return r;
+      }
+    }
+  }
+
+  graph->words = (providers->npkgs + 63) / 64;
+
+  return 0;
+}
+
+static int depgraph_add_edges(depgraph_t *graph)
+{
+  const size_t npkgs = graph->providers.npkgs;
+  size_t nedges = 0, capacity = 0;
+  _cleanup_free_ uint32_t *fill = NULL;
+
+  graph->offsets = calloc(npkgs + 1, sizeof(uint32_t));
+  graph->roffsets = calloc(npkgs + 2, sizeof(uint32_t));
+  if(graph->offsets == NULL || graph->roffsets == NULL) {
+    return -ENOMEM;
+  }
+
+  for(size_t u = 0; u < npkgs; ++u) {
+    alpm_pkg_t *pkg = graph->providers.pkgs[u];
+
+    graph->offsets[u] = nedges;
+
+    for(alpm_list_t *d = alpm_pkg_get_depends(pkg); d; d = d->next) {
+      ssize_t w = depgraph_resolve(graph, d->data);
+
+      /* unsatisfiable or self-satisfied dependencies lead nowhere */
+      if(w < 0 || (size_t)w == u) {
+        continue;
+      }
+
+      if(nedges == capacity) {
+        void *ptr;
+        const size_t newcap = capacity ? capacity * 2 : 1024;
+
+        ptr = realloc(graph->edges, newcap * sizeof(uint32_t));
+        if(ptr == NULL) {
+          return -ENOMEM;
+        }
+
+        graph->edges = ptr;
+        capacity = newcap;
+      }
+
+      graph->edges[nedges++] = w;
+      graph->roffsets[w + 2]++;
+    }
+  }
+  graph->offsets[npkgs] = nedges;
+
+  /* the same edges the other way around */
+  graph->redges = malloc((nedges + 1) * sizeof(uint32_t));
+  if(graph->redges == NULL) {
+    return -ENOMEM;
+  }
+
+  for(size_t w = 2; w <= npkgs + 1; ++w) {
+    graph->roffsets[w] += graph->roffsets[w - 1];
+  }
+  for(size_t u = 0; u < npkgs; ++u) {
+    for(size_t e = graph->offsets[u]; e < graph->offsets[u + 1]; ++e) {
+      graph->redges[graph->roffsets[graph->edges[e] + 1]++] = u;
+    }
+  }
+
+  graph->depends.offsets = graph->offsets;
+  graph->depends.edges = graph->edges;
+  graph->requiredby.offsets = graph->roffsets;
+  graph->requiredby.edges = graph->redges;
+
+  return 0;
+}
+
+int depgraph_build(depgraph_t *graph, alpm_list_t *dbs)
+{
+  int r;
+
+  memset(graph, 0, sizeof(*graph));
+
+  r = depgraph_add_nodes(graph, dbs);
+  if(r == 0) {
+    r = depgraph_add_edges(graph);
+  }
+
+  if(r < 0) {
+    depgraph_reset(graph);
+  }
+
+  return r;
+}
+
+static void depclosure_reset(depclosure_t *closure)
+{
+  for(size_t i = 0; i < closure->nsccs; ++i) {
+    free(closure->sets[i]);
+  }
+
+  free(closure->sets);
+  free(closure->scc);
+}
+
+void depgraph_reset(depgraph_t *graph)
+{
+  if(graph == NULL) {
+    return;
+  }
+
+  depclosure_reset(&graph->depends);
+  depclosure_reset(&graph->requiredby);
+
+  free(graph->offsets);
+  free(graph->edges);
+  free(graph->roffsets);
+  free(graph->redges);
+  revdeps_reset(&graph->providers);
+
+  memset(graph, 0, sizeof(*graph));
+}
+
+static void tarjan_reset(tarjan_t *t)
+{
+  free(t->index);
+  free(t->low);
+  free(t->onstack);
+  free(t->stack);
+  free(t->calls);
+  free(t->pos);
+}
+
+static int tarjan_init(tarjan_t *t, size_t n)
+{
+  memset(t, 0, sizeof(*t));
+
+  t->index = calloc(n + 1, sizeof(uint32_t));
+  t->low = malloc((n + 1) * sizeof(uint32_t));
+  t->onstack = calloc(n + 1, sizeof(bool));
+  t->stack = malloc((n + 1) * sizeof(uint32_t));
+  t->calls = malloc((n + 1) * sizeof(uint32_t));
+  t->pos = malloc((n + 1) * sizeof(uint32_t));
+  if(!t->index || !t->low || !t->onstack || !t->stack || !t->calls || !t->pos) {
+    tarjan_reset(t);
+    return -ENOMEM;
+  }
+
+  return 0;
+}
+
+static void bitset_or(uint64_t *dst, const uint64_t *src, size_t words)
+{
+  for(size_t i = 0; i < words; ++i) {
+    dst[i] |= src[i];
+  }
+}
+
+/* pops the component rooted at v. Everything it reaches outside of itself
+ * was finished earlier, so its closure is just those closures combined. */
+static int closure_emit(depclosure_t *c, tarjan_t *t, size_t words,
+    uint32_t v)
+{
+  const uint32_t id = c->nsccs;
+  uint64_t *set;
+  size_t first = t->sp;
+
+  set = calloc(words, sizeof(uint64_t));
+  if(set == NULL) {
+    return -ENOMEM;
+  }
+
+  do {
+    --first;
+  } while(t->stack[first] != v);
+
+  for(size_t k = first; k < t->sp; ++k) {
+    const uint32_t m = t->stack[k];
+
+    c->scc[m] = id;
+    t->onstack[m] = false;
+    set[m / 64] |= UINT64_C(1) << (m % 64);
+  }
+
+  for(size_t k = first; k < t->sp; ++k) {
+    const uint32_t m = t->stack[k];
+
+    for(uint32_t e = c->offsets[m]; e < c->offsets[m + 1]; ++e) {
+      const uint32_t w = c->edges[e];
+
+      if(c->scc[w] != id) {
+        bitset_or(set, c->sets[c->scc[w]], words);
+      }
+    }
+  }
+
+  t->sp = first;
+  c->sets[c->nsccs++] = set;
+
+  return 0;
+}
+
+static void tarjan_push(const depclosure_t *c, tarjan_t *t, uint32_t v)
+{
+  t->index[v] = t->low[v] = ++t->counter;
+  t->stack[t->sp++] = v;
+  t->onstack[v] = true;
+  t->calls[t->cp] = v;
+  t->pos[t->cp] = c->offsets[v];
+  t->cp++;
+}
+
+static int closure_visit(depclosure_t *c, tarjan_t *t, size_t words,
+    uint32_t start)
+{
+  if(c->scc[start] != NO_SCC || t->index[start] != 0) {
+    return 0;
+  }
+
+  tarjan_push(c, t, start);
+
+  while(t->cp > 0) {
+    const uint32_t v = t->calls[t->cp - 1];
+
+    if(t->pos[t->cp - 1] < c->offsets[v + 1]) {
+      const uint32_t w = c->edges[t->pos[t->cp - 1]++];
+
+      if(c->scc[w] != NO_SCC) {
+        continue;
+      }
+
+      if(t->index[w] == 0) {
+        tarjan_push(c, t, w);
+      } else if(t->onstack[w] && t->index[w] < t->low[v]) {
+        t->low[v] = t->index[w];
+      }
+      continue;
+    }
+
+    --t->cp;
+    if(t->cp > 0) {
+      const uint32_t u = t->calls[t->cp - 1];
+
+      if(t->low[v] < t->low[u]) {
+        t->low[u] = t->low[v];
+      }
+    }
+
+    if(t->low[v] == t->index[v]) {
+      int r = closure_emit(c, t, words, v);
+      if(r < 0) {
+        return r;
+      }
+    }
+  }
+
+  return 0;
+}
+
+static int closure_prepare(depgraph_t *graph, depclosure_t *c,
+    alpm_list_t *pkgs, bool requiredby)
+{
+  const size_t npkgs = graph->providers.npkgs;
+  tarjan_t t;
+  int r = 0;
+
+  if(c->scc == NULL) {
+    c->scc = malloc((npkgs + 1) * sizeof(uint32_t));
+    c->sets = calloc(npkgs + 1, sizeof(uint64_t *));
+    if(c->scc == NULL || c->sets == NULL) {
+      return -ENOMEM;
+    }
+    memset(c->scc, 0xff, (npkgs + 1) * sizeof(uint32_t));
+  }
+
+  r = tarjan_init(&t, npkgs);
+  if(r < 0) {
+    return r;
+  }
+
+  for(alpm_list_t *i = pkgs; r == 0 && i; i = i->next) {
+    ssize_t node = depgraph_node(graph, i->data);
+
+    if(node >= 0) {
+      r = closure_visit(c, &t, graph->words, node);
+    } else if(!requiredby) {
+      /* a package from a file starts from whatever it would pull in */
+      for(alpm_list_t *d = alpm_pkg_get_depends(i->data); r == 0 && d; d = d->next) {
+        ssize_t w = depgraph_resolve(graph, d->data);
+        if(w >= 0) {
+          r = closure_visit(c, &t, graph->words, w);
+        }
+      }
+    } else {
+      /* ...and may be depended upon by anything */
+      for(size_t u = 0; r == 0 && u < npkgs; ++u) {
+        r = closure_visit(c, &t, graph->words, u);
+      }
+      break;
+    }
+  }
+
+  tarjan_reset(&t);
+
+  return r;
+}
+
+/* computes the closures that depgraph_closure will be asked for, for each
+ * of pkgs. Must be called before looking anything up from several threads. */
+int depgraph_prepare(depgraph_t *graph, alpm_list_t *pkgs, bool depends,
+    bool requiredby)
+{
+  int r = 0;
+
+  if(depends) {
+    r = closure_prepare(graph, &graph->depends, pkgs, false);
+  }
+  if(r == 0 && requiredby) {
+    r = closure_prepare(graph, &graph->requiredby, pkgs, true);
+  }
+
+  return r;
+}
+
+static void closure_add(const depclosure_t *c, uint64_t *set, size_t words,
+    uint32_t node)
+{
+  set[node / 64] |= UINT64_C(1) << (node % 64);
+  if(c->scc[node] != NO_SCC) {
+    bitset_or(set, c->sets[c->scc[node]], words);
+  }
+}
+
+/* fills set, which holds a bit for each package in the graph, with what pkg
+ * depends on or is required by, directly or not. pkg itself is left out. */
+void depgraph_closure(const depgraph_t *graph, alpm_pkg_t *pkg,
+    bool requiredby, uint64_t *set)
+{
+  const depclosure_t *c = requiredby ? &graph->requiredby : &graph->depends;
+  ssize_t node;
+
+  memset(set, 0, graph->words * sizeof(uint64_t));
+
+  if(c->scc == NULL) {
+    return;
+  }
+
+  node = depgraph_node(graph, pkg);
+  if(node >= 0) {
+    if(c->scc[node] != NO_SCC) {
+      bitset_or(set, c->sets[c->scc[node]], graph->words);
+    }
+    set[node / 64] &= ~(UINT64_C(1) << (node % 64));
+    return;
+  }
+
+  /* not in the graph, so connect it by hand */
+  if(!requiredby) {
+    for(alpm_list_t *d = alpm_pkg_get_depends(pkg); d; d = d->next) {
+      ssize_t w = depgraph_resolve(graph, d->data);
+      if(w >= 0) {
+        closure_add(c, set, graph->words, w);
+      }
+    }
+    return;
+  }
+
+  for(size_t u = 0; u < graph->providers.npkgs; ++u) {
+    alpm_pkg_t *dependent = graph->providers.pkgs[u];
+
+    for(alpm_list_t *d = alpm_pkg_get_depends(dependent); d; d = d->next) {
+      if(deps_satisfies(pkg, d->data)) {
+        closure_add(c, set, graph->words, u);
+        break;
+      }
+    }
+  }
+}
+
+/* vim: set et ts=2 sw=2: */
@@ -0,0 +1,83 @@
+#ifndef _DEPS_H
+#define _DEPS_H
+
+#include <alpm.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hashmap.h"
+
+typedef struct revdeps_edge_t {
+  uint32_t pkg;
+  const alpm_depend_t *dep;
+} revdeps_edge_t;
+
+typedef struct revdeps_node_t {
+  revdeps_edge_t *edges;
+  size_t size;
+  size_t capacity;
+} revdeps_node_t;
+
+/* every dependency in a set of DBs, by the name it depends on. Answers the
+ * same questions as alpm_pkg_compute_requiredby and _optionalfor without
+ * going over the whole set for each package. */
+typedef struct revdeps_t {
+  alpm_pkg_t **pkgs;
+  size_t npkgs;
+
+  revdeps_node_t *nodes;
+  size_t nnodes;
+  size_t capacity;
+  hashmap_t index;
+
+  /* sync DBs give their answers sorted by name, the local DB in its order */
+  bool sort_by_name;
+} revdeps_t;
+
+int revdeps_build(revdeps_t *revdeps, alpm_list_t *dbs, bool optional,
+    bool sort_by_name);
+void revdeps_reset(revdeps_t *revdeps);
+alpm_list_t *revdeps_lookup(const revdeps_t *revdeps, alpm_pkg_t *pkg);
+
+/* transitive closures over one direction of a dependency graph, kept per
+ * strongly connected component so that cycles and shared subtrees are only
+ * walked once */
+typedef struct depclosure_t {
+  const uint32_t *offsets;
+  const uint32_t *edges;
+
+  uint32_t *scc;
+  uint64_t **sets;
+  size_t nsccs;
+} depclosure_t;
+
+/* packages as nodes, each dependency as an edge to the package that would be
+ * picked to satisfy it */
+typedef struct depgraph_t {
+  /* the nodes, and each name they go by. An edge without a dependency is
+   * the package's own name, otherwise it's the provision. */
+  revdeps_t providers;
+  size_t words;
+
+  uint32_t *offsets;
+  uint32_t *edges;
+  uint32_t *roffsets;
+  uint32_t *redges;
+
+  depclosure_t depends;
+  depclosure_t requiredby;
+} depgraph_t;
+
+bool deps_satisfies(alpm_pkg_t *pkg, const alpm_depend_t *dep);
+
+int depgraph_build(depgraph_t *graph, alpm_list_t *dbs);
+void depgraph_reset(depgraph_t *graph);
+int depgraph_prepare(depgraph_t *graph, alpm_list_t *pkgs, bool depends,
+    bool requiredby);
+void depgraph_closure(const depgraph_t *graph, alpm_pkg_t *pkg,
+    bool requiredby, uint64_t *set);
+
+#endif  /* _DEPS_H */
+
+/* vim: set et ts=2 sw=2: */
@@ -26,18 +26,42 @@
 
 #include <alpm.h>
 #include <ctype.h>
+#include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
 #include <glob.h>
+#include <limits.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <time.h>
 
 #include "expac.h"
+#include "binary.h"
 #include "conf.h"
+#include "deps.h"
+#include "filesdb.h"
+#include "filter.h"
+#include "group.h"
+#include "format.h"
+#include "hashmap.h"
+#include "modified.h"
+#include "output.h"
+#include "owners.h"
+#include "pool.h"
+#include "request.h"
+#include "search.h"
+#include "serve.h"
+#include "snapshot.h"
+#include "sort.h"
+#include "stats.h"
+#include "timefmt.h"
 #include "util.h"
 
 #define DEFAULT_DELIM        "\n"
@@ -49,11 +73,11 @@
 #endif
 
 static char const size_tokens[] = "BKMGTPEZYRQ";
-static char const digits[] = "0123456789";
-static char const printf_flags[] = "'-+ #0I";
 
 bool opt_readone = false;
 bool opt_verbose = false;
+bool opt_null = false;
+bool opt_batch = false;
 char opt_humansize = 'B';
 package_corpus_t opt_corpus = CORPUS_LOCAL;
 search_what_t opt_what = SEARCH_EXACT;
@@ -62,26 +86,194 @@ const char *opt_timefmt = DEFAULT_TIMEFMT;
 const char *opt_listdelim = DEFAULT_LISTDELIM;
 const char *opt_delim = DEFAULT_DELIM;
 const char *opt_config_file = "/etc/pacman.conf";
-int opt_pkgcounter = 0;
+const char *opt_cachedir = NULL;
+const char *opt_serve = NULL;
+const char *opt_connect = NULL;
+const char *opt_filter = NULL;
+const char *opt_sort = NULL;
+bool opt_reverse = false;
+size_t opt_limit = 0;
+const char *opt_group_by = NULL;
+const char *opt_aggregate = "count";
+output_format_t opt_output = OUTPUT_TEXT;
+bool opt_rehash = false;
+bool opt_files = false;
+bool opt_stats = false;
+int opt_stats_fd = -1;
+size_t opt_bufsize = OUTBUF_DEFAULT_SIZE;
+size_t opt_jobs = 1;
+
+static modified_t modified_backups;
+
+/* answers %N and %W, if they could be built */
+static revdeps_t requiredby;
+static revdeps_t optionalfor;
+
+/* answers %X, %x, %Y and %y */
+static depgraph_t depgraph;
+
+/* the packages loaded from files for the current query, whether or not they
+ * made it into the results. Unlike those of a DB, they're ours to free. */
+static alpm_list_t *loaded_pkgs;
+
+/* the file lists of each sync DB with --files, in the order of the DBs.
+ * Those without a .files DB are left unmapped. */
+typedef struct repo_files_t {
+  alpm_db_t *db;
+  filesdb_t index;
+} repo_files_t;
+
+static repo_files_t *repo_files;
+static size_t nrepo_files;
+
+/* the state of the stream for --output=binary */
+static binary_t binary;
+
+/* serializes the few alpm calls that walk whole databases while printing
+ * on several threads */
+static pthread_mutex_t alpm_lock = PTHREAD_MUTEX_INITIALIZER;
 
 typedef const char *(*extractfn)(void*);
 
-static int is_valid_size_unit(char *u)
+static int is_valid_size_unit(const char *u)
 {
   return u[0] != '\0' && u[1] == '\0' &&
     memchr(size_tokens, *u, sizeof(size_tokens) - 1) != NULL;
 }
 
+static int parse_humansize(const char *str, char *unit)
+{
+  if(strcmp(str, "auto") == 0) {
+    *unit = '\0';
+    return 0;
+  }
+
+  if(!is_valid_size_unit(str)) {
+    return -EINVAL;
+  }
+
+  *unit = *str;
+
+  return 0;
+}
+
+static int parse_bufsize(const char *str, size_t *size)
+{
+  char *end;
+  unsigned long long n;
+
+  errno = 0;
+  n = strtoull(str, &end, 10);
+  if(errno != 0 || end == str) {
+    return -EINVAL;
+  }
+
+  switch (*end) {
+    case 'K':
+      n <<= 10;
+      end++;
+      break;
+    case 'M':
+      n <<= 20;
+      end++;
+      break;
+  }
+
+  /* anything smaller defeats the purpose */
+  if(*end != '\0' || n < 4096) {
+    return -EINVAL;
+  }
+
+  *size = n;
+
+  return 0;
+}
+
+static int parse_stats_fd(const char *str, int *fd)
+{
+  char *end;
+  long n;
+
+  errno = 0;
+  n = strtol(str, &end, 10);
+  if(errno != 0 || end == str || *end != '\0' || n < 0 || n > INT_MAX) {
+    return -EINVAL;
+  }
+
+  /* better to find out now than after all the work is done */
+  if(fcntl(n, F_GETFD) < 0) {
+    return -errno;
+  }
+
+  *fd = n;
+
+  return 0;
+}
+
+static int parse_jobs(const char *str, size_t *jobs)
+{
+  char *end;
+  unsigned long n;
+
+  errno = 0;
+  n = strtoul(str, &end, 10);
+  if(errno != 0 || end == str || *end != '\0' || n == 0 || n > 1024) {
+    return -EINVAL;
+  }
+
+  *jobs = n;
+
+  return 0;
+}
+
+static int parse_limit(const char *str, size_t *limit)
+{
+  char *end;
+  unsigned long long n;
+
+  errno = 0;
+  n = strtoull(str, &end, 10);
+  if(errno != 0 || end == str || *end != '\0' || n == 0 || n > SIZE_MAX) {
+    return -EINVAL;
+  }
+
+  *limit = n;
+
+  return 0;
+}
+
+static int parse_output(const char *str, output_format_t *output)
+{
+  static const struct {
+    const char *name;
+    output_format_t output;
+  } outputs[] = {
+    { "text",   OUTPUT_TEXT },
+    { "json",   OUTPUT_JSON },
+    { "jsonl",  OUTPUT_JSONL },
+    { "nul",    OUTPUT_NUL },
+    { "binary", OUTPUT_BINARY },
+  };
+
+  for(size_t i = 0; i < sizeof(outputs) / sizeof(outputs[0]); ++i) {
+    if(strcmp(str, outputs[i].name) == 0) {
+      *output = outputs[i].output;
+      return 0;
+    }
+  }
+
+  return -EINVAL;
+}
+
 static const char *alpm_backup_get_name(alpm_backup_t *bkup)
 {
   return bkup->name;
 }
 
-static double humanize_size(off_t bytes, const char target_unit,
-    const char **label)
+/* label must have room for 4 bytes */
+static double humanize_size(off_t bytes, const char target_unit, char *label)
 {
   static const int unitcount = sizeof(size_tokens) - 1;
-  static char label_buf[4];
 
   double val = (double)bytes;
   int index;
@@ -96,24 +288,102 @@ static double humanize_size(off_t bytes, const char target_unit,
   }
 
   if(label) {
-    sprintf(label_buf, "%c%s", size_tokens[index],
+    sprintf(label, "%c%s", size_tokens[index],
         size_tokens[index] == 'B' ? "" : "iB");
-    *label = label_buf;
   }
 
   return val;
 }
 
-static char *size_to_string(off_t pkgsize)
+/* the unit humanize_size would pick for a size of magnitude bytes */
+static int humanize_index(uint64_t bytes, const char target_unit)
+{
+  /* the largest size still shown in each unit, 2048 of it */
+  static const uint64_t thresholds[] = {
+    UINT64_C(2048) << 0,
+    UINT64_C(2048) << 10,
+    UINT64_C(2048) << 20,
+    UINT64_C(2048) << 30,
+    UINT64_C(2048) << 40,
+    UINT64_C(2048) << 50,
+  };
+  int index;
+
+  if(target_unit != '\0') {
+    return strchr(size_tokens, target_unit) - size_tokens;
+  }
+
+  for(index = 0; index < (int)(sizeof(thresholds) / sizeof(thresholds[0])); index++) {
+    if(bytes <= thresholds[index]) {
+      break;
+    }
+  }
+
+  return index;
+}
+
+/* what "%.2f" would print for bytes / 1024^index. That quotient is exact in
+ * a double, so printf's rounding comes down to rounding half to even. */
+static char *print_hundredths(uint64_t bytes, int index, char *p)
+{
+  const unsigned shift = 10 * index;
+  uint64_t hundredths = 0;
+
+  /* bytes is at most 2^53, so times 100 it stays under 2^60 */
+  if(shift < 61) {
+    const uint64_t scaled = bytes * 100;
+    const uint64_t rem = shift ? scaled & ((UINT64_C(1) << shift) - 1) : 0;
+    const uint64_t half = shift ? UINT64_C(1) << (shift - 1) : 1;
+
+    hundredths = scaled >> shift;
+    if(rem > half || (rem == half && (hundredths & 1))) {
+      hundredths++;
+    }
+  }
+
+  p += uint_to_str(hundredths / 100, p);
+  *p++ = '.';
+  *p++ = '0' + hundredths / 10 % 10;
+  *p++ = '0' + hundredths % 10;
+
+  return p;
+}
+
+static const char *size_to_string(off_t pkgsize, char *out, size_t size)
 {
-  static char out[64];
+  const uint64_t bytes = pkgsize < 0 ? -(uint64_t)pkgsize : (uint64_t)pkgsize;
+  char *p = out;
+
+  /* beyond 2^53, doubles lose precision, so leave it to printf */
+  if(size < 48 || bytes > (UINT64_C(1) << 53)) {
+    if(opt_humansize == 'B') {
+      snprintf(out, size, "%jd", (intmax_t)pkgsize);
+    } else {
+      char unit[4];
+      const double n = humanize_size(pkgsize, opt_humansize, unit);
+      snprintf(out, size, "%.2f %s", n, unit);
+    }
+
+    return out;
+  }
+
+  if(pkgsize < 0) {
+    *p++ = '-';
+  }
 
   if(opt_humansize == 'B') {
-    snprintf(out, sizeof(out), "%jd", (intmax_t)pkgsize);
+    uint_to_str(bytes, p);
   } else {
-    const char *unit = NULL;
-    const double n = humanize_size(pkgsize, opt_humansize, &unit);
-    snprintf(out, sizeof(out), "%.2f %s", n, unit);
+    const int index = humanize_index(bytes, opt_humansize);
+
+    p = print_hundredths(bytes, index, p);
+    *p++ = ' ';
+    *p++ = size_tokens[index];
+    if(size_tokens[index] != 'B') {
+      *p++ = 'i';
+      *p++ = 'B';
+    }
+    *p = '\0';
   }
 
   return out;
@@ -145,13 +415,31 @@ static void usage(void)
       "  -S, --sync                search sync DBs\n"
       "  -s, --search              search for matching regex\n"
       "  -g, --group               return packages matching targets as groups\n"
+      "  -o, --owns                return packages owning the files given as targets\n"
       "  -H, --humansize <size>    format package sizes in SI units, or \"auto\"\n"
-      "  -1, --readone             return only the first result of a sync search\n\n"
+      "  -1, --readone             return only the first result of a sync search\n"
+      "  -j, --jobs <n>            use <n> threads to format results and load files (default: 1)\n\n"
       "  -d, --delim <string>      separator used between packages (default: \"\\n\")\n"
       "  -l, --listdelim <string>  separator used between list elements (default: \"  \")\n"
-      "  -p, --file                query local files instead of the DB\n"
+      "  -p, --file                query local files or directories instead of the DB\n"
+      "  -0, --null                targets read from stdin are separated by NUL\n"
       "  -t, --timefmt <fmt>       date format passed to strftime (default: \"%%c\")\n"
-      "      --config <file>       read from <file> for alpm initialization (default: /etc/pacman.conf)\n\n"
+      "      --filter <expr>       only print packages for which <expr> holds (see expac(1))\n"
+      "      --sort <field,...>    print packages ordered by the given fields\n"
+      "      --reverse             sort in descending order\n"
+      "      --limit <n>           print at most <n> packages\n"
+      "      --group-by <field>    print a line per value of <field> instead of each package\n"
+      "      --aggregate <fn,...>  what to print for each group (default: count)\n"
+      "      --output <mode>       print text, or json, jsonl, nul or binary records\n"
+      "      --config <file>       read from <file> for alpm initialization (default: /etc/pacman.conf)\n"
+      "      --bufsize <size>      flush output in chunks of <size> bytes (default: 128K)\n"
+      "      --cachedir <dir>      cache backup file checksums, file owners and sync DB snapshots in <dir>\n"
+      "      --rehash              ignore cached checksums and hash all backup files\n"
+      "      --files               read file lists of sync packages from the .files DBs\n"
+      "      --batch               answer queries read from stdin (see expac(1))\n"
+      "      --serve <socket>      answer queries from clients connecting to <socket>\n"
+      "      --connect <socket>    send the query to a server listening on <socket>\n"
+      "      --stats[=<fd>]        report where the time went on stderr, or as JSON to <fd>\n\n"
       "  -v, --verbose             be more verbose\n\n"
       "  -V, --version             display version information and exit\n"
       "  -h, --help                display this help and exit\n\n"
@@ -167,10 +455,13 @@ static int parse_options(int *argc, char **argv[])
 {
   static struct option opts[] = {
     {"readone",   no_argument,        0, '1'},
+    {"null",      no_argument,        0, '0'},
     {"delim",     required_argument,  0, 'd'},
     {"listdelim", required_argument,  0, 'l'},
     {"group",     required_argument,  0, 'g'},
     {"help",      no_argument,        0, 'h'},
+    {"jobs",      required_argument,  0, 'j'},
+    {"owns",      no_argument,        0, 'o'},
     {"file",      no_argument,        0, 'p'},
     {"humansize", required_argument,  0, 'H'},
     {"query",     no_argument,        0, 'Q'},
@@ -180,13 +471,28 @@ static int parse_options(int *argc, char **argv[])
     {"verbose",   no_argument,        0, 'v'},
     {"version",   no_argument,        0, 'V'},
     {"config",    required_argument,  0, 128},
+    {"bufsize",   required_argument,  0, 129},
+    {"cachedir",  required_argument,  0, 130},
+    {"rehash",    no_argument,        0, 131},
+    {"batch",     no_argument,        0, 132},
+    {"serve",     required_argument,  0, 133},
+    {"connect",   required_argument,  0, 134},
+    {"stats",     optional_argument,  0, 135},
+    {"filter",    required_argument,  0, 136},
+    {"sort",      required_argument,  0, 137},
+    {"reverse",   no_argument,        0, 138},
+    {"limit",     required_argument,  0, 139},
+    {"group-by",  required_argument,  0, 140},
+    {"aggregate", required_argument,  0, 141},
+    {"output",    required_argument,  0, 142},
+    {"files",     no_argument,        0, 143},
     {0, 0, 0, 0}
   };
 
   for(;;) {
     int opt;
 
-    opt = getopt_long(*argc, *argv, "1l:d:gH:hf:pQSst:Vv", opts, NULL);
+    opt = getopt_long(*argc, *argv, "01l:d:gH:hf:j:opQSst:Vv", opts, NULL);
     if(opt < 0) {
       break;
     }
@@ -198,6 +504,9 @@ static int parse_options(int *argc, char **argv[])
       case 'Q':
         opt_corpus = CORPUS_LOCAL;
         break;
+      case '0':
+        opt_null = true;
+        break;
       case '1':
         opt_readone = true;
         break;
@@ -211,19 +520,23 @@ static int parse_options(int *argc, char **argv[])
         opt_listdelim = optarg;
         break;
       case 'H':
-        if(strcmp(optarg, "auto") == 0) {
-          opt_humansize = '\0';
-          break;
-        }
-        if(!is_valid_size_unit(optarg)) {
+        if(parse_humansize(optarg, &opt_humansize) < 0) {
           fprintf(stderr, "error: invalid SI size formatter: %s\n", optarg);
           return -1;
         }
-        opt_humansize = *optarg;
         break;
       case 'h':
         usage();
         exit(0);
+      case 'j':
+        if(parse_jobs(optarg, &opt_jobs) < 0) {
+          fprintf(stderr, "error: invalid number of jobs: %s\n", optarg);
+          return -EINVAL;
+        }
+        break;
+      case 'o':
+        opt_what = SEARCH_OWNER;
+        break;
       case 'p':
         opt_corpus = CORPUS_FILE;
         break;
@@ -243,6 +556,64 @@ static int parse_options(int *argc, char **argv[])
       case 128:
         opt_config_file = optarg;
         break;
+      case 129:
+        if(parse_bufsize(optarg, &opt_bufsize) < 0) {
+          fprintf(stderr, "error: invalid buffer size: %s\n", optarg);
+          return -EINVAL;
+        }
+        break;
+      case 130:
+        opt_cachedir = optarg;
+        break;
+      case 131:
+        opt_rehash = true;
+        break;
+      case 132:
+        opt_batch = true;
+        break;
+      case 133:
+        opt_serve = optarg;
+        break;
+      case 134:
+        opt_connect = optarg;
+        break;
+      case 135:
+        opt_stats = true;
+        if(optarg && parse_stats_fd(optarg, &opt_stats_fd) < 0) {
+          fprintf(stderr, "error: invalid file descriptor for --stats: %s\n", optarg);
+          return -EINVAL;
+        }
+        break;
+      case 136:
+        opt_filter = optarg;
+        break;
+      case 137:
+        opt_sort = optarg;
+        break;
+      case 138:
+        opt_reverse = true;
+        break;
+      case 139:
+        if(parse_limit(optarg, &opt_limit) < 0) {
+          fprintf(stderr, "error: invalid limit: %s\n", optarg);
+          return -EINVAL;
+        }
+        break;
+      case 140:
+        opt_group_by = optarg;
+        break;
+      case 141:
+        opt_aggregate = optarg;
+        break;
+      case 142:
+        if(parse_output(optarg, &opt_output) < 0) {
+          fprintf(stderr, "error: invalid output mode: %s\n", optarg);
+          return -EINVAL;
+        }
+        break;
+      case 143:
+        opt_files = true;
+        break;
 
       case '?':
         return -EINVAL;
@@ -251,79 +622,159 @@ static int parse_options(int *argc, char **argv[])
     }
   }
 
-  if(optind < *argc) {
+  if(opt_what == SEARCH_OWNER && opt_corpus != CORPUS_LOCAL &&
+      !(opt_corpus == CORPUS_SYNC && opt_files)) {
+    fprintf(stderr, "error: --owns only works with --query, or --sync and --files\n");
+    return -EINVAL;
+  }
+
+  if(opt_batch + (opt_serve != NULL) + (opt_connect != NULL) > 1) {
+    fprintf(stderr, "error: only one of --batch, --serve and --connect may be given\n");
+    return -EINVAL;
+  }
+
+  /* in batch and server mode, the format is only a default for requests. A
+   * grouping doesn't take one at all. */
+  if(opt_group_by) {
+    /* nothing to take */
+  } else if(optind < *argc) {
     opt_format = (*argv)[optind++];
-  } else {
+  } else if(!opt_batch && !opt_serve) {
     fprintf(stderr, "error: missing format string (use -h for help)\n");
     return -EINVAL;
   }
 
+  if((opt_batch || opt_serve) && optind < *argc) {
+    fprintf(stderr, "error: targets cannot be given in %s mode\n",
+        opt_batch ? "batch" : "server");
+    return -EINVAL;
+  }
+
   *argc -= optind;
   *argv += optind;
 
   return 0;
 }
 
-static int print_escaped(const char *delim)
+/* the names from a list of dependencies, or of anything else fn can name */
+static alpm_list_t *list_names(alpm_list_t *list, extractfn fn)
+{
+  alpm_list_t *names = NULL;
+
+  for(alpm_list_t *i = list; i; i = i->next) {
+    names = alpm_list_add(names, (void *)fn(i->data));
+  }
+
+  return names;
+}
+
+static alpm_list_t *filelist_names(alpm_filelist_t *filelist)
+{
+  alpm_list_t *names = NULL;
+
+  for(size_t i = 0; i < filelist->count; ++i) {
+    names = alpm_list_add(names, filelist->files[i].name);
+  }
+
+  return names;
+}
+
+/* the files of pkg. With --files, those of a sync package come from the
+ * index of its .files DB, decoded into *decoded, whose files the caller
+ * frees. */
+static alpm_filelist_t *pkg_files(alpm_pkg_t *pkg, alpm_filelist_t *decoded)
+{
+  alpm_db_t *db = alpm_pkg_get_db(pkg);
+
+  memset(decoded, 0, sizeof(*decoded));
+
+  if(nrepo_files == 0 || alpm_pkg_get_origin(pkg) != ALPM_PKG_FROM_SYNCDB) {
+    return alpm_pkg_get_files(pkg);
+  }
+
+  for(size_t i = 0; i < nrepo_files; ++i) {
+    const filesdb_t *index = &repo_files[i].index;
+    ssize_t n;
+
+    if(repo_files[i].db != db || index->header == NULL) {
+      continue;
+    }
+
+    n = filesdb_find(index, alpm_pkg_get_name(pkg));
+    if(n >= 0 && filesdb_files(index, n, decoded) == 0) {
+      return decoded;
+    }
+    break;
+  }
+
+  return alpm_pkg_get_files(pkg);
+}
+
+static bool output_json(void)
+{
+  return opt_output == OUTPUT_JSON || opt_output == OUTPUT_JSONL;
+}
+
+/* a list as a JSON array, or for --output=nul as its length followed by its
+ * items, each ending in a NUL, and likewise for --output=binary */
+static int print_structured_list(outbuf_t *buf, alpm_list_t *list,
+    extractfn fn)
 {
-  const char *f;
+  char countbuf[21];
   int out = 0;
 
-  for(f = delim; *f != '\0'; f++) {
-    if(*f == '\\') {
-      switch (*++f) {
-        case '\\':
-          fputc('\\', stdout);
-          break;
-        case '"':
-          fputc('\"', stdout);
-          break;
-        case 'a':
-          fputc('\a', stdout);
-          break;
-        case 'b':
-          fputc('\b', stdout);
-          break;
-        case 'e': /* \e is nonstandard */
-          fputc('\033', stdout);
-          break;
-        case 'n':
-          fputc('\n', stdout);
-          break;
-        case 'r':
-          fputc('\r', stdout);
-          break;
-        case 't':
-          fputc('\t', stdout);
-          break;
-        case 'v':
-          fputc('\v', stdout);
-          break;
-        case '0':
-          fputc('\0', stdout);
-          break;
-        default:
-          fputc(*f, stdout);
-          break;
-      }
-      ++out;
+  if(opt_output == OUTPUT_BINARY) {
+    out += binary_put_uint(buf, alpm_list_count(list));
+    for(alpm_list_t *i = list; i; i = i->next) {
+      out += binary_put_str(&binary, buf, fn ? fn(i->data) : i->data);
+    }
+    return out;
+  }
+
+  if(opt_output == OUTPUT_NUL) {
+    out += outbuf_write(buf, countbuf,
+        uint_to_str(alpm_list_count(list), countbuf) + 1);
+  } else {
+    out += outbuf_putc(buf, '[');
+  }
+
+  for(alpm_list_t *i = list; i; i = i->next) {
+    const char *item = fn ? fn(i->data) : i->data;
+
+    if(item == NULL) {
+      item = "";
+    }
+
+    if(opt_output == OUTPUT_NUL) {
+      out += outbuf_write(buf, item, strlen(item) + 1);
     } else {
-      fputc(*f, stdout);
-      ++out;
+      if(i != list) {
+        out += outbuf_putc(buf, ',');
+      }
+      out += outbuf_json_string(buf, item);
     }
   }
 
+  if(opt_output != OUTPUT_NUL) {
+    out += outbuf_putc(buf, ']');
+  }
+
   return out;
 }
 
-static int print_list(alpm_list_t *list, extractfn fn)
+static int print_list(outbuf_t *buf, const format_t *format, alpm_list_t *list,
+    extractfn fn)
 {
   alpm_list_t *i;
   int out = 0;
 
+  if(opt_output != OUTPUT_TEXT) {
+    return print_structured_list(buf, list, fn);
+  }
+
   if(!list) {
     if(opt_verbose) {
-      out += printf("None");
+      out += outbuf_puts(buf, "None");
     }
     return out;
   }
@@ -335,10 +786,10 @@ static int print_list(alpm_list_t *list, extractfn fn)
       continue;
     }
 
-    out += printf("%s", item);
+    out += outbuf_puts(buf, item);
 
     if((i = i->next)) {
-      out += print_escaped(opt_listdelim);
+      out += outbuf_write(buf, format->listdelim, format->listdelim_len);
     } else {
       break;
     }
@@ -347,72 +798,74 @@ static int print_list(alpm_list_t *list, extractfn fn)
   return out;
 }
 
-static int print_allocated_list(alpm_list_t *list, extractfn fn)
+static int print_allocated_list(outbuf_t *buf, const format_t *format,
+    alpm_list_t *list, extractfn fn)
 {
-  int out = print_list(list, fn);
+  int out = print_list(buf, format, list, fn);
   alpm_list_free(list);
   return out;
 }
 
-static int print_time(time_t timestamp) {
-  char buffer[64];
+static int print_time(outbuf_t *buf, time_t timestamp) {
+  char buffer[TIMEFMT_MAX];
+  size_t len;
   int out = 0;
 
+  if(output_json()) {
+    if(!timestamp) {
+      return outbuf_write(buf, "null", 4);
+    }
+    return outbuf_write(buf, buffer, int_to_str(timestamp, buffer));
+  }
+
+  /* varints are unsigned, so dates before the epoch are sent as none */
+  if(opt_output == OUTPUT_BINARY) {
+    return binary_put_uint(buf, timestamp < 0 ? 0 : timestamp);
+  }
+
   if(!timestamp) {
     if(opt_verbose) {
-      out += printf("None");
+      out += outbuf_puts(buf, "None");
     }
-    return out;
+  } else {
+    len = timefmt_format(opt_timefmt, timestamp, buffer);
+    out += outbuf_write(buf, buffer, len);
   }
 
-  /* no overflow here, strftime prints a max of 64 including null */
-  strftime(&buffer[0], 64, opt_timefmt, localtime(&timestamp));
-  out += printf("%s", buffer);
+  if(opt_output == OUTPUT_NUL) {
+    out += outbuf_putc(buf, '\0');
+  }
 
   return out;
 }
 
-static int print_filelist(alpm_filelist_t *filelist)
+static int print_filelist(outbuf_t *buf, const format_t *format,
+    alpm_filelist_t *filelist)
 {
   int out = 0;
   size_t i;
 
+  if(opt_output != OUTPUT_TEXT) {
+    return print_allocated_list(buf, format, filelist_names(filelist), NULL);
+  }
+
   for(i = 0; i < filelist->count; i++) {
-    out += printf("%s", (filelist->files + i)->name);
+    out += outbuf_puts(buf, (filelist->files + i)->name);
     if(i < filelist->count - 1) {
-      out += print_escaped(opt_listdelim);
+      out += outbuf_write(buf, format->listdelim, format->listdelim_len);
     }
   }
 
   return out;
 }
 
-static bool backup_file_is_modified(const alpm_backup_t *backup_file)
-{
-  char fullpath[PATH_MAX];
-  _cleanup_free_ char *md5sum = NULL;
-  bool modified;
-
-  /* TODO: respect expac->dbroot */
-  snprintf(fullpath, sizeof(fullpath), "/%s", backup_file->name);
-
-  md5sum = alpm_compute_md5sum(fullpath);
-  if(md5sum == NULL) {
-    return false;
-  }
-
-  modified = strcmp(md5sum, backup_file->hash) != 0;
-
-  return modified;
-}
-
 static alpm_list_t *get_modified_files(alpm_pkg_t *pkg)
 {
   alpm_list_t *i, *modified_files = NULL;
 
   for(i = alpm_pkg_get_backup(pkg); i; i = i->next) {
     const alpm_backup_t *backup = i->data;
-    if(backup->hash && backup_file_is_modified(backup)) {
+    if(backup->hash && modified_check(&modified_backups, backup)) {
       modified_files = alpm_list_add(modified_files, backup->name);
     }
   }
@@ -447,489 +900,3113 @@ static alpm_list_t *get_validation_method(alpm_pkg_t *pkg)
   return validation;
 }
 
-static void print_pkg(alpm_pkg_t *pkg, const char *format)
+static int print_str(outbuf_t *buf, const format_op_t *op, const char *str)
 {
-  const char *f, *end;
-  int out = 0;
+  if(opt_output == OUTPUT_BINARY) {
+    return binary_put_str(&binary, buf, str);
+  }
 
-  end = format + strlen(format);
-
-  for(f = format; f < end; f++) {
-    if(*f == '%') {
-      char fmt[64] = {0};
-      int l = 1;
-
-      l += strspn(f + l, printf_flags);
-      l += strspn(f + l, digits);
-      memcpy(fmt, f, l);
-      fmt[l] = 's';
-
-      f += l;
-      switch (*f) {
-        /* simple attributes */
-        case 'f': /* filename */
-          out += printf(fmt, alpm_pkg_get_filename(pkg));
-          break;
-        case 'e': /* package base */
-          out += printf(fmt, alpm_pkg_get_base(pkg));
-          break;
-        case 'n': /* package name */
-          out += printf(fmt, alpm_pkg_get_name(pkg));
-          break;
-        case 'v': /* version */
-          out += printf(fmt, alpm_pkg_get_version(pkg));
-          break;
-        case 'd': /* description */
-          out += printf(fmt, alpm_pkg_get_desc(pkg));
-          break;
-        case 'u': /* project url */
-          out += printf(fmt, alpm_pkg_get_url(pkg));
-          break;
-        case 'p': /* packager name */
-          out += printf(fmt, alpm_pkg_get_packager(pkg));
-          break;
-        case 's': /* md5sum */
-          out += printf(fmt, alpm_pkg_get_md5sum(pkg));
-          break;
-        case 'a': /* architecture */
-          out += printf(fmt, alpm_pkg_get_arch(pkg));
-          break;
-        case 'i': /* has install scriptlet? */
-          out += printf(fmt, alpm_pkg_has_scriptlet(pkg) ? "yes" : "no");
-          break;
-        case 'r': /* repo */
-          out += printf(fmt, alpm_db_get_name(alpm_pkg_get_db(pkg)));
-          break;
-        case 'w': /* install reason */
-          out += printf(fmt, alpm_pkg_get_reason(pkg) ? "dependency" : "explicit");
-          break;
-        case '!': /* result number */
-          fmt[strlen(fmt)-1] = 'd';
-          out += printf(fmt, opt_pkgcounter++);
-          break;
-        case 'g': /* base64 gpg sig */
-          out += printf(fmt, alpm_pkg_get_base64_sig(pkg));
-          break;
-        case 'h': /* sha256sum */
-          out += printf(fmt, alpm_pkg_get_sha256sum(pkg));
-          break;
-
-        /* times */
-        case 'b': /* build date */
-          out += print_time(alpm_pkg_get_builddate(pkg));
-          break;
-        case 'l': /* install date */
-          out += print_time(alpm_pkg_get_installdate(pkg));
-          break;
-
-        /* sizes */
-        case 'k': /* download size */
-          out += printf(fmt, size_to_string(alpm_pkg_get_size(pkg)));
-          break;
-        case 'm': /* install size */
-          out += printf(fmt, size_to_string(alpm_pkg_get_isize(pkg)));
-          break;
-
-        /* lists */
-        case 'F': /* files */
-          out += print_filelist(alpm_pkg_get_files(pkg));
-          break;
-        case 'N': /* requiredby */
-          out += print_list(alpm_pkg_compute_requiredby(pkg), NULL);
-          break;
-        case 'W': /* optionalfor */
-          out += print_list(alpm_pkg_compute_optionalfor(pkg), NULL);
-          break;
-        case 'L': /* licenses */
-          out += print_list(alpm_pkg_get_licenses(pkg), NULL);
-          break;
-        case 'G': /* groups */
-          out += print_list(alpm_pkg_get_groups(pkg), NULL);
-          break;
-        case 'E': /* depends (shortdeps) */
-          out += print_list(alpm_pkg_get_depends(pkg), (extractfn)alpm_dep_get_name);
-          break;
-        case 'J': /* makedepends */
-          out += print_list(alpm_pkg_get_makedepends(pkg), (extractfn)alpm_dep_compute_string);
-          break;
-        case 'K': /* checkdepends */
-          out += print_list(alpm_pkg_get_checkdepends(pkg), (extractfn)alpm_dep_compute_string);
-          break;
-        case 'D': /* depends */
-          out += print_list(alpm_pkg_get_depends(pkg), (extractfn)alpm_dep_compute_string);
-          break;
-        case 'O': /* optdepends */
-          out += print_list(alpm_pkg_get_optdepends(pkg), (extractfn)format_optdep);
-          break;
-        case 'o': /* optdepends (shortdeps) */
-          out += print_list(alpm_pkg_get_optdepends(pkg), (extractfn)alpm_dep_get_name);
-          break;
-        case 'H': /* conflicts */
-          out += print_list(alpm_pkg_get_conflicts(pkg), (extractfn)alpm_dep_compute_string);
-          break;
-        case 'C': /* conflicts (shortdeps) */
-          out += print_list(alpm_pkg_get_conflicts(pkg), (extractfn)alpm_dep_get_name);
-          break;
-        case 'S': /* provides (shortdeps) */
-          out += print_list(alpm_pkg_get_provides(pkg), (extractfn)alpm_dep_get_name);
-          break;
-        case 'P': /* provides */
-          out += print_list(alpm_pkg_get_provides(pkg), (extractfn)alpm_dep_compute_string);
-          break;
-        case 'R': /* replaces (shortdeps) */
-          out += print_list(alpm_pkg_get_replaces(pkg), (extractfn)alpm_dep_get_name);
-          break;
-        case 'T': /* replaces */
-          out += print_list(alpm_pkg_get_replaces(pkg), (extractfn)alpm_dep_compute_string);
-          break;
-        case 'B': /* backup */
-          out += print_list(alpm_pkg_get_backup(pkg), (extractfn)alpm_backup_get_name);
-          break;
-        case 'V': /* package validation */
-          out += print_allocated_list(get_validation_method(pkg), NULL);
-          break;
-        case 'M': /* modified */
-          out += print_allocated_list(get_modified_files(pkg), NULL);
-          break;
-        case '%':
-          fputc('%', stdout);
-          out++;
-          break;
-        default:
-          fputc('?', stdout);
-          out++;
-          break;
-      }
-    } else if(*f == '\\') {
-      char esc[3] = { f[0], f[1], '\0' };
-      out += print_escaped(esc);
-      ++f;
-    } else {
-      fputc(*f, stdout);
-      out++;
-    }
+  if(output_json()) {
+    return str ? outbuf_json_string(buf, str) : outbuf_write(buf, "null", 4);
   }
 
-  /* only print a delimeter if any package data was outputted */
-  if(out > 0) {
-    print_escaped(opt_delim);
+  /* structured output has no use for widths and such */
+  if(opt_output == OUTPUT_NUL) {
+    str = str ? str : "";
+    return outbuf_write(buf, str, strlen(str) + 1);
+  }
+
+  if(op->spec) {
+    return outbuf_printf(buf, op->spec, str);
+  }
+
+  /* match printf's rendering of a NULL %s */
+  if(str == NULL) {
+    str = "(null)";
   }
+
+  return outbuf_puts(buf, str);
 }
 
-static alpm_list_t *all_packages(alpm_list_t *dbs)
+static int print_number(outbuf_t *buf, const format_op_t *op, uint64_t n)
 {
-  alpm_list_t *i, *packages = NULL;
+  char numbuf[21];
+  size_t len = uint_to_str(n, numbuf);
 
-  for(i = dbs; i; i = i->next) {
-    packages = alpm_list_join(packages, alpm_list_copy(alpm_db_get_pkgcache(i->data)));
+  if(opt_output == OUTPUT_BINARY) {
+    return binary_put_uint(buf, n);
   }
 
-  return packages;
+  if(output_json()) {
+    return outbuf_write(buf, numbuf, len);
+  }
+
+  return print_str(buf, op, numbuf);
 }
 
-static alpm_list_t *search_packages(alpm_list_t *dbs, alpm_list_t *targets)
+/* bytes as a number in JSON or binary, otherwise as --humansize would have
+ * it */
+static int print_size(outbuf_t *buf, const format_op_t *op, off_t bytes)
 {
-  alpm_list_t *i, *packages = NULL;
+  char sizebuf[64];
 
-  for(i = dbs; i; i = i->next) {
-    alpm_list_t *results = NULL;
-#ifdef HAVE_THREE_ARG_DB_SEARCH
-    alpm_db_search(i->data, targets, &results);
-#else
-    results = alpm_db_search(i->data, targets);
-#endif
-    packages = alpm_list_join(packages, results);
+  /* varints are unsigned, so a negative size is sent as 0 */
+  if(opt_output == OUTPUT_BINARY) {
+    return binary_put_uint(buf, bytes < 0 ? 0 : bytes);
   }
 
-  return packages;
+  if(output_json()) {
+    return outbuf_write(buf, sizebuf, int_to_str(bytes, sizebuf));
+  }
+
+  return print_str(buf, op, size_to_string(bytes, sizebuf, sizeof(sizebuf)));
 }
 
-static alpm_list_t *search_groups(alpm_list_t *dbs, alpm_list_t *groupnames)
+/* the packages pkg depends on, or is required by, directly or not, as a bit
+ * for each package in the graph */
+static uint64_t *closure_set(alpm_pkg_t *pkg, bool requiredby)
 {
-  alpm_list_t *i, *j, *packages = NULL;
+  uint64_t *set = malloc((depgraph.words + 1) * sizeof(uint64_t));
 
-  for(i = groupnames; i; i = i->next) {
-    for(j = dbs; j; j = j->next) {
-      alpm_group_t *grp = alpm_db_get_group(j->data, i->data);
-      if(grp != NULL) {
-        packages = alpm_list_join(packages, alpm_list_copy(grp->packages));
-      }
-    }
+  if(set) {
+    depgraph_closure(&depgraph, pkg, requiredby, set);
   }
 
-  return packages;
+  return set;
 }
 
-static alpm_list_t *search_exact(alpm_list_t *dblist, alpm_list_t *targets)
+static alpm_list_t *closure_names(alpm_pkg_t *pkg, bool requiredby)
 {
-  alpm_list_t *results = NULL;
-
-  /* resolve each target individually from the repo pool */
-  for(alpm_list_t *t = targets; t; t = t->next) {
-    char *pkgname, *reponame;
-    alpm_list_t *r;
-    int found = 0;
+  _cleanup_free_ uint64_t *set = closure_set(pkg, requiredby);
+  alpm_list_t *names = NULL;
 
-    pkgname = reponame = t->data;
-    if(strchr(pkgname, '/')) {
-      strsep(&pkgname, "/");
-    } else {
-      reponame = NULL;
+  for(size_t w = 0; set && w < depgraph.words; ++w) {
+    for(uint64_t bits = set[w]; bits; bits &= bits - 1) {
+      alpm_pkg_t *dep = depgraph.providers.pkgs[w * 64 + __builtin_ctzll(bits)];
+      names = alpm_list_add(names, (void *)alpm_pkg_get_name(dep));
     }
+  }
 
-    for(r = dblist; r; r = r->next) {
-      alpm_db_t *repo = r->data;
-      alpm_pkg_t *pkg;
+  return names;
+}
 
-      if(reponame && strcmp(reponame, alpm_db_get_name(repo)) != 0) {
-        continue;
-      }
+static int print_closure(outbuf_t *buf, const format_t *format,
+    alpm_pkg_t *pkg, bool requiredby)
+{
+  return print_allocated_list(buf, format, closure_names(pkg, requiredby),
+      NULL);
+}
 
-      pkg = alpm_db_get_pkg(repo, pkgname);
-      if(pkg == NULL) {
-        continue;
-      }
+static int print_closure_count(outbuf_t *buf, const format_op_t *op,
+    alpm_pkg_t *pkg, bool requiredby)
+{
+  _cleanup_free_ uint64_t *set = closure_set(pkg, requiredby);
+  size_t count = 0;
 
-      found = 1;
-      results = alpm_list_add(results, pkg);
-      if(opt_readone) {
+  for(size_t w = 0; set && w < depgraph.words; ++w) {
+    count += __builtin_popcountll(set[w]);
+  }
+
+  return print_number(buf, op, count);
+}
+
+/* prints the field op stands for. counter is the value of the next %! */
+static int print_field(outbuf_t *buf, alpm_pkg_t *pkg, const format_t *format,
+    const format_op_t *op, int *counter)
+{
+  alpm_list_t *list;
+  int out = 0;
+
+  switch (op->token) {
+    /* simple attributes */
+    case 'f': /* filename */
+      out += print_str(buf, op, alpm_pkg_get_filename(pkg));
+      break;
+    case 'e': /* package base */
+      out += print_str(buf, op, alpm_pkg_get_base(pkg));
+      break;
+    case 'n': /* package name */
+      out += print_str(buf, op, alpm_pkg_get_name(pkg));
+      break;
+    case 'v': /* version */
+      out += print_str(buf, op, alpm_pkg_get_version(pkg));
+      break;
+    case 'd': /* description */
+      out += print_str(buf, op, alpm_pkg_get_desc(pkg));
+      break;
+    case 'u': /* project url */
+      out += print_str(buf, op, alpm_pkg_get_url(pkg));
+      break;
+    case 'p': /* packager name */
+      out += print_str(buf, op, alpm_pkg_get_packager(pkg));
+      break;
+    case 's': /* md5sum */
+      out += print_str(buf, op, alpm_pkg_get_md5sum(pkg));
+      break;
+    case 'a': /* architecture */
+      out += print_str(buf, op, alpm_pkg_get_arch(pkg));
+      break;
+    case 'i': /* has install scriptlet? */
+      out += print_str(buf, op, alpm_pkg_has_scriptlet(pkg) ? "yes" : "no");
+      break;
+    case 'r': /* repo */
+      out += print_str(buf, op, alpm_db_get_name(alpm_pkg_get_db(pkg)));
+      break;
+    case 'w': /* install reason */
+      out += print_str(buf, op, alpm_pkg_get_reason(pkg) ? "dependency" : "explicit");
+      break;
+    case '!': /* result number */
+      if(opt_output == OUTPUT_TEXT) {
+        out += outbuf_printf(buf, op->spec, (*counter)++);
+      } else {
+        out += print_number(buf, op, (*counter)++);
+      }
+      break;
+    case 'g': /* base64 gpg sig */
+      out += print_str(buf, op, alpm_pkg_get_base64_sig(pkg));
+      break;
+    case 'h': /* sha256sum */
+      out += print_str(buf, op, alpm_pkg_get_sha256sum(pkg));
+      break;
+
+    /* times */
+    case 'b': /* build date */
+      out += print_time(buf, alpm_pkg_get_builddate(pkg));
+      break;
+    case 'l': /* install date */
+      out += print_time(buf, alpm_pkg_get_installdate(pkg));
+      break;
+
+    /* sizes */
+    case 'k': /* download size */
+      out += print_size(buf, op, alpm_pkg_get_size(pkg));
+      break;
+    case 'm': /* install size */
+      out += print_size(buf, op, alpm_pkg_get_isize(pkg));
+      break;
+
+    /* counts */
+    case 'x': /* depends, recursively */
+      out += print_closure_count(buf, op, pkg, false);
+      break;
+    case 'y': /* requiredby, recursively */
+      out += print_closure_count(buf, op, pkg, true);
+      break;
+
+    /* lists */
+    case 'F': { /* files */
+      alpm_filelist_t decoded;
+
+      out += print_filelist(buf, format, pkg_files(pkg, &decoded));
+      free(decoded.files);
+      break;
+    }
+    case 'N': /* requiredby */
+      if(requiredby.pkgs) {
+        out += print_allocated_list(buf, format,
+            revdeps_lookup(&requiredby, pkg), NULL);
+        break;
+      }
+      pthread_mutex_lock(&alpm_lock);
+      list = alpm_pkg_compute_requiredby(pkg);
+      pthread_mutex_unlock(&alpm_lock);
+      out += print_list(buf, format, list, NULL);
+      break;
+    case 'W': /* optionalfor */
+      if(optionalfor.pkgs) {
+        out += print_allocated_list(buf, format,
+            revdeps_lookup(&optionalfor, pkg), NULL);
+        break;
+      }
+      pthread_mutex_lock(&alpm_lock);
+      list = alpm_pkg_compute_optionalfor(pkg);
+      pthread_mutex_unlock(&alpm_lock);
+      out += print_list(buf, format, list, NULL);
+      break;
+    case 'X': /* depends, recursively */
+      out += print_closure(buf, format, pkg, false);
+      break;
+    case 'Y': /* requiredby, recursively */
+      out += print_closure(buf, format, pkg, true);
+      break;
+    case 'L': /* licenses */
+      out += print_list(buf, format, alpm_pkg_get_licenses(pkg), NULL);
+      break;
+    case 'G': /* groups */
+      out += print_list(buf, format, alpm_pkg_get_groups(pkg), NULL);
+      break;
+    case 'E': /* depends (shortdeps) */
+      out += print_list(buf, format, alpm_pkg_get_depends(pkg), (extractfn)alpm_dep_get_name);
+      break;
+    case 'J': /* makedepends */
+      out += print_list(buf, format, alpm_pkg_get_makedepends(pkg), (extractfn)alpm_dep_compute_string);
+      break;
+    case 'K': /* checkdepends */
+      out += print_list(buf, format, alpm_pkg_get_checkdepends(pkg), (extractfn)alpm_dep_compute_string);
+      break;
+    case 'D': /* depends */
+      out += print_list(buf, format, alpm_pkg_get_depends(pkg), (extractfn)alpm_dep_compute_string);
+      break;
+    case 'O': /* optdepends */
+      out += print_list(buf, format, alpm_pkg_get_optdepends(pkg), (extractfn)format_optdep);
+      break;
+    case 'o': /* optdepends (shortdeps) */
+      out += print_list(buf, format, alpm_pkg_get_optdepends(pkg), (extractfn)alpm_dep_get_name);
+      break;
+    case 'H': /* conflicts */
+      out += print_list(buf, format, alpm_pkg_get_conflicts(pkg), (extractfn)alpm_dep_compute_string);
+      break;
+    case 'C': /* conflicts (shortdeps) */
+      out += print_list(buf, format, alpm_pkg_get_conflicts(pkg), (extractfn)alpm_dep_get_name);
+      break;
+    case 'S': /* provides (shortdeps) */
+      out += print_list(buf, format, alpm_pkg_get_provides(pkg), (extractfn)alpm_dep_get_name);
+      break;
+    case 'P': /* provides */
+      out += print_list(buf, format, alpm_pkg_get_provides(pkg), (extractfn)alpm_dep_compute_string);
+      break;
+    case 'R': /* replaces (shortdeps) */
+      out += print_list(buf, format, alpm_pkg_get_replaces(pkg), (extractfn)alpm_dep_get_name);
+      break;
+    case 'T': /* replaces */
+      out += print_list(buf, format, alpm_pkg_get_replaces(pkg), (extractfn)alpm_dep_compute_string);
+      break;
+    case 'B': /* backup */
+      out += print_list(buf, format, alpm_pkg_get_backup(pkg), (extractfn)alpm_backup_get_name);
+      break;
+    case 'V': /* package validation */
+      out += print_allocated_list(buf, format, get_validation_method(pkg), NULL);
+      break;
+    case 'M': /* modified */
+      out += print_allocated_list(buf, format, get_modified_files(pkg), NULL);
+      break;
+  }
+
+  return out;
+}
+
+/* index is the package's position in the results */
+static void print_pkg(outbuf_t *buf, alpm_pkg_t *pkg, const format_t *format,
+    size_t index)
+{
+  int counter = index * format->counters;
+  bool first = true;
+  uint64_t start;
+  int out = 0;
+
+  if(opt_output == OUTPUT_JSON) {
+    outbuf_puts(buf, index ? ",\n" : "\n");
+  }
+  if(output_json()) {
+    outbuf_putc(buf, '{');
+  }
+
+  for(size_t i = 0; i < format->size; ++i) {
+    const format_op_t *op = &format->ops[i];
+
+    if(op->type == FORMAT_OP_LITERAL) {
+      if(opt_output == OUTPUT_TEXT) {
+        out += outbuf_write(buf, op->literal, op->len);
+      }
+      continue;
+    }
+
+    /* each field becomes a key, named after the token */
+    if(output_json()) {
+      if(!first) {
+        outbuf_putc(buf, ',');
+      }
+      outbuf_json_string(buf, field_key(op->token));
+      outbuf_putc(buf, ':');
+    }
+    first = false;
+
+    start = opt_stats ? stats_now() : 0;
+
+    if(opt_output == OUTPUT_BINARY) {
+      binary_begin_field(&binary, op->token);
+      print_field(&binary.record, pkg, format, op, &counter);
+    } else {
+      out += print_field(buf, pkg, format, op, &counter);
+    }
+
+    if(opt_stats) {
+      stats_token(op->token, stats_now() - start);
+    }
+  }
+
+  if(output_json()) {
+    outbuf_write(buf, "}\n", opt_output == OUTPUT_JSONL ? 2 : 1);
+    return;
+  }
+
+  if(opt_output == OUTPUT_BINARY) {
+    binary_end_record(&binary, buf);
+    return;
+  }
+
+  /* records made only of NUL terminated fields need no delimiter */
+  if(opt_output == OUTPUT_NUL) {
+    return;
+  }
+
+  /* only print a delimeter if any package data was outputted */
+  if(out > 0) {
+    outbuf_write(buf, format->delim, format->delim_len);
+  }
+}
+
+static void revdeps_value(const revdeps_t *revdeps, alpm_pkg_t *pkg,
+    bool optional, field_value_t *value)
+{
+  if(revdeps->pkgs) {
+    value->list = revdeps_lookup(revdeps, pkg);
+    value->owned = true;
+    return;
+  }
+
+  pthread_mutex_lock(&alpm_lock);
+  value->list = optional ? alpm_pkg_compute_optionalfor(pkg) :
+    alpm_pkg_compute_requiredby(pkg);
+  pthread_mutex_unlock(&alpm_lock);
+  value->owned = value->owned_items = true;
+}
+
+/* pkg's value of field, as the matching token would print it. Fields worked
+ * out over all of the results are only known once ready is set. */
+static int field_get(void *ctx, alpm_pkg_t *pkg, const field_t *field,
+    field_value_t *value)
+{
+  const bool *ready = ctx;
+
+  if(field->deferred && !*ready) {
+    return -EAGAIN;
+  }
+
+  switch (field->token) {
+    case 'a':
+      value->str = alpm_pkg_get_arch(pkg);
+      break;
+    case 'd':
+      value->str = alpm_pkg_get_desc(pkg);
+      break;
+    case 'e':
+      value->str = alpm_pkg_get_base(pkg);
+      break;
+    case 'f':
+      value->str = alpm_pkg_get_filename(pkg);
+      break;
+    case 'h':
+      value->str = alpm_pkg_get_sha256sum(pkg);
+      break;
+    case 'n':
+      value->str = alpm_pkg_get_name(pkg);
+      break;
+    case 'p':
+      value->str = alpm_pkg_get_packager(pkg);
+      break;
+    case 'r':
+      value->str = alpm_db_get_name(alpm_pkg_get_db(pkg));
+      break;
+    case 's':
+      value->str = alpm_pkg_get_md5sum(pkg);
+      break;
+    case 'u':
+      value->str = alpm_pkg_get_url(pkg);
+      break;
+    case 'v':
+      value->str = alpm_pkg_get_version(pkg);
+      break;
+    case 'w':
+      value->str = alpm_pkg_get_reason(pkg) ? "dependency" : "explicit";
+      break;
+
+    case 'b':
+      value->num = alpm_pkg_get_builddate(pkg);
+      break;
+    case 'l':
+      value->num = alpm_pkg_get_installdate(pkg);
+      break;
+    case 'k':
+      value->num = alpm_pkg_get_size(pkg);
+      break;
+    case 'm':
+      value->num = alpm_pkg_get_isize(pkg);
+      break;
+
+    case 'G':
+      value->list = alpm_pkg_get_groups(pkg);
+      break;
+    case 'L':
+      value->list = alpm_pkg_get_licenses(pkg);
+      break;
+    case 'B':
+      value->list = list_names(alpm_pkg_get_backup(pkg),
+          (extractfn)alpm_backup_get_name);
+      value->owned = true;
+      break;
+    case 'C':
+    case 'E':
+    case 'J':
+    case 'K':
+    case 'o':
+    case 'R':
+    case 'S': {
+      alpm_list_t *deps = NULL;
+
+      switch (field->token) {
+        case 'C': deps = alpm_pkg_get_conflicts(pkg); break;
+        case 'E': deps = alpm_pkg_get_depends(pkg); break;
+        case 'J': deps = alpm_pkg_get_makedepends(pkg); break;
+        case 'K': deps = alpm_pkg_get_checkdepends(pkg); break;
+        case 'o': deps = alpm_pkg_get_optdepends(pkg); break;
+        case 'R': deps = alpm_pkg_get_replaces(pkg); break;
+        case 'S': deps = alpm_pkg_get_provides(pkg); break;
+      }
+
+      value->list = list_names(deps, (extractfn)alpm_dep_get_name);
+      value->owned = true;
+      break;
+    }
+    case 'F': {
+      alpm_filelist_t decoded;
+      alpm_filelist_t *files = pkg_files(pkg, &decoded);
+
+      value->list = filelist_names(files);
+      value->owned = true;
+
+      /* decoded names go away with decoded */
+      if(files == &decoded) {
+        for(alpm_list_t *i = value->list; i; i = i->next) {
+          i->data = strdup(i->data);
+        }
+        value->owned_items = true;
+        free(decoded.files);
+      }
+      break;
+    }
+    case 'V':
+      value->list = get_validation_method(pkg);
+      value->owned = true;
+      break;
+
+    case 'M':
+      value->list = get_modified_files(pkg);
+      value->owned = true;
+      break;
+    case 'N':
+      revdeps_value(&requiredby, pkg, false, value);
+      break;
+    case 'W':
+      revdeps_value(&optionalfor, pkg, true, value);
+      break;
+    case 'X':
+    case 'Y':
+      value->list = closure_names(pkg, field->token == 'Y');
+      value->owned = true;
+      break;
+  }
+
+  return 0;
+}
+
+/* drops the results which can't pass filter. Until ready, those which might
+ * are kept and marked as such in pending, which must have room for each of
+ * the results. Once ready, only those marked are looked at again. */
+static alpm_list_t *filter_results(const filter_t *filter, alpm_list_t *results,
+    bool ready, bool *pending)
+{
+  alpm_list_t *kept = NULL;
+  size_t n = 0, k = 0;
+
+  for(alpm_list_t *i = results; i; i = i->next, ++n) {
+    filter_result_t r = FILTER_TRUE;
+
+    if(!ready || pending[n]) {
+      r = filter_eval(filter, i->data, field_get, &ready);
+    }
+
+    if(r == FILTER_FALSE) {
+      continue;
+    }
+
+    if(!ready) {
+      pending[k++] = r == FILTER_UNKNOWN;
+    }
+    kept = alpm_list_add(kept, i->data);
+  }
+
+  alpm_list_free(results);
+
+  return kept;
+}
+
+static alpm_list_t *all_packages(alpm_list_t *dbs)
+{
+  alpm_list_t *i, *packages = NULL;
+
+  for(i = dbs; i; i = i->next) {
+    packages = alpm_list_join(packages, alpm_list_copy(alpm_db_get_pkgcache(i->data)));
+  }
+
+  return packages;
+}
+
+typedef struct dbsearch_t {
+  search_t *searches;
+  alpm_db_t **dbs;
+  alpm_list_t **results;
+} dbsearch_t;
+
+static void search_one(void *ctx, size_t worker, size_t job)
+{
+  dbsearch_t *dbsearch = ctx;
+
+  dbsearch->results[job] = search_db(&dbsearch->searches[worker],
+      dbsearch->dbs[job]);
+}
+
+static alpm_list_t *search_packages(alpm_list_t *dbs, alpm_list_t *targets)
+{
+  _cleanup_free_ search_t *searches = NULL;
+  _cleanup_free_ alpm_db_t **dbarray = NULL;
+  _cleanup_free_ alpm_list_t **results = NULL;
+  alpm_list_t *packages = NULL;
+  size_t count = alpm_list_count(dbs), nworkers, compiled, n = 0;
+  dbsearch_t dbsearch;
+
+  if(count == 0) {
+    return NULL;
+  }
+
+  nworkers = pool_online_cpus();
+  if(nworkers > count) {
+    nworkers = count;
+  }
+
+  searches = calloc(nworkers, sizeof(search_t));
+  dbarray = malloc(count * sizeof(alpm_db_t *));
+  results = calloc(count, sizeof(alpm_list_t *));
+  if(searches == NULL || dbarray == NULL || results == NULL) {
+    return NULL;
+  }
+
+  /* glibc serializes regexec on a shared regex_t, so each worker compiles
+   * its own. An invalid regex finds nothing, as with alpm_db_search. */
+  for(compiled = 0; compiled < nworkers; ++compiled) {
+    if(search_compile(&searches[compiled], targets) < 0) {
+      break;
+    }
+  }
+  if(compiled == 0) {
+    return NULL;
+  }
+
+  /* libalpm populates its caches lazily, and can't be left to do so from
+   * several threads at once */
+  for(alpm_list_t *i = dbs; i; i = i->next) {
+    alpm_db_get_pkgcache(i->data);
+    dbarray[n++] = i->data;
+  }
+
+  dbsearch = (dbsearch_t){
+    .searches = searches,
+    .dbs = dbarray,
+    .results = results,
+  };
+  pool_run(compiled, count, search_one, &dbsearch);
+
+  for(size_t i = 0; i < count; ++i) {
+    packages = alpm_list_join(packages, results[i]);
+  }
+
+  for(size_t i = 0; i < compiled; ++i) {
+    search_reset(&searches[i]);
+  }
+
+  return packages;
+}
+
+static alpm_list_t *search_groups(alpm_list_t *dbs, alpm_list_t *groupnames)
+{
+  alpm_list_t *i, *j, *packages = NULL;
+
+  for(i = groupnames; i; i = i->next) {
+    for(j = dbs; j; j = j->next) {
+      alpm_group_t *grp = alpm_db_get_group(j->data, i->data);
+      if(grp != NULL) {
+        packages = alpm_list_join(packages, alpm_list_copy(grp->packages));
+      }
+    }
+  }
+
+  return packages;
+}
+
+static alpm_list_t *search_exact(alpm_list_t *dblist, alpm_list_t *targets)
+{
+  alpm_list_t *results = NULL;
+
+  /* resolve each target individually from the repo pool */
+  for(alpm_list_t *t = targets; t; t = t->next) {
+    char *pkgname, *reponame;
+    alpm_list_t *r;
+    int found = 0;
+
+    pkgname = reponame = t->data;
+    if(strchr(pkgname, '/')) {
+      strsep(&pkgname, "/");
+    } else {
+      reponame = NULL;
+    }
+
+    for(r = dblist; r; r = r->next) {
+      alpm_db_t *repo = r->data;
+      alpm_pkg_t *pkg;
+
+      if(reponame && strcmp(reponame, alpm_db_get_name(repo)) != 0) {
+        continue;
+      }
+
+      pkg = alpm_db_get_pkg(repo, pkgname);
+      if(pkg == NULL) {
+        continue;
+      }
+
+      found = 1;
+      results = alpm_list_add(results, pkg);
+      if(opt_readone) {
+        break;
+      }
+    }
+
+    if(!found && opt_verbose) {
+      fprintf(stderr, "error: package `%s' not found\n", pkgname);
+    }
+  }
+
+  return results;
+}
+
+static alpm_list_t *resolve_targets(alpm_list_t *dblist, alpm_list_t *targets)
+{
+  if(targets == NULL) {
+    return all_packages(dblist);
+  }
+
+  if(opt_what == SEARCH_REGEX) {
+    return search_packages(dblist, targets);
+  }
+
+  if(opt_what == SEARCH_GROUPS) {
+    return search_groups(dblist, targets);
+  }
+
+  return search_exact(dblist, targets);
+}
+
+static void expac_free(expac_t *expac)
+{
+  if(expac == NULL) {
+    return;
+  }
+
+  for(size_t i = 0; i < expac->nloaders; ++i) {
+    alpm_release(expac->loaders[i]);
+  }
+  free(expac->loaders);
+
+  for(size_t i = 0; i < expac->nrepos; ++i) {
+    free(expac->repos[i]);
+  }
+  free(expac->repos);
+
+  alpm_release(expac->alpm);
+  free(expac);
+}
+
+static void expac_freep(expac_t **expac) {
+  expac_free(*expac);
+}
+
+static int expac_new(expac_t **expac, const char *config_file)
+{
+  expac_t *e;
+  enum _alpm_errno_t alpm_errno = 0;
+  config_t config;
+  stats_clock_t clock;
+  const char *dbroot = "/";
+  const char *dbpath = "/var/lib/pacman";
+  int r;
+
+  e = calloc(1, sizeof(*e));
+  if(e == NULL) {
+    return -ENOMEM;
+  }
+
+  memset(&config, 0, sizeof(config));
+
+  /* the repos, and the mirror lists they include, only matter to sync
+   * queries */
+  clock = stats_start();
+  r = config_parse(&config, config_file,
+      opt_corpus == CORPUS_SYNC || opt_batch || opt_serve);
+  stats_stop(STATS_CONFIG_PARSE, clock);
+  if(r < 0) {
+    return r;
+  }
+
+  if(config.dbpath) {
+    dbpath = config.dbpath;
+  }
+
+  if(config.dbroot) {
+    dbroot = config.dbroot;
+  }
+
+  clock = stats_start();
+  e->alpm = alpm_initialize(dbroot, dbpath, &alpm_errno);
+  stats_stop(STATS_ALPM_INITIALIZE, clock);
+  if(!e->alpm) {
+    fprintf(stderr, "error: failed to initialize alpm: %s\n", alpm_strerror(alpm_errno));
+    return -alpm_errno;
+  }
+
+  e->repos = config.repos;
+  e->nrepos = config.size;
+  config.repos = NULL;
+  config.size = 0;
+
+  config_reset(&config);
+
+  *expac = e;
+
+  return 0;
+}
+
+static alpm_db_t *find_syncdb(expac_t *expac, const char *name)
+{
+  for(alpm_list_t *i = alpm_get_syncdbs(expac->alpm); i; i = i->next) {
+    if(strcmp(alpm_db_get_name(i->data), name) == 0) {
+      return i->data;
+    }
+  }
+
+  return NULL;
+}
+
+/* registers the sync DBs named in wanted, or all of them if it's NULL,
+ * keeping the order of the config. DBs registered by earlier queries stay,
+ * unless one has to go ahead of them, in which case they're registered
+ * again after it, as reload_syncdbs does. */
+static void expac_register_syncdbs(expac_t *expac, alpm_list_t *wanted)
+{
+  size_t first = expac->nrepos;
+  stats_clock_t clock;
+
+  for(size_t k = 0; k < expac->nrepos; ++k) {
+    const char *name = expac->repos[k];
+
+    if((wanted == NULL || alpm_list_find_str(wanted, name)) &&
+        find_syncdb(expac, name) == NULL) {
+      first = k;
+      break;
+    }
+  }
+
+  if(first == expac->nrepos) {
+    return;
+  }
+
+  clock = stats_start();
+  for(size_t k = first; k < expac->nrepos; ++k) {
+    const char *name = expac->repos[k];
+    alpm_db_t *db = find_syncdb(expac, name);
+
+    if(db != NULL) {
+      alpm_db_unregister(db);
+    } else if(wanted != NULL && alpm_list_find_str(wanted, name) == NULL) {
+      continue;
+    }
+
+    alpm_register_syncdb(expac->alpm, name, 0);
+  }
+  stats_stop(STATS_REGISTER_SYNCDBS, clock);
+}
+
+typedef struct pkgload_t {
+  alpm_handle_t **handles;
+  char **paths;
+  alpm_pkg_t **pkgs;
+  alpm_errno_t *errors;
+} pkgload_t;
+
+static bool is_package_file(const char *name)
+{
+  size_t len = strlen(name);
+
+  if(strstr(name, ".pkg.tar") == NULL) {
+    return false;
+  }
+
+  return len < 4 || strcmp(name + len - 4, ".sig") != 0;
+}
+
+static int scan_package_dir(const char *dir, alpm_list_t **paths)
+{
+  struct dirent **entries;
+  int n, r = 0;
+
+  /* sorted, so that the results come out in a predictable order */
+  n = scandir(dir, &entries, NULL, alphasort);
+  if(n < 0) {
+    return -errno;
+  }
+
+  for(int i = 0; i < n; ++i) {
+    const char *name = entries[i]->d_name;
+    struct stat st;
+    char *path;
+
+    if(r < 0 || strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+      continue;
+    }
+
+    if(asprintf(&path, "%s/%s", dir, name) < 0) {
+      r = -ENOMEM;
+      continue;
+    }
+
+    /* don't follow symlinks to directories, they can loop */
+    if(lstat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+      r = scan_package_dir(path, paths);
+      free(path);
+    } else if(is_package_file(name)) {
+      *paths = alpm_list_add(*paths, path);
+    } else {
+      free(path);
+    }
+  }
+
+  for(int i = 0; i < n; ++i) {
+    free(entries[i]);
+  }
+  free(entries);
+
+  return r;
+}
+
+static alpm_list_t *expand_package_paths(alpm_list_t *targets)
+{
+  alpm_list_t *paths = NULL;
+
+  for(alpm_list_t *i = targets; i; i = i->next) {
+    const char *target = i->data;
+    struct stat st;
+
+    if(stat(target, &st) == 0 && S_ISDIR(st.st_mode)) {
+      int r = scan_package_dir(target, &paths);
+      if(r < 0) {
+        fprintf(stderr, "error: %s: %s\n", target, strerror(-r));
+      }
+      continue;
+    }
+
+    /* anything else is handed to alpm as is, and fails there if need be */
+    paths = alpm_list_add(paths, strdup(target));
+  }
+
+  return paths;
+}
+
+static int expac_add_loaders(expac_t *expac, size_t count)
+{
+  const char *root = alpm_option_get_root(expac->alpm);
+  const char *dbpath = alpm_option_get_dbpath(expac->alpm);
+  void *ptr;
+
+  if(count <= expac->nloaders) {
+    return 0;
+  }
+
+  ptr = realloc(expac->loaders, count * sizeof(alpm_handle_t *));
+  if(ptr == NULL) {
+    return -ENOMEM;
+  }
+  expac->loaders = ptr;
+
+  while(expac->nloaders < count) {
+    alpm_errno_t err = 0;
+    alpm_handle_t *handle;
+
+    handle = alpm_initialize(root, dbpath, &err);
+    if(handle == NULL) {
+      return -err;
+    }
+
+    expac->loaders[expac->nloaders++] = handle;
+  }
+
+  return 0;
+}
+
+static void load_one(void *ctx, size_t worker, size_t job)
+{
+  pkgload_t *load = ctx;
+
+  if(alpm_pkg_load(load->handles[worker], load->paths[job], 0, 0,
+        &load->pkgs[job]) != 0) {
+    load->pkgs[job] = NULL;
+    load->errors[job] = alpm_errno(load->handles[worker]);
+  }
+}
+
+static void loaded_pkgs_reset(void)
+{
+  for(alpm_list_t *i = loaded_pkgs; i; i = i->next) {
+    alpm_pkg_free(i->data);
+  }
+  alpm_list_free(loaded_pkgs);
+
+  loaded_pkgs = NULL;
+}
+
+static alpm_list_t *expac_search_files(expac_t *expac, alpm_list_t *targets)
+{
+  alpm_list_t *paths, *r = NULL;
+  _cleanup_free_ alpm_handle_t **handles = NULL;
+  _cleanup_free_ char **patharray = NULL;
+  _cleanup_free_ alpm_pkg_t **pkgs = NULL;
+  _cleanup_free_ alpm_errno_t *errors = NULL;
+  pkgload_t load;
+  size_t count, n = 0, nworkers = opt_jobs;
+
+  paths = expand_package_paths(targets);
+  count = alpm_list_count(paths);
+  if(count == 0) {
+    return NULL;
+  }
+
+  if(nworkers > count) {
+    nworkers = count;
+  }
+
+  /* alpm handles aren't thread safe, so each worker gets its own */
+  if(nworkers > 1 && expac_add_loaders(expac, nworkers - 1) < 0) {
+    nworkers = 1;
+  }
+
+  handles = malloc(nworkers * sizeof(alpm_handle_t *));
+  patharray = malloc(count * sizeof(char *));
+  pkgs = calloc(count, sizeof(alpm_pkg_t *));
+  errors = calloc(count, sizeof(alpm_errno_t));
+  if(handles == NULL || patharray == NULL || pkgs == NULL || errors == NULL) {
+    goto out;
+  }
+
+  handles[0] = expac->alpm;
+  for(size_t i = 1; i < nworkers; ++i) {
+    handles[i] = expac->loaders[i - 1];
+  }
+
+  for(alpm_list_t *i = paths; i; i = i->next) {
+    patharray[n++] = i->data;
+  }
+
+  load = (pkgload_t){
+    .handles = handles,
+    .paths = patharray,
+    .pkgs = pkgs,
+    .errors = errors,
+  };
+  pool_run(nworkers, count, load_one, &load);
+
+  for(size_t i = 0; i < count; ++i) {
+    if(pkgs[i] == NULL) {
+      fprintf(stderr, "error: %s: %s\n", patharray[i], alpm_strerror(errors[i]));
+      continue;
+    }
+
+    r = alpm_list_add(r, pkgs[i]);
+    loaded_pkgs = alpm_list_add(loaded_pkgs, pkgs[i]);
+  }
+
+out:
+  alpm_list_free_inner(paths, free);
+  alpm_list_free(paths);
+
+  return r;
+}
+
+/* the first file named name in $PATH, as pacman -Qo finds programs */
+static char *search_path(const char *name)
+{
+  _cleanup_free_ char *path = NULL;
+  char *dirs, *dir;
+  struct stat st;
+
+  if(getenv("PATH") == NULL) {
+    return NULL;
+  }
+
+  path = strdup(getenv("PATH"));
+  if(path == NULL) {
+    return NULL;
+  }
+
+  for(dirs = path; (dir = strsep(&dirs, ":"));) {
+    char *file;
+
+    if(asprintf(&file, "%s/%s", *dir ? dir : ".", name) < 0) {
+      return NULL;
+    }
+    if(lstat(file, &st) == 0) {
+      return file;
+    }
+    free(file);
+  }
+
+  return NULL;
+}
+
+/* target as a path inside of root, the way pacman -Qo resolves it: the
+ * directory it's in has its symlinks resolved but the file itself doesn't,
+ * and directories get a trailing slash as in file lists. Files that no
+ * longer exist are still looked up. Returns NULL if target isn't under
+ * root. */
+static char *owned_path(const char *root, const char *target)
+{
+  _cleanup_free_ char *found = NULL;
+  _cleanup_free_ char *copy = NULL;
+  _cleanup_free_ char *dir = NULL;
+  const char *path = target, *base, *sep;
+  size_t rootlen = strlen(root), len;
+  struct stat st;
+  char *resolved;
+  bool is_dir = false;
+
+  if(lstat(target, &st) == 0) {
+    is_dir = S_ISDIR(st.st_mode);
+  } else if(strchr(target, '/') == NULL && (found = search_path(target))) {
+    path = found;
+  }
+
+  copy = strdup(path);
+  if(copy == NULL) {
+    return NULL;
+  }
+
+  len = strlen(copy);
+  while(len > 1 && copy[len - 1] == '/') {
+    copy[--len] = '\0';
+  }
+
+  if(is_dir) {
+    dir = realpath(copy, NULL);
+    base = "";
+  } else {
+    char *slash = strrchr(copy, '/');
+
+    if(slash == NULL) {
+      dir = realpath(".", NULL);
+      base = copy;
+    } else {
+      *slash = '\0';
+      dir = realpath(slash == copy ? "/" : copy, NULL);
+      if(dir == NULL && copy[0] == '/') {
+        dir = strdup(copy);
+      }
+      base = slash + 1;
+    }
+  }
+  if(dir == NULL) {
+    return NULL;
+  }
+
+  sep = strcmp(dir, "/") == 0 ? "" : "/";
+  if(asprintf(&resolved, "%s%s%s", dir, sep, base) < 0) {
+    return NULL;
+  }
+
+  if(strncmp(resolved, root, rootlen) != 0) {
+    free(resolved);
+    return NULL;
+  }
+  memmove(resolved, resolved + rootlen, strlen(resolved + rootlen) + 1);
+
+  return resolved;
+}
+
+/* the packages owning each file given, from an index of the local DB kept
+ * in the cache directory */
+static alpm_list_t *search_owners(expac_t *expac, alpm_db_t *db,
+    alpm_list_t *targets)
+{
+  const char *root = alpm_option_get_root(expac->alpm);
+  _cleanup_free_ char *dbdir = NULL, *cachefile = NULL;
+  alpm_list_t *results = NULL;
+  owners_t owners;
+  int r;
+
+  if(asprintf(&dbdir, "%s/local", alpm_option_get_dbpath(expac->alpm)) < 0) {
+    return NULL;
+  }
+  if(opt_cachedir &&
+      asprintf(&cachefile, "%s/file-owners", opt_cachedir) < 0) {
+    return NULL;
+  }
+
+  r = owners_open(&owners, db, dbdir, cachefile);
+  if(r < 0) {
+    fprintf(stderr, "error: failed to index file owners: %s\n", strerror(-r));
+    return NULL;
+  }
+
+  for(alpm_list_t *t = targets; t; t = t->next) {
+    _cleanup_free_ char *path = owned_path(root, t->data);
+    size_t first = 0, n = 0;
+
+    if(path != NULL) {
+      n = owners_find(&owners, path, &first);
+    }
+
+    for(size_t k = first; k < first + n; ++k) {
+      alpm_pkg_t *pkg = alpm_db_get_pkg(db, owners_pkgname(&owners, k));
+      if(pkg != NULL) {
+        results = alpm_list_add(results, pkg);
+      }
+    }
+
+    if(n == 0 && opt_verbose) {
+      fprintf(stderr, "error: no package owns %s\n", (char *)t->data);
+    }
+  }
+
+  owners_reset(&owners);
+
+  return results;
+}
+
+static void repo_files_reset(void)
+{
+  for(size_t i = 0; i < nrepo_files; ++i) {
+    filesdb_reset(&repo_files[i].index);
+  }
+  free(repo_files);
+
+  repo_files = NULL;
+  nrepo_files = 0;
+}
+
+/* maps the index of the file lists of each sync DB from the cache
+ * directory. Those which are out of date are built again from the .files
+ * DBs, which are only loaded then, on a handle of their own that's let go
+ * of once done. */
+static int repo_files_open(expac_t *expac)
+{
+  alpm_list_t *dbs = alpm_get_syncdbs(expac->alpm);
+  const char *dbpath = alpm_option_get_dbpath(expac->alpm);
+  alpm_handle_t *handle = NULL;
+  int r = 0;
+
+  if(repo_files != NULL) {
+    return 0;
+  }
+
+  repo_files = calloc(alpm_list_count(dbs) + 1, sizeof(repo_files_t));
+  if(repo_files == NULL) {
+    return -ENOMEM;
+  }
+
+  for(alpm_list_t *i = dbs; i; i = i->next) {
+    _cleanup_free_ char *dbfile = NULL, *cachefile = NULL;
+    const char *name = alpm_db_get_name(i->data);
+    repo_files_t *repo = &repo_files[nrepo_files++];
+    alpm_errno_t err = 0;
+    alpm_db_t *db;
+
+    repo->db = i->data;
+
+    if(asprintf(&dbfile, "%s/sync/%s.files", dbpath, name) < 0 ||
+        (opt_cachedir && asprintf(&cachefile, "%s/sync/%s.files.index",
+          opt_cachedir, name) < 0)) {
+      r = -ENOMEM;
+      break;
+    }
+
+    r = filesdb_map(&repo->index, dbfile, cachefile);
+    if(r == -ENOENT) {
+      fprintf(stderr, "warning: no file lists for %s (use pacman -Fy to download them)\n",
+          name);
+      r = 0;
+      continue;
+    }
+    if(r != -ESTALE) {
+      if(r < 0) {
+        break;
+      }
+      continue;
+    }
+
+    if(handle == NULL) {
+      handle = alpm_initialize(alpm_option_get_root(expac->alpm), dbpath,
+          &err);
+      if(handle == NULL) {
+        fprintf(stderr, "error: failed to initialize alpm: %s\n",
+            alpm_strerror(err));
+        r = -EIO;
+        break;
+      }
+      alpm_option_set_dbext(handle, ".files");
+    }
+
+    db = alpm_register_syncdb(handle, name, 0);
+    if(db == NULL) {
+      fprintf(stderr, "error: failed to register %s.files: %s\n", name,
+          alpm_strerror(alpm_errno(handle)));
+      r = -EIO;
+      break;
+    }
+
+    r = filesdb_build(&repo->index, db, dbfile, cachefile);
+    if(r < 0) {
+      fprintf(stderr, "error: failed to index file lists of %s: %s\n", name,
+          strerror(-r));
+      break;
+    }
+  }
+
+  if(handle != NULL) {
+    alpm_release(handle);
+  }
+
+  if(r < 0) {
+    repo_files_reset();
+  }
+
+  return r;
+}
+
+/* the sync packages whose file lists have each target, as pacman -F finds
+ * them */
+static alpm_list_t *search_repo_owners(expac_t *expac, alpm_list_t *targets)
+{
+  alpm_list_t *results = NULL;
+
+  if(repo_files_open(expac) < 0) {
+    return NULL;
+  }
+
+  for(alpm_list_t *t = targets; t; t = t->next) {
+    bool found = false;
+
+    for(size_t k = 0; k < nrepo_files && !(found && opt_readone); ++k) {
+      const filesdb_t *index = &repo_files[k].index;
+      _cleanup_free_ uint32_t *pkgs = NULL;
+      ssize_t n;
+
+      if(index->header == NULL) {
+        continue;
+      }
+
+      n = filesdb_owners(index, t->data, &pkgs);
+      for(ssize_t p = 0; p < n; ++p) {
+        alpm_pkg_t *pkg = alpm_db_get_pkg(repo_files[k].db,
+            filesdb_pkgname(index, pkgs[p]));
+
+        if(pkg != NULL) {
+          results = alpm_list_add(results, pkg);
+          found = true;
+          if(opt_readone) {
+            break;
+          }
+        }
+      }
+    }
+
+    if(!found && opt_verbose) {
+      fprintf(stderr, "error: no package owns %s\n", (char *)t->data);
+    }
+  }
+
+  return results;
+}
+
+static alpm_list_t *expac_search_local(expac_t *expac, alpm_list_t *targets)
+{
+  alpm_list_t *dblist, *r;
+
+  if(targets != NULL && opt_what == SEARCH_OWNER) {
+    return search_owners(expac, alpm_get_localdb(expac->alpm), targets);
+  }
+
+  dblist = alpm_list_add(NULL, alpm_get_localdb(expac->alpm));
+  r = resolve_targets(dblist, targets);
+  alpm_list_free(dblist);
+
+  return r;
+}
+
+static alpm_list_t *expac_search_sync(expac_t *expac, alpm_list_t *targets)
+{
+  if(targets != NULL && opt_what == SEARCH_OWNER) {
+    return search_repo_owners(expac, targets);
+  }
+
+  return resolve_targets(alpm_get_syncdbs(expac->alpm), targets);
+}
+
+static alpm_list_t *expac_search(expac_t *expac, package_corpus_t corpus, alpm_list_t *targets)
+{
+  switch (corpus) {
+  case CORPUS_LOCAL:
+    return expac_search_local(expac, targets);
+  case CORPUS_SYNC:
+    return expac_search_sync(expac, targets);
+  case CORPUS_FILE:
+    return expac_search_files(expac, targets);
+  }
+
+  /* should be unreachable */
+  return NULL;
+}
+
+/* the files libalpm reads from local/<name>-<version>/ as fields of a
+ * package are first accessed */
+#define LOCALDB_DESC       (1 << 0)
+#define LOCALDB_FILES      (1 << 1)
+#define LOCALDB_SCRIPTLET  (1 << 2)
+
+#define READAHEAD_MAX_THREADS  8
+
+typedef struct readahead_t {
+  const char *dbpath;
+  alpm_pkg_t **pkgs;
+  int needs;
+} readahead_t;
+
+static int localdb_needs(const format_t *format, bool *whole_db)
+{
+  int needs = 0;
+
+  *whole_db = false;
+
+  for(size_t i = 0; i < format->size; ++i) {
+    if(format->ops[i].type != FORMAT_OP_FIELD) {
+      continue;
+    }
+
+    switch (format->ops[i].token) {
+      /* known from the directory name, or not read from disk at all */
+      case 'n':
+      case 'v':
+      case 'r':
+      case '!':
+        break;
+      case 'i':
+        /* only checks whether the install file exists */
+        needs |= LOCALDB_SCRIPTLET;
+        break;
+      case 'B':
+      case 'F':
+      case 'M':
+        needs |= LOCALDB_FILES;
+        break;
+      case 'N':
+      case 'W':
+      case 'X':
+      case 'x':
+      case 'Y':
+      case 'y':
+        /* computed from the depends of every installed package */
+        *whole_db = true;
+        needs |= LOCALDB_DESC;
+        break;
+      default:
+        needs |= LOCALDB_DESC;
+        break;
+    }
+  }
+
+  return needs;
+}
+
+static void readahead_file(const char *path)
+{
+  int fd;
+
+  fd = open(path, O_RDONLY | O_CLOEXEC);
+  if(fd < 0) {
+    return;
+  }
+
+  posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+  close(fd);
+}
+
+static void readahead_pkg(void *ctx, size_t worker, size_t job)
+{
+  readahead_t *ra = ctx;
+  alpm_pkg_t *pkg = ra->pkgs[job];
+  char path[PATH_MAX];
+  int len;
+
+  (void)worker;
+
+  len = snprintf(path, sizeof(path), "%slocal/%s-%s/", ra->dbpath,
+      alpm_pkg_get_name(pkg), alpm_pkg_get_version(pkg));
+  if(len < 0 || (size_t)len + sizeof("files") > sizeof(path)) {
+    return;
+  }
+
+  if(ra->needs & LOCALDB_DESC) {
+    strcpy(path + len, "desc");
+    readahead_file(path);
+  }
+
+  if(ra->needs & LOCALDB_FILES) {
+    strcpy(path + len, "files");
+    readahead_file(path);
+  }
+}
+
+static void readahead_pkgs(const char *dbpath, alpm_list_t *pkgs, int needs)
+{
+  _cleanup_free_ alpm_pkg_t **array = NULL;
+  readahead_t ra = { .dbpath = dbpath, .needs = needs };
+  size_t count = alpm_list_count(pkgs), n = 0, nthreads;
+
+  if(count == 0) {
+    return;
+  }
+
+  array = malloc(count * sizeof(alpm_pkg_t *));
+  if(array == NULL) {
+    return;
+  }
+
+  for(alpm_list_t *i = pkgs; i; i = i->next) {
+    array[n++] = i->data;
+  }
+  ra.pkgs = array;
+
+  /* the hints themselves are asynchronous, threads only help overlap the
+   * directory lookups that open() has to do */
+  nthreads = pool_online_cpus();
+  if(nthreads > READAHEAD_MAX_THREADS) {
+    nthreads = READAHEAD_MAX_THREADS;
+  }
+
+  pool_run(nthreads, count, readahead_pkg, &ra);
+}
+
+/* ask the kernel to start reading in the local DB entries that printing
+ * the results will touch, rather than letting libalpm fault them in one
+ * package at a time */
+static void expac_readahead_local(expac_t *expac, alpm_list_t *results,
+    const format_t *format)
+{
+  const char *dbpath = alpm_option_get_dbpath(expac->alpm);
+  bool whole_db;
+  int needs;
+
+  needs = localdb_needs(format, &whole_db) & ~LOCALDB_SCRIPTLET;
+  if(needs == 0) {
+    return;
+  }
+
+  if(whole_db) {
+    readahead_pkgs(dbpath, alpm_db_get_pkgcache(alpm_get_localdb(expac->alpm)),
+        LOCALDB_DESC);
+    needs &= ~LOCALDB_DESC;
+  }
+
+  readahead_pkgs(dbpath, results, needs);
+}
+
+/* records are rendered in chunks of this many packages when printing on
+ * several threads */
+#define RENDER_CHUNK_SIZE  128
+
+/* how many chunks per thread may be rendered ahead of the writer */
+#define RENDER_WINDOW      4
+
+typedef struct render_chunk_t {
+  outbuf_t buf;
+  bool done;
+} render_chunk_t;
+
+typedef struct render_t {
+  const format_t *format;
+  alpm_pkg_t **pkgs;
+  size_t count;
+  outbuf_t *out;
+
+  render_chunk_t *chunks;
+  size_t nchunks;
+  size_t window;
+
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  size_t next_claim;
+  size_t next_write;
+  bool writing;
+  int error;
+} render_t;
+
+/* do all of the lazy loading that printing the results will trigger up
+ * front, so that the threads only ever read from the packages */
+static void prewarm_local(expac_t *expac, alpm_list_t *results,
+    const format_t *format)
+{
+  bool whole_db;
+  int needs;
+
+  needs = localdb_needs(format, &whole_db);
+
+  if(whole_db) {
+    for(alpm_list_t *i = alpm_db_get_pkgcache(alpm_get_localdb(expac->alpm));
+        i; i = i->next) {
+      alpm_pkg_get_depends(i->data);
+    }
+  }
+
+  for(alpm_list_t *i = results; i; i = i->next) {
+    if(needs & LOCALDB_DESC) {
+      alpm_pkg_get_desc(i->data);
+    }
+    if(needs & LOCALDB_FILES) {
+      alpm_pkg_get_files(i->data);
+    }
+    if(needs & LOCALDB_SCRIPTLET) {
+      alpm_pkg_has_scriptlet(i->data);
+    }
+  }
+}
+
+static int render_chunk(render_t *render, size_t c)
+{
+  render_chunk_t *chunk = &render->chunks[c];
+  size_t first = c * RENDER_CHUNK_SIZE, last = first + RENDER_CHUNK_SIZE;
+
+  if(last > render->count) {
+    last = render->count;
+  }
+
+  if(outbuf_init(&chunk->buf, -1, 0) < 0) {
+    return -ENOMEM;
+  }
+
+  for(size_t i = first; i < last; ++i) {
+    print_pkg(&chunk->buf, render->pkgs[i], render->format, i);
+  }
+
+  return chunk->buf.error;
+}
+
+/* called with the lock held. Writes out every finished chunk that's next
+ * in line, unless another thread is already doing so. */
+static void render_drain(render_t *render)
+{
+  if(render->writing) {
+    return;
+  }
+
+  render->writing = true;
+  while(render->next_write < render->nchunks &&
+      render->chunks[render->next_write].done) {
+    render_chunk_t *chunk = &render->chunks[render->next_write];
+
+    pthread_mutex_unlock(&render->lock);
+    outbuf_write(render->out, chunk->buf.buf, chunk->buf.len);
+    outbuf_reset(&chunk->buf);
+    pthread_mutex_lock(&render->lock);
+
+    ++render->next_write;
+    pthread_cond_broadcast(&render->cond);
+  }
+  render->writing = false;
+}
+
+static void render_worker(void *ctx, size_t worker, size_t job)
+{
+  render_t *render = ctx;
+
+  (void)worker;
+  (void)job;
+
+  pthread_mutex_lock(&render->lock);
+  for(;;) {
+    size_t c;
+    int r;
+
+    /* don't get too far ahead of the writer */
+    while(render->next_claim < render->nchunks &&
+        render->next_claim >= render->next_write + render->window) {
+      pthread_cond_wait(&render->cond, &render->lock);
+    }
+
+    if(render->next_claim >= render->nchunks) {
+      break;
+    }
+
+    c = render->next_claim++;
+    pthread_mutex_unlock(&render->lock);
+
+    r = render_chunk(render, c);
+
+    pthread_mutex_lock(&render->lock);
+    if(r < 0) {
+      render->error = r;
+    }
+    render->chunks[c].done = true;
+    render_drain(render);
+  }
+  pthread_mutex_unlock(&render->lock);
+}
+
+static int print_results_parallel(outbuf_t *buf, alpm_list_t *results,
+    const format_t *format, size_t njobs)
+{
+  _cleanup_free_ alpm_pkg_t **pkgs = NULL;
+  _cleanup_free_ render_chunk_t *chunks = NULL;
+  render_t render = { .format = format, .out = buf };
+  size_t n = 0;
+
+  render.count = alpm_list_count(results);
+  render.nchunks = (render.count + RENDER_CHUNK_SIZE - 1) / RENDER_CHUNK_SIZE;
+  render.window = njobs * RENDER_WINDOW;
+
+  pkgs = malloc(render.count * sizeof(alpm_pkg_t *));
+  chunks = calloc(render.nchunks, sizeof(render_chunk_t));
+  if(pkgs == NULL || chunks == NULL) {
+    return -ENOMEM;
+  }
+
+  for(alpm_list_t *i = results; i; i = i->next) {
+    pkgs[n++] = i->data;
+  }
+  render.pkgs = pkgs;
+  render.chunks = chunks;
+
+  pthread_mutex_init(&render.lock, NULL);
+  pthread_cond_init(&render.cond, NULL);
+
+  /* one job per worker, each of which loops over chunks */
+  pool_run(njobs, njobs, render_worker, &render);
+
+  pthread_cond_destroy(&render.cond);
+  pthread_mutex_destroy(&render.lock);
+
+  return render.error;
+}
+
+/* a line for each group: its key, then its aggregates, separated by tabs */
+static void print_groups(outbuf_t *buf, const grouping_t *grouping,
+    const format_t *format)
+{
+  char numbuf[64];
+
+  for(size_t row = 0; row < grouping->size; ++row) {
+    const int64_t *values = grouping_values(grouping, row);
+    const char *key = grouping->keys[row];
+
+    outbuf_puts(buf, *key == '\0' && opt_verbose ? "None" : key);
+
+    for(size_t a = 0; a < grouping->naggregates; ++a) {
+      const aggregate_t *aggregate = &grouping->aggregates[a];
+      const field_type_t type = aggregate->field ?
+        aggregate->field->type : FIELD_LIST;
+
+      outbuf_putc(buf, '\t');
+
+      if(aggregate->fn != AGGREGATE_COUNT && type == FIELD_SIZE) {
+        outbuf_puts(buf, size_to_string(values[a], numbuf, sizeof(numbuf)));
+      } else if(aggregate->fn != AGGREGATE_COUNT && type == FIELD_TIME) {
+        print_time(buf, values[a]);
+      } else {
+        uint_to_str(values[a], numbuf);
+        outbuf_puts(buf, numbuf);
+      }
+    }
+
+    outbuf_write(buf, format->delim, format->delim_len);
+  }
+}
+
+static int print_results(expac_t *expac, outbuf_t *buf, alpm_list_t *results,
+    const format_t *format)
+{
+  size_t index = 0;
+  int r = 0;
+
+  /* the records of a JSON array are streamed out as any others */
+  if(opt_output == OUTPUT_JSON) {
+    outbuf_putc(buf, '[');
+  }
+
+  if(opt_output == OUTPUT_BINARY) {
+    r = binary_init(&binary);
+    if(r < 0) {
+      return r;
+    }
+    binary_header(buf, format);
+  }
+
+  /* binary records depend on the dictionary the ones before them built
+   * up, so they're written in order */
+  if(opt_jobs > 1 && opt_output != OUTPUT_BINARY && results && results->next) {
+    if(opt_corpus == CORPUS_LOCAL) {
+      prewarm_local(expac, results, format);
+    }
+
+    r = print_results_parallel(buf, results, format, opt_jobs);
+  } else {
+    for(alpm_list_t *i = results; i; i = i->next) {
+      print_pkg(buf, i->data, format, index++);
+    }
+  }
+
+  if(opt_output == OUTPUT_JSON) {
+    outbuf_puts(buf, "\n]\n");
+  }
+
+  if(opt_output == OUTPUT_BINARY) {
+    binary_reset(&binary);
+  }
+
+  return r;
+}
+
+/* printing counts as formatting, except for the writes it made along the
+ * way, which count as output */
+static void stats_printed(stats_clock_t start, const outbuf_t *buf,
+    stats_clock_t written)
+{
+  stats_stop(STATS_FORMAT, start);
+  stats_move(STATS_FORMAT, STATS_OUTPUT, (stats_clock_t){
+      buf->write_ns - written.wall, buf->write_cpu_ns - written.cpu });
+}
+
+static stats_clock_t stats_written(const outbuf_t *buf)
+{
+  return (stats_clock_t){ buf->write_ns, buf->write_cpu_ns };
+}
+
+static int print_snapshot_list(outbuf_t *buf, const format_t *format,
+    const snapshot_t *snap, size_t pkg, char token)
+{
+  const uint32_t *items;
+  size_t count;
+  int out = 0;
+
+  count = snapshot_get_list(snap, pkg, token, &items);
+  if(count == 0) {
+    /* file lists are never reported as missing */
+    if(opt_verbose && token != 'F') {
+      out += outbuf_puts(buf, "None");
+    }
+    return out;
+  }
+
+  for(size_t i = 0; i < count; ++i) {
+    if(i > 0) {
+      out += outbuf_write(buf, format->listdelim, format->listdelim_len);
+    }
+    out += outbuf_puts(buf, snapshot_string(snap, items[i]));
+  }
+
+  return out;
+}
+
+/* print_pkg, for a package read from a snapshot */
+static void print_snapshot_pkg(outbuf_t *buf, const snapshot_t *snap,
+    size_t pkg, const format_t *format, int counter)
+{
+  char sizebuf[64];
+  uint64_t start;
+  int out = 0;
+
+  for(size_t i = 0; i < format->size; ++i) {
+    const format_op_t *op = &format->ops[i];
+
+    if(op->type == FORMAT_OP_LITERAL) {
+      out += outbuf_write(buf, op->literal, op->len);
+      continue;
+    }
+
+    start = opt_stats ? stats_now() : 0;
+
+    switch (op->token) {
+      case '!':
+        out += outbuf_printf(buf, op->spec, counter++);
+        break;
+      case 'b':
+      case 'l':
+        out += print_time(buf, snapshot_get_num(snap, pkg, op->token));
+        break;
+      case 'k':
+      case 'm':
+        out += print_str(buf, op, size_to_string(
+              snapshot_get_num(snap, pkg, op->token), sizebuf, sizeof(sizebuf)));
+        break;
+      default:
+        if(snapshot_field_type(op->token) == SNAPSHOT_FIELD_STR) {
+          out += print_str(buf, op, snapshot_get_str(snap, pkg, op->token));
+        } else {
+          out += print_snapshot_list(buf, format, snap, pkg, op->token);
+        }
+        break;
+    }
+
+    if(opt_stats) {
+      stats_token(op->token, stats_now() - start);
+    }
+  }
+
+  if(out > 0) {
+    outbuf_write(buf, format->delim, format->delim_len);
+  }
+}
+
+/* input is read in blocks of this size when it can't be mapped */
+#define READ_BLOCK_SIZE  (1024 * 1024)
+
+typedef struct input_t {
+  char *data;
+  size_t len;
+  bool mapped;
+} input_t;
+
+static void input_reset(input_t *input)
+{
+  if(input->mapped) {
+    munmap(input->data, input->len);
+  } else {
+    free(input->data);
+  }
+}
+
+static int read_input(int fd, input_t *input)
+{
+  size_t capacity = 0;
+  struct stat st;
+
+  memset(input, 0, sizeof(*input));
+
+  if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(data != MAP_FAILED) {
+      input->data = data;
+      input->len = st.st_size;
+      input->mapped = true;
+      return 0;
+    }
+  }
+
+  for(;;) {
+    ssize_t n;
+
+    if(capacity - input->len < READ_BLOCK_SIZE) {
+      void *ptr;
+
+      capacity = capacity ? capacity * 2 : READ_BLOCK_SIZE;
+      ptr = realloc(input->data, capacity);
+      if(ptr == NULL) {
+        return -ENOMEM;
+      }
+      input->data = ptr;
+    }
+
+    n = read(fd, input->data + input->len, capacity - input->len);
+    if(n < 0) {
+      if(errno == EINTR) {
+        continue;
+      }
+      return -errno;
+    }
+
+    if(n == 0) {
+      break;
+    }
+
+    input->len += n;
+  }
+
+  return 0;
+}
+
+static bool is_target_separator(char c)
+{
+  if(opt_null) {
+    return c == '\0';
+  }
+
+  return c == '\0' || isspace((unsigned char)c);
+}
+
+static int read_targets_from_fd(int fd, alpm_list_t **targets)
+{
+  _cleanup_(input_reset) input_t input;
+  _cleanup_(hashmap_reset) hashmap_t seen;
+  const char *p, *end;
+  int r, targets_added = 0;
+
+  memset(&seen, 0, sizeof(seen));
+
+  r = read_input(fd, &input);
+  if(r < 0) {
+    fprintf(stderr, "error: failed to read stdin: %s\n", strerror(-r));
+    return r;
+  }
+
+  r = hashmap_init(&seen, alpm_list_count(*targets));
+  if(r < 0) {
+    return r;
+  }
+
+  for(alpm_list_t *i = *targets; i; i = i->next) {
+    r = hashmap_put(&seen, i->data, i->data);
+    if(r < 0) {
+      return r;
+    }
+  }
+
+  p = input.data;
+  end = input.data + input.len;
+  while(p < end) {
+    const char *tok;
+    char *target;
+
+    while(p < end && is_target_separator(*p)) {
+      ++p;
+    }
+
+    tok = p;
+    while(p < end && !is_target_separator(*p)) {
+      ++p;
+    }
+
+    /* avoid adding zero length arg, if multiple spaces separate args */
+    if(p == tok) {
+      continue;
+    }
+
+    ++targets_added;
+
+    target = strndup(tok, p - tok);
+    if(target == NULL) {
+      return -ENOMEM;
+    }
+
+    if(hashmap_get(&seen, target) != NULL) {
+      free(target);
+      continue;
+    }
+
+    r = hashmap_put(&seen, target, target);
+    if(r < 0) {
+      free(target);
+      return r;
+    }
+
+    *targets = alpm_list_add(*targets, target);
+  }
+
+  return targets_added;
+}
+
+static int process_targets(int argc, char **argv, alpm_list_t **targets)
+{
+  int allow_stdin;
+
+  allow_stdin = !isatty(STDIN_FILENO);
+
+  for(int i = 0; i < argc; ++i) {
+    if(allow_stdin && strcmp(argv[i], "-") == 0) {
+      int k;
+
+      k = read_targets_from_fd(STDIN_FILENO, targets);
+      if(k < 0) {
+        return k;
+      }
+
+      if(k == 0) {
+        fputs("error: argument '-' specified with empty stdin\n", stderr);
+        return -1;
+      }
+
+      allow_stdin = 0;
+    } else {
+      *targets = alpm_list_add(*targets, strdup(argv[i]));
+    }
+  }
+
+  return 0;
+}
+
+/* the options a batch request may override */
+typedef struct query_opts_t {
+  package_corpus_t corpus;
+  search_what_t what;
+  const char *format;
+  const char *delim;
+  const char *listdelim;
+  const char *timefmt;
+  const char *filter;
+  const char *sort;
+  size_t limit;
+  const char *group_by;
+  const char *aggregate;
+  output_format_t output;
+  char humansize;
+  bool readone;
+  bool reverse;
+} query_opts_t;
+
+static void query_opts_save(query_opts_t *opts)
+{
+  opts->corpus = opt_corpus;
+  opts->what = opt_what;
+  opts->format = opt_format;
+  opts->delim = opt_delim;
+  opts->listdelim = opt_listdelim;
+  opts->timefmt = opt_timefmt;
+  opts->filter = opt_filter;
+  opts->sort = opt_sort;
+  opts->limit = opt_limit;
+  opts->group_by = opt_group_by;
+  opts->aggregate = opt_aggregate;
+  opts->output = opt_output;
+  opts->reverse = opt_reverse;
+  opts->humansize = opt_humansize;
+  opts->readone = opt_readone;
+}
+
+static void query_opts_restore(const query_opts_t *opts)
+{
+  opt_corpus = opts->corpus;
+  opt_what = opts->what;
+  opt_format = opts->format;
+  opt_delim = opts->delim;
+  opt_listdelim = opts->listdelim;
+  opt_timefmt = opts->timefmt;
+  opt_filter = opts->filter;
+  opt_sort = opts->sort;
+  opt_limit = opts->limit;
+  opt_group_by = opts->group_by;
+  opt_aggregate = opts->aggregate;
+  opt_output = opts->output;
+  opt_reverse = opts->reverse;
+  opt_humansize = opts->humansize;
+  opt_readone = opts->readone;
+}
+
+static void snapshot_render(outbuf_t *out, alpm_pkg_t *pkg,
+    const format_t *format)
+{
+  print_pkg(out, pkg, format, 0);
+}
+
+static bool snapshot_usable(const format_t *format, alpm_list_t *targets)
+{
+  if(opt_corpus != CORPUS_SYNC || opt_cachedir == NULL || opt_filter ||
+      opt_sort || opt_limit || opt_group_by || opt_output != OUTPUT_TEXT ||
+      (targets != NULL && opt_what != SEARCH_EXACT) ||
+      (opt_files && format_has_token(format, 'F'))) {
+    return false;
+  }
+
+  for(size_t i = 0; i < format->size; ++i) {
+    const format_op_t *op = &format->ops[i];
+
+    if(op->type == FORMAT_OP_FIELD && op->token != '!' &&
+        snapshot_field_type(op->token) == SNAPSHOT_FIELD_NONE) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+typedef struct snapshot_result_t {
+  const snapshot_t *snap;
+  size_t pkg;
+} snapshot_result_t;
+
+static size_t snapshot_search_exact(const snapshot_t *snaps, alpm_list_t *dbs,
+    alpm_list_t *targets, snapshot_result_t *results)
+{
+  size_t count = 0;
+
+  /* as search_exact, without touching the targets */
+  for(alpm_list_t *t = targets; t; t = t->next) {
+    const char *pkgname = t->data, *slash;
+    size_t repolen = 0, n = 0;
+    int found = 0;
+
+    slash = strchr(pkgname, '/');
+    if(slash) {
+      repolen = slash - pkgname;
+      pkgname = slash + 1;
+    }
+
+    for(alpm_list_t *r = dbs; r; r = r->next, ++n) {
+      const char *reponame = alpm_db_get_name(r->data);
+      ssize_t pkg;
+
+      if(slash && (strlen(reponame) != repolen ||
+            memcmp(reponame, t->data, repolen) != 0)) {
+        continue;
+      }
+
+      pkg = snapshot_find(&snaps[n], pkgname);
+      if(pkg < 0) {
+        continue;
+      }
+
+      found = 1;
+      results[count++] = (snapshot_result_t){ &snaps[n], pkg };
+      if(opt_readone) {
         break;
       }
     }
 
-    if(!found && opt_verbose) {
-      fprintf(stderr, "error: package `%s' not found\n", pkgname);
-    }
+    if(!found && opt_verbose) {
+      fprintf(stderr, "error: package `%s' not found\n", pkgname);
+    }
+  }
+
+  return count;
+}
+
+/* answers a sync query from snapshots of the sync DBs kept in the cache
+ * directory, which need no parsing. Fails without printing anything if any
+ * of the DBs has no usable snapshot. */
+static int expac_query_snapshots(expac_t *expac, outbuf_t *buf,
+    alpm_list_t *targets, const format_t *format)
+{
+  alpm_list_t *dbs = alpm_get_syncdbs(expac->alpm);
+  const char *dbpath = alpm_option_get_dbpath(expac->alpm);
+  const char *dbext = alpm_option_get_dbext(expac->alpm);
+  const size_t ndbs = alpm_list_count(dbs);
+  _cleanup_free_ snapshot_t *snaps = NULL;
+  _cleanup_free_ snapshot_result_t *results = NULL;
+  const bool verbose = opt_verbose;
+  stats_clock_t clock, written;
+  size_t n = 0, count = 0, total = 0;
+  int r = 0, counter = 0;
+
+  clock = stats_start();
+
+  snaps = calloc(ndbs + 1, sizeof(snapshot_t));
+  if(snaps == NULL) {
+    return -ENOMEM;
+  }
+
+  /* fields are stored as they'd print without --verbose */
+  opt_verbose = false;
+  for(alpm_list_t *i = dbs; i; i = i->next, ++n) {
+    _cleanup_free_ char *dbfile = NULL, *cachefile = NULL;
+    const char *name = alpm_db_get_name(i->data);
+
+    if(asprintf(&dbfile, "%s/sync/%s%s", dbpath, name, dbext) < 0 ||
+        asprintf(&cachefile, "%s/sync/%s%s.snapshot", opt_cachedir, name,
+          dbext) < 0) {
+      r = -ENOMEM;
+      break;
+    }
+
+    r = snapshot_open(&snaps[n], i->data, dbfile, cachefile, snapshot_render);
+    if(r < 0) {
+      break;
+    }
+
+    total += snapshot_count(&snaps[n]);
+  }
+  opt_verbose = verbose;
+
+  if(r < 0) {
+    goto out;
+  }
+
+  if(targets == NULL) {
+    results = malloc((total + 1) * sizeof(snapshot_result_t));
+    if(results == NULL) {
+      r = -ENOMEM;
+      goto out;
+    }
+
+    for(size_t k = 0; k < ndbs; ++k) {
+      for(size_t pkg = 0; pkg < snapshot_count(&snaps[k]); ++pkg) {
+        results[count++] = (snapshot_result_t){ &snaps[k], pkg };
+      }
+    }
+  } else {
+    results = malloc((alpm_list_count(targets) * ndbs + 1) *
+        sizeof(snapshot_result_t));
+    if(results == NULL) {
+      r = -ENOMEM;
+      goto out;
+    }
+
+    count = snapshot_search_exact(snaps, dbs, targets, results);
+  }
+
+  stats_stop(STATS_SEARCH, clock);
+
+  clock = stats_start();
+  written = stats_written(buf);
+  for(size_t k = 0; k < count; ++k) {
+    print_snapshot_pkg(buf, results[k].snap, results[k].pkg, format, counter);
+    counter += format->counters;
+  }
+  stats_printed(clock, buf, written);
+
+out:
+  for(size_t k = 0; k < ndbs; ++k) {
+    snapshot_reset(&snaps[k]);
+  }
+
+  return r < 0 ? r : (int)count;
+}
+
+/* everything a query was asked to do with its results */
+typedef struct query_t {
+  format_t format;
+  filter_t filter;
+  sort_t sort;
+  grouping_t grouping;
+} query_t;
+
+/* whether a query prints token, or needs its value otherwise */
+static bool query_has_token(const query_t *query, char token)
+{
+  return format_has_token(&query->format, token) ||
+    filter_has_token(&query->filter, token) ||
+    sort_has_token(&query->sort, token) ||
+    grouping_has_token(&query->grouping, token);
+}
+
+/* the repos a sync query's targets name, when all of them are given as
+ * repo/pkg and nothing printed looks beyond the packages themselves.
+ * Returns false if every sync DB is needed. */
+static bool sync_targets_repos(const query_t *query, alpm_list_t *targets,
+    alpm_list_t **repos)
+{
+  *repos = NULL;
+
+  if(targets == NULL || opt_what != SEARCH_EXACT) {
+    return false;
+  }
+
+  /* these span every sync DB */
+  for(const char *t = "NWXxYy"; *t; ++t) {
+    if(query_has_token(query, *t)) {
+      return false;
+    }
+  }
+
+  for(alpm_list_t *i = targets; i; i = i->next) {
+    const char *slash = strchr(i->data, '/');
+    char *repo = NULL;
+
+    if(slash != NULL) {
+      repo = strndup(i->data, slash - (const char *)i->data);
+    }
+    if(repo == NULL) {
+      alpm_list_free_inner(*repos, free);
+      alpm_list_free(*repos);
+      *repos = NULL;
+      return false;
+    }
+
+    *repos = alpm_list_add(*repos, repo);
+  }
+
+  return true;
+}
+
+/* registers the sync DBs a query needs, which are all of them unless its
+ * targets say otherwise */
+static void syncdbs_prepare(expac_t *expac, const query_t *query,
+    alpm_list_t *targets)
+{
+  alpm_list_t *repos;
+
+  if(sync_targets_repos(query, targets, &repos)) {
+    expac_register_syncdbs(expac, repos);
+    alpm_list_free_inner(repos, free);
+    alpm_list_free(repos);
+  } else {
+    expac_register_syncdbs(expac, NULL);
+  }
+}
+
+/* libalpm goes over every package in the DB for each %N or %W. Index the
+ * whole DB once instead. Packages from files are looked up in the local DB,
+ * as libalpm does. Failing that, print_pkg asks libalpm after all. */
+static void revdeps_prepare(expac_t *expac, const query_t *query)
+{
+  const bool sync = opt_corpus == CORPUS_SYNC;
+  alpm_list_t *dbs;
+
+  if(sync) {
+    dbs = alpm_get_syncdbs(expac->alpm);
+  } else {
+    dbs = alpm_list_add(NULL, alpm_get_localdb(expac->alpm));
+  }
+
+  if(query_has_token(query, 'N')) {
+    revdeps_build(&requiredby, dbs, false, sync);
+  }
+  if(query_has_token(query, 'W')) {
+    revdeps_build(&optionalfor, dbs, true, sync);
+  }
+
+  if(!sync) {
+    alpm_list_free(dbs);
+  }
+}
+
+/* the graph behind %X and %Y spans the same DBs as revdeps_prepare's
+ * indexes. Closures are only worked out for what's about to be printed. */
+static int depgraph_prepare_query(expac_t *expac, alpm_list_t *results,
+    const query_t *query)
+{
+  const bool depends = query_has_token(query, 'X') ||
+    query_has_token(query, 'x');
+  const bool reqby = query_has_token(query, 'Y') ||
+    query_has_token(query, 'y');
+  alpm_list_t *dbs;
+  int r;
+
+  if(!depends && !reqby) {
+    return 0;
+  }
+
+  if(opt_corpus == CORPUS_SYNC) {
+    dbs = alpm_list_copy(alpm_get_syncdbs(expac->alpm));
+  } else {
+    dbs = alpm_list_add(NULL, alpm_get_localdb(expac->alpm));
+  }
+
+  r = depgraph_build(&depgraph, dbs);
+  if(r == 0) {
+    r = depgraph_prepare(&depgraph, results, depends, reqby);
+  }
+
+  alpm_list_free(dbs);
+
+  if(r < 0) {
+    fprintf(stderr, "error: failed to build dependency graph: %s\n",
+        strerror(-r));
+  }
+
+  return r;
+}
+
+static int filter_compile_opt(filter_t *filter)
+{
+  filter_error_t error;
+  int r;
+
+  if(opt_filter == NULL) {
+    return 0;
+  }
+
+  r = filter_compile(filter, opt_filter, &error);
+  if(r < 0) {
+    fprintf(stderr, "error: invalid filter: %s\n  %s\n  %*s^\n",
+        error.message, opt_filter, (int)error.pos, "");
+  }
+
+  return r;
+}
+
+static int sort_compile_opt(sort_t *sort)
+{
+  const char *unknown;
+  size_t len;
+  int r;
+
+  r = sort_compile(sort, opt_sort, opt_reverse, opt_limit, &unknown, &len);
+  if(r == -EINVAL) {
+    fprintf(stderr, "error: unknown field for --sort: %.*s\n", (int)len, unknown);
+  } else if(r < 0) {
+    fprintf(stderr, "error: failed to compile sort order: %s\n", strerror(-r));
+  }
+
+  return r;
+}
+
+static int grouping_compile_opt(grouping_t *grouping)
+{
+  grouping_error_t error;
+  int r;
+
+  if(opt_group_by == NULL) {
+    return 0;
+  }
+
+  r = grouping_compile(grouping, opt_group_by, opt_aggregate, &error);
+  if(r == -EINVAL) {
+    fprintf(stderr, "error: invalid grouping: %s: %.*s\n", error.message,
+        (int)error.len, error.where);
+  } else if(r < 0) {
+    fprintf(stderr, "error: failed to compile grouping: %s\n", strerror(-r));
+  }
+
+  return r;
+}
+
+static int query_compile(query_t *query)
+{
+  int r;
+
+  /* a grouping prints its own rows rather than a format */
+  r = format_compile(&query->format, opt_group_by ? "" : opt_format,
+      opt_delim, opt_listdelim);
+  if(r < 0) {
+    fprintf(stderr, "error: failed to compile format: %s\n", strerror(-r));
+    return r;
+  }
+
+  r = filter_compile_opt(&query->filter);
+  if(r < 0) {
+    return r;
   }
 
-  return results;
+  r = sort_compile_opt(&query->sort);
+  if(r < 0) {
+    return r;
+  }
+
+  r = grouping_compile_opt(&query->grouping);
+  if(r == 0 && opt_group_by && opt_output != OUTPUT_TEXT) {
+    fprintf(stderr, "error: --group-by only prints text\n");
+    r = -EINVAL;
+  }
+
+  return r;
 }
 
-static alpm_list_t *resolve_targets(alpm_list_t *dblist, alpm_list_t *targets)
+static void query_reset(query_t *query)
 {
-  if(targets == NULL) {
-    return all_packages(dblist);
+  format_reset(&query->format);
+  filter_reset(&query->filter);
+  sort_reset(&query->sort);
+  grouping_reset(&query->grouping);
+}
+
+/* drops whatever was worked out for a query's results, and the packages
+ * loaded for it */
+static void query_prepare_reset(void)
+{
+  revdeps_reset(&requiredby);
+  revdeps_reset(&optionalfor);
+  depgraph_reset(&depgraph);
+  modified_reset(&modified_backups);
+  repo_files_reset();
+  loaded_pkgs_reset();
+}
+
+/* runs a single query with the current options, printing the results to
+ * buf. Returns the number of results, or a negative errno.
+ *
+ * A filter is applied once the results are known, leaving out whatever
+ * needs the whole set of results, such as %M or %N. Only the packages which
+ * pass everything else have those worked out and the filter applied again.
+ * Likewise, results are sorted and cut down to --limit before anything is
+ * worked out for them, unless that takes one of those fields. */
+static int expac_query(expac_t *expac, outbuf_t *buf, alpm_list_t *targets)
+{
+  _cleanup_(query_reset) query_t query;
+  _cleanup_free_ bool *pending = NULL;
+  const size_t total = buf->total;
+  stats_clock_t clock, written;
+  alpm_list_t *results;
+  bool late_sort, ready = true;
+  int r, count;
+
+  memset(&query, 0, sizeof(query));
+
+  r = query_compile(&query);
+  if(r < 0) {
+    return r;
   }
 
-  if(opt_what == SEARCH_REGEX) {
-    return search_packages(dblist, targets);
+  if(opt_corpus == CORPUS_SYNC) {
+    syncdbs_prepare(expac, &query, targets);
   }
 
-  if(opt_what == SEARCH_GROUPS) {
-    return search_groups(dblist, targets);
+  if(snapshot_usable(&query.format, targets)) {
+    r = expac_query_snapshots(expac, buf, targets, &query.format);
+    if(r >= 0) {
+      stats_results(r, buf->total - total);
+      return r;
+    }
   }
 
-  return search_exact(dblist, targets);
+  clock = stats_start();
+  if(opt_files && opt_corpus == CORPUS_SYNC &&
+      (query_has_token(&query, 'F') ||
+       (targets != NULL && opt_what == SEARCH_OWNER))) {
+    r = repo_files_open(expac);
+    if(r < 0) {
+      return r;
+    }
+  }
+
+  results = expac_search(expac, opt_corpus, targets);
+  if(results && query.filter.root) {
+    pending = malloc(alpm_list_count(results) * sizeof(bool));
+    if(pending == NULL) {
+      query_prepare_reset();
+      alpm_list_free(results);
+      return -ENOMEM;
+    }
+    results = filter_results(&query.filter, results, false, pending);
+  }
+  stats_stop(STATS_SEARCH, clock);
+  if(results == NULL) {
+    /* which still makes for an empty JSON array */
+    if(query.grouping.key == NULL) {
+      print_results(expac, buf, NULL, &query.format);
+    }
+    query_prepare_reset();
+    return 0;
+  }
+
+  clock = stats_start();
+
+  late_sort = query.filter.deferred || query.sort.deferred;
+  if(!late_sort) {
+    r = sort_results(&query.sort, &results, field_get, &ready);
+    if(r < 0) {
+      query_prepare_reset();
+      alpm_list_free(results);
+      return r;
+    }
+  }
+
+  if(opt_corpus == CORPUS_LOCAL) {
+    expac_readahead_local(expac, results, &query.format);
+  }
+
+  if(query_has_token(&query, 'M')) {
+    r = modified_compute(&modified_backups, results,
+        alpm_option_get_root(expac->alpm), opt_cachedir, opt_rehash,
+        pool_online_cpus());
+    if(r < 0) {
+      query_prepare_reset();
+      alpm_list_free(results);
+      return r;
+    }
+  }
+
+  revdeps_prepare(expac, &query);
+
+  r = depgraph_prepare_query(expac, results, &query);
+  if(r == 0 && query.filter.deferred) {
+    results = filter_results(&query.filter, results, true, pending);
+  }
+  if(r == 0 && late_sort) {
+    r = sort_results(&query.sort, &results, field_get, &ready);
+  }
+  if(r < 0) {
+    query_prepare_reset();
+    alpm_list_free(results);
+    return r;
+  }
+
+  stats_stop(STATS_PREPARE, clock);
+
+  clock = stats_start();
+  written = stats_written(buf);
+  if(query.grouping.key) {
+    r = grouping_add(&query.grouping, results, field_get, &ready);
+    if(r == 0) {
+      print_groups(buf, &query.grouping, &query.format);
+    }
+  } else {
+    r = print_results(expac, buf, results, &query.format);
+  }
+  stats_printed(clock, buf, written);
+  count = alpm_list_count(results);
+
+  query_prepare_reset();
+  alpm_list_free(results);
+
+  stats_results(count, buf->total - total);
+
+  return r < 0 ? r : count;
 }
 
-static void expac_free(expac_t *expac)
+static const char *request_apply(const request_t *req)
 {
-  if(expac == NULL) {
-    return;
+  if(req->error) {
+    return req->error;
   }
 
-  alpm_release(expac->alpm);
-  free(expac);
-}
+  if(req->format) {
+    opt_format = req->format;
+  }
+  if(req->groupby) {
+    opt_group_by = req->groupby;
+  }
+  if(req->aggregate) {
+    opt_aggregate = req->aggregate;
+  }
 
-static void expac_freep(expac_t **expac) {
-  expac_free(*expac);
+  if(opt_format == NULL && opt_group_by == NULL) {
+    return "request has no format";
+  }
+
+  if(req->corpus) {
+    if(strcmp(req->corpus, "local") == 0) {
+      opt_corpus = CORPUS_LOCAL;
+    } else if(strcmp(req->corpus, "sync") == 0) {
+      opt_corpus = CORPUS_SYNC;
+    } else if(strcmp(req->corpus, "file") == 0) {
+      opt_corpus = CORPUS_FILE;
+    } else {
+      return "invalid corpus";
+    }
+  }
+
+  if(req->search) {
+    if(strcmp(req->search, "exact") == 0) {
+      opt_what = SEARCH_EXACT;
+    } else if(strcmp(req->search, "groups") == 0) {
+      opt_what = SEARCH_GROUPS;
+    } else if(strcmp(req->search, "regex") == 0) {
+      opt_what = SEARCH_REGEX;
+    } else if(strcmp(req->search, "owner") == 0) {
+      opt_what = SEARCH_OWNER;
+    } else {
+      return "invalid search mode";
+    }
+  }
+
+  if(opt_what == SEARCH_OWNER && opt_corpus != CORPUS_LOCAL &&
+      !(opt_corpus == CORPUS_SYNC && opt_files)) {
+    return "owner search only works on the local corpus, or the sync corpus with --files";
+  }
+
+  if(req->humansize && parse_humansize(req->humansize, &opt_humansize) < 0) {
+    return "invalid SI size formatter";
+  }
+
+  if(req->delim) {
+    opt_delim = req->delim;
+  }
+  if(req->listdelim) {
+    opt_listdelim = req->listdelim;
+  }
+  if(req->timefmt) {
+    opt_timefmt = req->timefmt;
+  }
+  if(req->filter) {
+    opt_filter = req->filter;
+  }
+  if(req->sort) {
+    opt_sort = req->sort;
+  }
+  if(req->limit && parse_limit(req->limit, &opt_limit) < 0) {
+    return "invalid limit";
+  }
+  if(req->reverse) {
+    opt_reverse = true;
+  }
+  if(req->output && parse_output(req->output, &opt_output) < 0) {
+    return "invalid output mode";
+  }
+  if(req->readone) {
+    opt_readone = true;
+  }
+
+  return NULL;
 }
 
-static int expac_new(expac_t **expac, const char *config_file)
+/* answers requests from in until it runs dry. Each response carries the
+ * output of one query, as described in expac(1). Queries go through the
+ * global options, so if lock is given it's held for each of them. */
+static int expac_batch(expac_t *expac, FILE *in, int outfd,
+    pthread_mutex_t *lock)
 {
-  expac_t *e;
-  enum _alpm_errno_t alpm_errno = 0;
-  config_t config;
-  const char *dbroot = "/";
-  const char *dbpath = "/var/lib/pacman";
+  _cleanup_(outbuf_reset) outbuf_t out;
+  _cleanup_(outbuf_reset) outbuf_t payload;
+  query_opts_t defaults;
   int r;
 
-  e = calloc(1, sizeof(*e));
-  if(e == NULL) {
-    return -ENOMEM;
-  }
+  memset(&out, 0, sizeof(out));
+  memset(&payload, 0, sizeof(payload));
 
-  memset(&config, 0, sizeof(config));
+  query_opts_save(&defaults);
 
-  r = config_parse(&config, config_file);
+  r = outbuf_init(&out, outfd, opt_bufsize);
   if(r < 0) {
     return r;
   }
 
-  if(config.dbpath) {
-    dbpath = config.dbpath;
+  r = outbuf_init(&payload, -1, opt_bufsize);
+  if(r < 0) {
+    return r;
   }
 
-  if(config.dbroot) {
-    dbroot = config.dbroot;
-  }
+  for(;;) {
+    _cleanup_(request_reset) request_t req;
+    const char *error;
+    size_t count = 0;
 
-  e->alpm = alpm_initialize(dbroot, dbpath, &alpm_errno);
-  if(!e->alpm) {
-    fprintf(stderr, "error: failed to initialize alpm: %s\n", alpm_strerror(alpm_errno));
-    return -alpm_errno;
-  }
+    r = request_read(in, &req);
+    if(r <= 0) {
+      break;
+    }
+
+    if(lock) {
+      pthread_mutex_lock(lock);
+    }
+
+    query_opts_restore(&defaults);
+    payload.len = 0;
+
+    error = request_apply(&req);
+    if(error == NULL) {
+      r = expac_query(expac, &payload, req.targets);
+      if(r < 0) {
+        error = strerror(-r);
+      } else {
+        count = r;
+      }
+    }
+
+    /* the options must not point into the request once it is freed */
+    query_opts_restore(&defaults);
 
-  for(int i = 0; i < config.size; ++i) {
-    alpm_register_syncdb(e->alpm, config.repos[i], 0);
+    if(lock) {
+      pthread_mutex_unlock(lock);
+    }
+
+    if(error != NULL) {
+      r = response_write(&out, false, 0, error, strlen(error));
+    } else {
+      r = response_write(&out, true, count, payload.buf, payload.len);
+    }
+
+    if(r < 0) {
+      break;
+    }
   }
 
-  config_reset(&config);
+  return r;
+}
 
-  *expac = e;
+typedef struct serve_t {
+  expac_t *expac;
+  pthread_mutex_t lock;
+} serve_t;
 
-  return 0;
+static void serve_handle(void *ctx, int fd)
+{
+  serve_t *serve = ctx;
+  FILE *in;
+
+  /* fclose must not take the socket away from the response writer */
+  in = fdopen(dup(fd), "r");
+  if(in == NULL) {
+    return;
+  }
+
+  expac_batch(serve->expac, in, fd, &serve->lock);
+
+  fclose(in);
 }
 
-static alpm_list_t *expac_search_files(expac_t *expac, alpm_list_t *targets)
+static void reload_syncdbs(expac_t *expac, alpm_list_t *changed)
 {
-  alpm_list_t *i, *r = NULL;
+  alpm_list_t *names = NULL, *i;
+  bool found = false;
+
+  /* libalpm has no way to drop a DB's cache, only to unregister it. Since
+   * the order of the sync DBs matters, everything from the first changed DB
+   * onwards is registered again in its original order. */
+  i = alpm_get_syncdbs(expac->alpm);
+  while(i) {
+    alpm_db_t *db = i->data;
+    const char *name = alpm_db_get_name(db);
 
-  for(i = targets; i; i = i->next) {
-    const char *path = i->data;
-    alpm_pkg_t *pkg;
+    i = i->next;
 
-    if(alpm_pkg_load(expac->alpm, path, 0, 0, &pkg) != 0) {
-      fprintf(stderr, "error: %s: %s\n", path,
-          alpm_strerror(alpm_errno(expac->alpm)));
+    if(!found && alpm_list_find_str(changed, name) == NULL) {
       continue;
     }
+    found = true;
 
-    r = alpm_list_add(r, pkg);
+    names = alpm_list_add(names, strdup(name));
+    alpm_db_unregister(db);
   }
 
-  return r;
+  for(i = names; i; i = i->next) {
+    alpm_register_syncdb(expac->alpm, i->data, 0);
+  }
+
+  alpm_list_free_inner(names, free);
+  alpm_list_free(names);
 }
 
-static alpm_list_t *expac_search_local(expac_t *expac, alpm_list_t *targets)
+static void serve_reload(void *ctx, int what, alpm_list_t *syncdbs)
 {
-  alpm_list_t *dblist, *r;
+  serve_t *serve = ctx;
+  expac_t *fresh, tmp;
 
-  dblist = alpm_list_add(NULL, alpm_get_localdb(expac->alpm));
-  r = resolve_targets(dblist, targets);
-  alpm_list_free(dblist);
+  pthread_mutex_lock(&serve->lock);
 
-  return r;
+  if(what & RELOAD_LOCAL) {
+    /* the local DB can't be unregistered, so start over with a new handle,
+     * keeping the one clients know about */
+    if(expac_new(&fresh, opt_config_file) < 0) {
+      fprintf(stderr, "warning: failed to reload databases, keeping the old ones\n");
+    } else {
+      tmp = *serve->expac;
+      *serve->expac = *fresh;
+      *fresh = tmp;
+      expac_free(fresh);
+    }
+  } else if(what & RELOAD_SYNC) {
+    reload_syncdbs(serve->expac, syncdbs);
+  }
+
+  pthread_mutex_unlock(&serve->lock);
 }
 
-static alpm_list_t *expac_search_sync(expac_t *expac, alpm_list_t *targets)
+static int expac_serve(expac_t *expac, const char *sockpath)
 {
-  return resolve_targets(alpm_get_syncdbs(expac->alpm), targets);
+  _cleanup_free_ char *dbpath = NULL;
+  serve_t serve = {
+    .expac = expac,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+  };
+  const server_t server = {
+    .handle = serve_handle,
+    .reload = serve_reload,
+    .ctx = &serve,
+  };
+
+  /* the handle, and the path along with it, is replaced on reload */
+  dbpath = strdup(alpm_option_get_dbpath(expac->alpm));
+  if(dbpath == NULL) {
+    return -ENOMEM;
+  }
+
+  return server_run(sockpath, dbpath, &server);
 }
 
-static alpm_list_t *expac_search(expac_t *expac, package_corpus_t corpus, alpm_list_t *targets)
+static const char *corpus_name(package_corpus_t corpus)
 {
   switch (corpus) {
-  case CORPUS_LOCAL:
-    return expac_search_local(expac, targets);
-  case CORPUS_SYNC:
-    return expac_search_sync(expac, targets);
-  case CORPUS_FILE:
-    return expac_search_files(expac, targets);
+    case CORPUS_SYNC:
+      return "sync";
+    case CORPUS_FILE:
+      return "file";
+    default:
+      return "local";
   }
+}
 
-  /* should be unreachable */
-  return NULL;
+static const char *output_name(output_format_t output)
+{
+  switch (output) {
+    case OUTPUT_JSON:
+      return "json";
+    case OUTPUT_JSONL:
+      return "jsonl";
+    case OUTPUT_NUL:
+      return "nul";
+    case OUTPUT_BINARY:
+      return "binary";
+    default:
+      return "text";
+  }
+}
+
+static const char *search_name(search_what_t what)
+{
+  switch (what) {
+    case SEARCH_GROUPS:
+      return "groups";
+    case SEARCH_REGEX:
+      return "regex";
+    case SEARCH_OWNER:
+      return "owner";
+    default:
+      return "exact";
+  }
 }
 
-static int read_targets_from_file(FILE *in, alpm_list_t **targets)
+/* sends the query given on the command line to a server instead of
+ * running it here. Returns like expac_query, minus the count. */
+static int expac_connect(const char *sockpath, alpm_list_t *targets)
 {
-  char line[BUFSIZ];
-  int i = 0, end = 0, targets_added = 0;
+  _cleanup_(outbuf_reset) outbuf_t out;
+  char humansize[2] = { opt_humansize, '\0' };
+  char limit[21];
+  request_t req = {
+    .format = (char *)opt_format,
+    .corpus = (char *)corpus_name(opt_corpus),
+    .search = (char *)search_name(opt_what),
+    .delim = (char *)opt_delim,
+    .listdelim = (char *)opt_listdelim,
+    .timefmt = (char *)opt_timefmt,
+    .humansize = opt_humansize ? humansize : "auto",
+    .filter = (char *)opt_filter,
+    .sort = (char *)opt_sort,
+    .limit = opt_limit ? limit : NULL,
+    .reverse = opt_reverse,
+    .groupby = (char *)opt_group_by,
+    .aggregate = opt_group_by ? (char *)opt_aggregate : NULL,
+    .output = (char *)output_name(opt_output),
+    .readone = opt_readone,
+    .targets = targets,
+  };
+  int r;
 
-  while(!end) {
-    line[i] = fgetc(in);
+  uint_to_str(opt_limit, limit);
+  memset(&out, 0, sizeof(out));
 
-    if(feof(in))
-      end = 1;
+  r = outbuf_init(&out, -1, 0);
+  if(r < 0) {
+    return r;
+  }
 
-    if(isspace(line[i]) || end) {
-      line[i] = '\0';
-      /* avoid adding zero length arg, if multiple spaces separate args */
-      if(i > 0) {
-        if(!alpm_list_find_str(*targets, line)) {
-          *targets = alpm_list_add(*targets, strdup(line));
-        }
-        i = 0;
-        ++targets_added;
+  /* the server doesn't share our working directory */
+  if(opt_corpus == CORPUS_FILE) {
+    for(alpm_list_t *i = targets; i; i = i->next) {
+      char *path = realpath(i->data, NULL);
+      if(path != NULL) {
+        free(i->data);
+        i->data = path;
       }
-    } else {
-      ++i;
-      if(i >= BUFSIZ) {
-        fprintf(stderr, "error: buffer overflow on stdin\n");
-        return -1;
+    }
+  } else if(opt_what == SEARCH_OWNER && opt_corpus == CORPUS_LOCAL) {
+    _cleanup_free_ char *cwd = getcwd(NULL, 0);
+
+    /* the file itself mustn't be resolved, and names of programs are left
+     * for the server to look up */
+    for(alpm_list_t *i = targets; cwd && i; i = i->next) {
+      const char *target = i->data;
+      struct stat st;
+      char *path;
+
+      if(target[0] == '/' ||
+          (strchr(target, '/') == NULL && lstat(target, &st) < 0)) {
+        continue;
+      }
+
+      if(asprintf(&path, "%s/%s", cwd, target) >= 0) {
+        free(i->data);
+        i->data = path;
       }
     }
   }
 
-  return targets_added;
+  r = request_write(&out, &req);
+  if(r < 0) {
+    fprintf(stderr, "error: query cannot be sent to a server: %s\n",
+        strerror(-r));
+    return r;
+  }
+
+  return client_query(sockpath, out.buf, out.len);
 }
 
-static int process_targets(int argc, char **argv, alpm_list_t **targets)
+static void expac_report_stats(void)
 {
-  int allow_stdin;
-
-  allow_stdin = !isatty(STDIN_FILENO);
-
-  for(int i = 0; i < argc; ++i) {
-    if(allow_stdin && strcmp(argv[i], "-") == 0) {
-      int k;
-
-      k = read_targets_from_file(stdin, targets);
-      if(k < 0) {
-        return k;
-      }
+  int r;
 
-      if(k == 0) {
-        fputs("error: argument '-' specified with empty stdin\n", stderr);
-        return -1;
-      }
+  if(!opt_stats) {
+    return;
+  }
 
-      allow_stdin = 0;
-    } else {
-      *targets = alpm_list_add(*targets, strdup(argv[i]));
-    }
+  if(opt_stats_fd < 0) {
+    r = stats_report(STDERR_FILENO, false);
+  } else {
+    r = stats_report(opt_stats_fd, true);
   }
 
-  return 0;
+  if(r < 0) {
+    fprintf(stderr, "error: failed to write stats: %s\n", strerror(-r));
+  }
 }
 
 int main(int argc, char *argv[])
 {
-  alpm_list_t *results = NULL, *targets = NULL;
+  alpm_list_t *targets = NULL;
   _cleanup_(expac_freep) expac_t *expac = NULL;
+  _cleanup_(outbuf_reset) outbuf_t buf;
+  stats_clock_t clock;
   int r;
 
+  memset(&buf, 0, sizeof(buf));
+
   r = parse_options(&argc, &argv);
   if(r < 0) {
     return 1;
   }
 
+  /* localtime_r isn't required to do this for us */
+  tzset();
+
   r = process_targets(argc, argv, &targets);
   if(r < 0) {
     return 1;
   }
 
+  if(opt_connect) {
+    r = expac_connect(opt_connect, targets);
+    alpm_list_free_inner(targets, free);
+    alpm_list_free(targets);
+    return r <= 0;
+  }
+
   r = expac_new(&expac, opt_config_file);
   if(r < 0) {
     return 1;
   }
 
-  results = expac_search(expac, opt_corpus, targets);
-  if(results == NULL) {
-    return 1;
+  if(opt_batch) {
+    r = expac_batch(expac, stdin, STDOUT_FILENO, NULL);
+    expac_report_stats();
+    return r < 0;
   }
 
-  for(alpm_list_t *i = results; i; i = i->next) {
-    print_pkg(i->data, opt_format);
+  if(opt_serve) {
+    r = expac_serve(expac, opt_serve);
+    expac_report_stats();
+    return r < 0;
+  }
+
+  r = outbuf_init(&buf, STDOUT_FILENO, opt_bufsize);
+  if(r < 0) {
+    return 1;
   }
 
+  r = expac_query(expac, &buf, targets);
+
   alpm_list_free_inner(targets, free);
   alpm_list_free(targets);
-  alpm_list_free(results);
 
-  return 0;
+  clock = stats_start();
+  if(outbuf_flush(&buf) < 0 || buf.error < 0) {
+    fprintf(stderr, "error: failed to write output: %s\n", strerror(-buf.error));
+    return 1;
+  }
+  stats_stop(STATS_OUTPUT, clock);
+
+  expac_report_stats();
+
+  return r <= 0;
 }
 
 /* vim: set et ts=2 sw=2: */
@@ -13,10 +13,28 @@ typedef enum search_what_t {
   SEARCH_EXACT,
   SEARCH_GROUPS,
   SEARCH_REGEX,
+  SEARCH_OWNER,
 } search_what_t;
 
+typedef enum output_format_t {
+  OUTPUT_TEXT,
+  OUTPUT_JSON,
+  OUTPUT_JSONL,
+  OUTPUT_NUL,
+  OUTPUT_BINARY,
+} output_format_t;
+
 typedef struct expac_t {
   alpm_handle_t *alpm;
+
+  /* the sync DBs from the config, in order, which are only registered once
+   * a query needs them */
+  char **repos;
+  size_t nrepos;
+
+  /* extra handles, so package files can be loaded on several threads */
+  alpm_handle_t **loaders;
+  size_t nloaders;
 } expac_t;
 
 #endif  /* _EXPAC_H */
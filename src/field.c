@@ -0,0 +1,101 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "field.h"
+
+static const field_t fields[] = {
+  { "alldepends",    'X', FIELD_LIST,    true  },
+  { "allrequiredby", 'Y', FIELD_LIST,    true  },
+  { "arch",          'a', FIELD_STR,     false },
+  { "backup",        'B', FIELD_LIST,    false },
+  { "base",          'e', FIELD_STR,     false },
+  { "builddate",     'b', FIELD_TIME,    false },
+  { "checkdepends",  'K', FIELD_LIST,    false },
+  { "conflicts",     'C', FIELD_LIST,    false },
+  { "depends",       'E', FIELD_LIST,    false },
+  { "desc",          'd', FIELD_STR,     false },
+  { "filename",      'f', FIELD_STR,     false },
+  { "files",         'F', FIELD_LIST,    false },
+  { "groups",        'G', FIELD_LIST,    false },
+  { "installdate",   'l', FIELD_TIME,    false },
+  { "isize",         'm', FIELD_SIZE,    false },
+  { "licenses",      'L', FIELD_LIST,    false },
+  { "makedepends",   'J', FIELD_LIST,    false },
+  { "md5sum",        's', FIELD_STR,     false },
+  { "modified",      'M', FIELD_LIST,    true  },
+  { "name",          'n', FIELD_STR,     false },
+  { "optdepends",    'o', FIELD_LIST,    false },
+  { "optionalfor",   'W', FIELD_LIST,    true  },
+  { "packager",      'p', FIELD_STR,     false },
+  { "provides",      'S', FIELD_LIST,    false },
+  { "reason",        'w', FIELD_STR,     false },
+  { "replaces",      'R', FIELD_LIST,    false },
+  { "repo",          'r', FIELD_STR,     false },
+  { "requiredby",    'N', FIELD_LIST,    true  },
+  { "sha256sum",     'h', FIELD_STR,     false },
+  { "size",          'k', FIELD_SIZE,    false },
+  { "url",           'u', FIELD_STR,     false },
+  { "validation",    'V', FIELD_LIST,    false },
+  { "version",       'v', FIELD_VERSION, false },
+};
+
+/* names for the tokens which print something no field above stands for */
+static const struct {
+  char token;
+  const char *name;
+} token_names[] = {
+  { 'D', "depends_versioned" },
+  { 'g', "pgpsig" },
+  { 'H', "conflicts_versioned" },
+  { 'i', "scriptlet" },
+  { 'O', "optdepends_described" },
+  { 'P', "provides_versioned" },
+  { 'T', "replaces_versioned" },
+  { 'x', "alldepends_count" },
+  { 'y', "allrequiredby_count" },
+  { '!', "index" },
+};
+
+/* name need not be NUL terminated */
+const field_t *field_lookup(const char *name, size_t len)
+{
+  for(size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); ++i) {
+    if(strlen(fields[i].name) == len && memcmp(fields[i].name, name, len) == 0) {
+      return &fields[i];
+    }
+  }
+
+  return NULL;
+}
+
+/* what a format token is called in structured output */
+const char *field_key(char token)
+{
+  for(size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); ++i) {
+    if(fields[i].token == token) {
+      return fields[i].name;
+    }
+  }
+
+  for(size_t i = 0; i < sizeof(token_names) / sizeof(token_names[0]); ++i) {
+    if(token_names[i].token == token) {
+      return token_names[i].name;
+    }
+  }
+
+  return "";
+}
+
+void field_value_reset(field_value_t *value)
+{
+  if(value->owned_items) {
+    alpm_list_free_inner(value->list, free);
+  }
+  if(value->owned) {
+    alpm_list_free(value->list);
+  }
+
+  memset(value, 0, sizeof(*value));
+}
+
+/* vim: set et ts=2 sw=2: */
@@ -0,0 +1,49 @@
+#ifndef _FIELD_H
+#define _FIELD_H
+
+#include <alpm.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum field_type_t {
+  FIELD_STR,
+  FIELD_VERSION,
+  FIELD_SIZE,
+  FIELD_TIME,
+  FIELD_LIST,
+} field_type_t;
+
+/* a package attribute known by name, for the options which take one rather
+ * than a format. Each corresponds to a format token. */
+typedef struct field_t {
+  const char *name;
+  char token;
+  field_type_t type;
+
+  /* computed over a whole set of packages rather than one at a time */
+  bool deferred;
+} field_t;
+
+/* a package's value of a field. Lists are of strings; the list itself is
+ * freed with the value if owned is set, and its contents as well if
+ * owned_items is. */
+typedef struct field_value_t {
+  const char *str;
+  int64_t num;
+  alpm_list_t *list;
+  bool owned;
+  bool owned_items;
+} field_value_t;
+
+/* fills in pkg's value of field. Returns 0, or -EAGAIN if it can't be known
+ * yet. */
+typedef int (*field_get_fn)(void *ctx, alpm_pkg_t *pkg, const field_t *field,
+    field_value_t *value);
+
+const field_t *field_lookup(const char *name, size_t len);
+const char *field_key(char token);
+void field_value_reset(field_value_t *value);
+
+#endif  /* _FIELD_H */
+
+/* vim: set et ts=2 sw=2: */
@@ -0,0 +1,861 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "binary.h"
+#include "filesdb.h"
+#include "hashmap.h"
+#include "output.h"
+#include "util.h"
+
+#define FILESDB_MAGIC     "expacfl1"
+#define FILESDB_BOM       0x01020304u
+
+/* paths per block of front coded paths. Each block starts with a whole
+ * path, so that any path is at most this many steps from one. */
+#define FILESDB_BLOCK     16
+
+#define FILESDB_PATH_MAX  4096
+
+#define NO_PATH           UINT64_MAX
+
+struct filesdb_header_t {
+  char magic[8];
+  uint32_t bom;
+  uint32_t npkgs;
+  uint64_t npaths;
+  uint64_t nentries;
+
+  /* the DB this was built from */
+  uint64_t db_dev;
+  uint64_t db_ino;
+  uint64_t db_size;
+  int64_t db_mtime_ns;
+
+  uint64_t pkg_paths_off;
+  uint64_t paths_off;
+  uint64_t path_pkgs_off;
+  uint64_t pkgs_off;
+  uint64_t blocks_off;
+  uint64_t names_off;
+  uint64_t buckets_off;
+  uint64_t nbuckets;
+  uint64_t coded_off;
+  uint64_t coded_len;
+  uint64_t strings_off;
+  uint64_t strings_len;
+};
+
+/* Layout, after the header:
+ *
+ *   pkg_paths  npkgs + 1 indices into paths, where each package's start
+ *   paths      the ids of the paths owned by each package, in order
+ *   path_pkgs  npaths + 1 indices into pkgs, where each path's start
+ *   pkgs       the packages owning each path
+ *   blocks     where each block of paths starts in coded
+ *   names      the name of each package, as an offset into strings
+ *   buckets    package names, hashed, holding the package plus one
+ *   coded      the paths: for each, the length it shares with the one
+ *              before, the length of the rest, and the rest
+ *
+ * Lookups in the tables sized by the number of paths check what they read,
+ * rather than having the whole file checked each time it's mapped. */
+
+typedef struct pending_entry_t {
+  const char *path;
+  uint32_t pkg;
+} pending_entry_t;
+
+/* where a walk through the coded paths is at */
+typedef struct cursor_t {
+  uint64_t next;
+  size_t pos;
+  size_t len;
+  char buf[FILESDB_PATH_MAX];
+} cursor_t;
+
+static size_t align8(size_t n)
+{
+  return (n + 7) & ~(size_t)7;
+}
+
+static int64_t stat_mtime_ns(const struct stat *st)
+{
+  return (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+}
+
+static bool region_fits(size_t len, uint64_t off, uint64_t count, size_t size)
+{
+  return off <= len && count <= (len - off) / size;
+}
+
+static bool get_varint(const unsigned char *p, size_t len, size_t *pos,
+    uint64_t *out)
+{
+  uint64_t n = 0;
+
+  for(unsigned shift = 0; shift < 64 && *pos < len; shift += 7) {
+    unsigned char c = p[(*pos)++];
+
+    n |= (uint64_t)(c & 0x7f) << shift;
+    if(!(c & 0x80)) {
+      *out = n;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static void cursor_init(cursor_t *c)
+{
+  c->next = NO_PATH;
+  c->pos = 0;
+  c->len = 0;
+  c->buf[0] = '\0';
+}
+
+static int cursor_next(const filesdb_t *files, cursor_t *c)
+{
+  const uint64_t coded_len = files->header->coded_len;
+  uint64_t shared, rest;
+
+  if(!get_varint(files->coded, coded_len, &c->pos, &shared) ||
+      !get_varint(files->coded, coded_len, &c->pos, &rest) ||
+      shared > c->len || rest > coded_len - c->pos ||
+      rest >= sizeof(c->buf) - shared) {
+    return -EINVAL;
+  }
+
+  memcpy(c->buf + shared, files->coded + c->pos, rest);
+  c->pos += rest;
+  c->len = shared + rest;
+  c->buf[c->len] = '\0';
+  c->next++;
+
+  return 0;
+}
+
+/* leaves path id in the cursor's buffer. Walks on from where the cursor is
+ * if that's closer than the start of the path's block. */
+static int cursor_seek(const filesdb_t *files, cursor_t *c, uint64_t id)
+{
+  int r;
+
+  if(id >= files->header->npaths) {
+    return -EINVAL;
+  }
+
+  if(c->next == NO_PATH || c->next > id + 1 ||
+      id + 1 - c->next >= FILESDB_BLOCK) {
+    c->next = id - id % FILESDB_BLOCK;
+    c->pos = files->blocks[id / FILESDB_BLOCK];
+    c->len = 0;
+  }
+
+  while(c->next <= id) {
+    r = cursor_next(files, c);
+    if(r < 0) {
+      return r;
+    }
+  }
+
+  return 0;
+}
+
+/* checks that the tables sized by the number of packages or blocks stay
+ * inside the file. The rest is checked as it's read. */
+static int filesdb_attach(filesdb_t *files)
+{
+  const filesdb_header_t *h = files->base;
+  const char *base = files->base;
+  uint64_t nblocks;
+
+  if(files->len < sizeof(*h) ||
+      memcmp(h->magic, FILESDB_MAGIC, sizeof(h->magic)) != 0 ||
+      h->bom != FILESDB_BOM) {
+    return -EINVAL;
+  }
+
+  nblocks = h->npaths / FILESDB_BLOCK + (h->npaths % FILESDB_BLOCK != 0);
+
+  if(!region_fits(files->len, h->pkg_paths_off, (uint64_t)h->npkgs + 1,
+        sizeof(uint32_t)) ||
+      !region_fits(files->len, h->paths_off, h->nentries, sizeof(uint32_t)) ||
+      !region_fits(files->len, h->path_pkgs_off, h->npaths + 1,
+        sizeof(uint32_t)) ||
+      !region_fits(files->len, h->pkgs_off, h->nentries, sizeof(uint32_t)) ||
+      !region_fits(files->len, h->blocks_off, nblocks, sizeof(uint64_t)) ||
+      !region_fits(files->len, h->names_off, h->npkgs, sizeof(uint32_t)) ||
+      !region_fits(files->len, h->buckets_off, h->nbuckets,
+        sizeof(uint32_t)) ||
+      !region_fits(files->len, h->coded_off, h->coded_len, 1) ||
+      !region_fits(files->len, h->strings_off, h->strings_len, 1)) {
+    return -EINVAL;
+  }
+
+  if(h->strings_len == 0 || h->nbuckets <= h->npkgs ||
+      (h->nbuckets & (h->nbuckets - 1)) != 0) {
+    return -EINVAL;
+  }
+
+  files->header = h;
+  files->pkg_paths = (const uint32_t *)(base + h->pkg_paths_off);
+  files->paths = (const uint32_t *)(base + h->paths_off);
+  files->path_pkgs = (const uint32_t *)(base + h->path_pkgs_off);
+  files->pkgs = (const uint32_t *)(base + h->pkgs_off);
+  files->blocks = (const uint64_t *)(base + h->blocks_off);
+  files->names = (const uint32_t *)(base + h->names_off);
+  files->buckets = (const uint32_t *)(base + h->buckets_off);
+  files->coded = (const unsigned char *)(base + h->coded_off);
+  files->strings = base + h->strings_off;
+
+  if(files->strings[h->strings_len - 1] != '\0') {
+    return -EINVAL;
+  }
+
+  for(size_t i = 0; i < h->npkgs; ++i) {
+    if(files->names[i] >= h->strings_len ||
+        files->pkg_paths[i] > files->pkg_paths[i + 1]) {
+      return -EINVAL;
+    }
+  }
+  if(files->pkg_paths[0] != 0 || files->pkg_paths[h->npkgs] != h->nentries) {
+    return -EINVAL;
+  }
+
+  for(size_t i = 0; i < h->nbuckets; ++i) {
+    if(files->buckets[i] > h->npkgs) {
+      return -EINVAL;
+    }
+  }
+
+  for(size_t i = 0; i < nblocks; ++i) {
+    if(files->blocks[i] > h->coded_len) {
+      return -EINVAL;
+    }
+  }
+
+  return 0;
+}
+
+static bool filesdb_matches(const filesdb_t *files, const struct stat *st)
+{
+  const filesdb_header_t *h = files->header;
+
+  return h->db_dev == (uint64_t)st->st_dev &&
+    h->db_ino == (uint64_t)st->st_ino &&
+    h->db_size == (uint64_t)st->st_size &&
+    h->db_mtime_ns == stat_mtime_ns(st);
+}
+
+/* maps the index kept in cachefile, if it was built from dbfile as it is
+ * now. Returns -ESTALE if it needs building. */
+int filesdb_map(filesdb_t *files, const char *dbfile, const char *cachefile)
+{
+  struct stat st, cst;
+  int fd, r;
+
+  memset(files, 0, sizeof(*files));
+
+  if(stat(dbfile, &st) < 0) {
+    return -errno;
+  }
+
+  if(cachefile == NULL) {
+    return -ESTALE;
+  }
+
+  fd = open(cachefile, O_RDONLY | O_CLOEXEC);
+  if(fd < 0) {
+    return -ESTALE;
+  }
+
+  if(fstat(fd, &cst) < 0 || cst.st_size < (off_t)sizeof(filesdb_header_t)) {
+    close(fd);
+    return -ESTALE;
+  }
+
+  files->base = mmap(NULL, cst.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(files->base == MAP_FAILED) {
+    files->base = NULL;
+    return -ESTALE;
+  }
+
+  files->len = cst.st_size;
+  files->mapped = true;
+
+  r = filesdb_attach(files);
+  if(r < 0 || !filesdb_matches(files, &st)) {
+    filesdb_reset(files);
+    return -ESTALE;
+  }
+
+  return 0;
+}
+
+static int pending_cmp(const void *a, const void *b)
+{
+  const pending_entry_t *x = a, *y = b;
+  int r = strcmp(x->path, y->path);
+
+  if(r != 0) {
+    return r;
+  }
+
+  return (x->pkg > y->pkg) - (x->pkg < y->pkg);
+}
+
+static size_t shared_len(const char *a, const char *b)
+{
+  size_t n = 0;
+
+  while(a[n] && a[n] == b[n]) {
+    ++n;
+  }
+
+  return n;
+}
+
+/* the sorted paths, front coded, with the start of each block and the
+ * packages owning each path */
+static int code_paths(const pending_entry_t *pending, size_t nentries,
+    outbuf_t *coded, uint64_t **blocks, uint32_t *path_pkgs, uint32_t *pkgs,
+    uint32_t *ids, size_t *npaths)
+{
+  const char *prev = "";
+  size_t n = 0, nblocks = 0;
+
+  *blocks = malloc((nentries / FILESDB_BLOCK + 1) * sizeof(uint64_t));
+  if(*blocks == NULL) {
+    return -ENOMEM;
+  }
+
+  for(size_t i = 0; i < nentries; ++i) {
+    const char *path = pending[i].path;
+    size_t len = strlen(path), shared;
+
+    pkgs[i] = pending[i].pkg;
+
+    if(i > 0 && strcmp(path, prev) == 0) {
+      ids[i] = n - 1;
+      continue;
+    }
+
+    if(len >= FILESDB_PATH_MAX) {
+      return -ENAMETOOLONG;
+    }
+
+    if(n % FILESDB_BLOCK == 0) {
+      (*blocks)[nblocks++] = coded->len;
+      shared = 0;
+    } else {
+      shared = shared_len(prev, path);
+    }
+
+    binary_put_uint(coded, shared);
+    binary_put_uint(coded, len - shared);
+    outbuf_write(coded, path + shared, len - shared);
+
+    path_pkgs[n] = i;
+    ids[i] = n++;
+    prev = path;
+  }
+  path_pkgs[n] = nentries;
+
+  *npaths = n;
+
+  return coded->error;
+}
+
+/* the paths of each package, in the order of their ids, which is the order
+ * of the paths themselves */
+static void group_by_pkg(const pending_entry_t *pending, size_t nentries,
+    const uint32_t *ids, size_t npkgs, uint32_t *pkg_paths, uint32_t *paths)
+{
+  for(size_t i = 0; i <= npkgs; ++i) {
+    pkg_paths[i] = 0;
+  }
+
+  for(size_t i = 0; i < nentries; ++i) {
+    pkg_paths[pending[i].pkg + 1]++;
+  }
+  for(size_t i = 0; i < npkgs; ++i) {
+    pkg_paths[i + 1] += pkg_paths[i];
+  }
+
+  /* fill each package's range, using its start as where to write next */
+  for(size_t i = 0; i < nentries; ++i) {
+    paths[pkg_paths[pending[i].pkg]++] = ids[i];
+  }
+  for(size_t i = npkgs; i > 0; --i) {
+    pkg_paths[i] = pkg_paths[i - 1];
+  }
+  pkg_paths[0] = 0;
+}
+
+typedef struct layout_t {
+  uint32_t *pkg_paths;
+  uint32_t *paths;
+  uint32_t *path_pkgs;
+  uint32_t *pkgs;
+  uint64_t *blocks;
+  uint32_t *names;
+  outbuf_t coded;
+  outbuf_t strings;
+  size_t npkgs;
+  size_t npaths;
+  size_t nentries;
+} layout_t;
+
+static void layout_reset(layout_t *l)
+{
+  free(l->pkg_paths);
+  free(l->paths);
+  free(l->path_pkgs);
+  free(l->pkgs);
+  free(l->blocks);
+  free(l->names);
+  outbuf_reset(&l->coded);
+  outbuf_reset(&l->strings);
+}
+
+static int filesdb_layout(filesdb_t *files, const layout_t *l,
+    const struct stat *st)
+{
+  const size_t nblocks = l->npaths / FILESDB_BLOCK +
+    (l->npaths % FILESDB_BLOCK != 0);
+  filesdb_header_t *h;
+  uint32_t *buckets;
+  size_t nbuckets = 16, len;
+  char *base;
+
+  while(nbuckets < l->npkgs * 2) {
+    nbuckets *= 2;
+  }
+
+  len = align8(sizeof(*h));
+  len += align8((l->npkgs + 1) * sizeof(uint32_t));
+  len += align8(l->nentries * sizeof(uint32_t));
+  len += align8((l->npaths + 1) * sizeof(uint32_t));
+  len += align8(l->nentries * sizeof(uint32_t));
+  len += align8(nblocks * sizeof(uint64_t));
+  len += align8(l->npkgs * sizeof(uint32_t));
+  len += align8(nbuckets * sizeof(uint32_t));
+  len += align8(l->coded.len);
+  len += l->strings.len;
+
+  files->base = calloc(1, len);
+  if(files->base == NULL) {
+    return -ENOMEM;
+  }
+  files->len = len;
+  files->mapped = false;
+  base = files->base;
+
+  h = files->base;
+  memcpy(h->magic, FILESDB_MAGIC, sizeof(h->magic));
+  h->bom = FILESDB_BOM;
+  h->npkgs = l->npkgs;
+  h->npaths = l->npaths;
+  h->nentries = l->nentries;
+  h->db_dev = st->st_dev;
+  h->db_ino = st->st_ino;
+  h->db_size = st->st_size;
+  h->db_mtime_ns = stat_mtime_ns(st);
+
+  h->pkg_paths_off = align8(sizeof(*h));
+  h->paths_off = h->pkg_paths_off + align8((l->npkgs + 1) * sizeof(uint32_t));
+  h->path_pkgs_off = h->paths_off + align8(l->nentries * sizeof(uint32_t));
+  h->pkgs_off = h->path_pkgs_off + align8((l->npaths + 1) * sizeof(uint32_t));
+  h->blocks_off = h->pkgs_off + align8(l->nentries * sizeof(uint32_t));
+  h->names_off = h->blocks_off + align8(nblocks * sizeof(uint64_t));
+  h->buckets_off = h->names_off + align8(l->npkgs * sizeof(uint32_t));
+  h->nbuckets = nbuckets;
+  h->coded_off = h->buckets_off + align8(nbuckets * sizeof(uint32_t));
+  h->coded_len = l->coded.len;
+  h->strings_off = h->coded_off + align8(l->coded.len);
+  h->strings_len = l->strings.len;
+
+  memcpy(base + h->pkg_paths_off, l->pkg_paths,
+      (l->npkgs + 1) * sizeof(uint32_t));
+  memcpy(base + h->paths_off, l->paths, l->nentries * sizeof(uint32_t));
+  memcpy(base + h->path_pkgs_off, l->path_pkgs,
+      (l->npaths + 1) * sizeof(uint32_t));
+  memcpy(base + h->pkgs_off, l->pkgs, l->nentries * sizeof(uint32_t));
+  memcpy(base + h->blocks_off, l->blocks, nblocks * sizeof(uint64_t));
+  memcpy(base + h->names_off, l->names, l->npkgs * sizeof(uint32_t));
+  memcpy(base + h->coded_off, l->coded.buf, l->coded.len);
+  memcpy(base + h->strings_off, l->strings.buf, l->strings.len);
+
+  buckets = (uint32_t *)(base + h->buckets_off);
+  for(size_t i = 0; i < l->npkgs; ++i) {
+    const char *name = l->strings.buf + l->names[i];
+    size_t k = hashmap_hash(name, strlen(name)) & (nbuckets - 1);
+
+    while(buckets[k] != 0) {
+      k = (k + 1) & (nbuckets - 1);
+    }
+    buckets[k] = i + 1;
+  }
+
+  return filesdb_attach(files);
+}
+
+static int filesdb_index(filesdb_t *files, alpm_list_t *pkgs,
+    const struct stat *st)
+{
+  _cleanup_(layout_reset) layout_t l;
+  _cleanup_free_ pending_entry_t *pending = NULL;
+  _cleanup_free_ uint32_t *ids = NULL;
+  size_t nentries = 0, n = 0;
+  int r;
+
+  memset(&l, 0, sizeof(l));
+
+  for(alpm_list_t *i = pkgs; i; i = i->next) {
+    nentries += alpm_pkg_get_files(i->data)->count;
+    ++n;
+  }
+  if(n >= UINT32_MAX || nentries >= UINT32_MAX) {
+    return -EFBIG;
+  }
+
+  pending = malloc((nentries + 1) * sizeof(pending_entry_t));
+  ids = malloc((nentries + 1) * sizeof(uint32_t));
+  l.pkg_paths = malloc((n + 1) * sizeof(uint32_t));
+  l.paths = malloc((nentries + 1) * sizeof(uint32_t));
+  l.path_pkgs = malloc((nentries + 1) * sizeof(uint32_t));
+  l.pkgs = malloc((nentries + 1) * sizeof(uint32_t));
+  l.names = malloc((n + 1) * sizeof(uint32_t));
+  if(pending == NULL || ids == NULL || l.pkg_paths == NULL ||
+      l.paths == NULL || l.path_pkgs == NULL || l.pkgs == NULL ||
+      l.names == NULL) {
+    return -ENOMEM;
+  }
+
+  r = outbuf_init(&l.coded, -1, 0);
+  if(r == 0) {
+    r = outbuf_init(&l.strings, -1, 0);
+  }
+  if(r < 0) {
+    return r;
+  }
+
+  n = 0;
+  for(alpm_list_t *i = pkgs; i; i = i->next, ++n) {
+    alpm_filelist_t *filelist = alpm_pkg_get_files(i->data);
+    const char *name = alpm_pkg_get_name(i->data);
+
+    for(size_t f = 0; f < filelist->count; ++f) {
+      pending[l.nentries++] = (pending_entry_t){ filelist->files[f].name, n };
+    }
+
+    l.names[n] = l.strings.len;
+    outbuf_write(&l.strings, name, strlen(name) + 1);
+  }
+  l.npkgs = n;
+
+  if(l.strings.len == 0) {
+    outbuf_putc(&l.strings, '\0');
+  }
+  if(l.strings.error < 0) {
+    return l.strings.error;
+  }
+
+  qsort(pending, l.nentries, sizeof(pending_entry_t), pending_cmp);
+
+  r = code_paths(pending, l.nentries, &l.coded, &l.blocks, l.path_pkgs,
+      l.pkgs, ids, &l.npaths);
+  if(r < 0) {
+    return r;
+  }
+
+  group_by_pkg(pending, l.nentries, ids, l.npkgs, l.pkg_paths, l.paths);
+
+  return filesdb_layout(files, &l, st);
+}
+
+/* indexes the file lists of db, which must be a sync DB registered with
+ * the .files extension, read from dbfile. The index is saved to cachefile,
+ * if given. An index that can't be saved is still usable. */
+int filesdb_build(filesdb_t *files, alpm_db_t *db, const char *dbfile,
+    const char *cachefile)
+{
+  struct stat st;
+  int r;
+
+  memset(files, 0, sizeof(*files));
+
+  if(stat(dbfile, &st) < 0) {
+    return -errno;
+  }
+
+  r = filesdb_index(files, alpm_db_get_pkgcache(db), &st);
+  if(r < 0) {
+    filesdb_reset(files);
+    return r;
+  }
+
+  if(cachefile) {
+    write_file_atomic(cachefile, files->base, files->len);
+  }
+
+  return 0;
+}
+
+void filesdb_reset(filesdb_t *files)
+{
+  if(files == NULL) {
+    return;
+  }
+
+  if(files->mapped) {
+    munmap(files->base, files->len);
+  } else {
+    free(files->base);
+  }
+
+  memset(files, 0, sizeof(*files));
+}
+
+ssize_t filesdb_find(const filesdb_t *files, const char *name)
+{
+  const size_t mask = files->header->nbuckets - 1;
+  size_t k = hashmap_hash(name, strlen(name)) & mask;
+
+  for(size_t probes = 0; probes <= mask; ++probes, k = (k + 1) & mask) {
+    uint32_t b = files->buckets[k];
+
+    if(b == 0) {
+      break;
+    }
+
+    if(strcmp(files->strings + files->names[b - 1], name) == 0) {
+      return b - 1;
+    }
+  }
+
+  return -1;
+}
+
+const char *filesdb_pkgname(const filesdb_t *files, uint32_t pkg)
+{
+  return files->strings + files->names[pkg];
+}
+
+/* fills out with the files of pkg. The names are kept in the same
+ * allocation as out->files, so that freeing it frees everything. */
+int filesdb_files(const filesdb_t *files, size_t pkg, alpm_filelist_t *out)
+{
+  const uint32_t first = files->pkg_paths[pkg];
+  const size_t count = files->pkg_paths[pkg + 1] - first;
+  const size_t head = (count + 1) * sizeof(alpm_file_t);
+  size_t len = head, capacity = head + count * 32;
+  char *block;
+  cursor_t c;
+  int r;
+
+  memset(out, 0, sizeof(*out));
+  cursor_init(&c);
+
+  block = malloc(capacity);
+  if(block == NULL) {
+    return -ENOMEM;
+  }
+
+  /* names go in as offsets into the block, which may yet move */
+  for(size_t i = 0; i < count; ++i) {
+    r = cursor_seek(files, &c, files->paths[first + i]);
+    if(r < 0) {
+      free(block);
+      return r;
+    }
+
+    if(len + c.len + 1 > capacity) {
+      char *ptr;
+
+      while(len + c.len + 1 > capacity) {
+        capacity *= 2;
+      }
+      ptr = realloc(block, capacity);
+      if(ptr == NULL) {
+        free(block);
+        return -ENOMEM;
+      }
+      block = ptr;
+    }
+
+    ((alpm_file_t *)block)[i] = (alpm_file_t){ .name = (char *)(uintptr_t)len };
+    memcpy(block + len, c.buf, c.len + 1);
+    len += c.len + 1;
+  }
+
+  out->files = (alpm_file_t *)block;
+  out->count = count;
+  for(size_t i = 0; i < count; ++i) {
+    out->files[i].name = block + (uintptr_t)out->files[i].name;
+  }
+
+  return 0;
+}
+
+/* the id of path, or -1 if no package has it */
+static ssize_t find_path(const filesdb_t *files, cursor_t *c,
+    const char *path)
+{
+  const uint64_t npaths = files->header->npaths;
+  uint64_t lo = 0, hi = npaths / FILESDB_BLOCK + (npaths % FILESDB_BLOCK != 0);
+
+  /* the last block starting at or before path */
+  while(lo < hi) {
+    uint64_t mid = lo + (hi - lo) / 2;
+
+    if(cursor_seek(files, c, mid * FILESDB_BLOCK) < 0) {
+      return -1;
+    }
+    if(strcmp(c->buf, path) <= 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if(lo == 0) {
+    return -1;
+  }
+
+  for(uint64_t id = (lo - 1) * FILESDB_BLOCK;
+      id < lo * FILESDB_BLOCK && id < npaths; ++id) {
+    int cmp;
+
+    if(cursor_seek(files, c, id) < 0) {
+      return -1;
+    }
+
+    cmp = strcmp(c->buf, path);
+    if(cmp == 0) {
+      return id;
+    }
+    if(cmp > 0) {
+      break;
+    }
+  }
+
+  return -1;
+}
+
+static int add_owners(const filesdb_t *files, uint64_t id, uint32_t **pkgs,
+    size_t *count, size_t *capacity)
+{
+  const uint32_t from = files->path_pkgs[id], to = files->path_pkgs[id + 1];
+
+  if(from > to || to > files->header->nentries) {
+    return -EINVAL;
+  }
+
+  if(*count + (to - from) > *capacity) {
+    size_t newcap = *capacity ? *capacity : 16;
+    uint32_t *ptr;
+
+    while(newcap < *count + (to - from)) {
+      newcap *= 2;
+    }
+    ptr = realloc(*pkgs, newcap * sizeof(uint32_t));
+    if(ptr == NULL) {
+      return -ENOMEM;
+    }
+    *pkgs = ptr;
+    *capacity = newcap;
+  }
+
+  for(uint32_t k = from; k < to; ++k) {
+    if(files->pkgs[k] >= files->header->npkgs) {
+      return -EINVAL;
+    }
+    (*pkgs)[(*count)++] = files->pkgs[k];
+  }
+
+  return 0;
+}
+
+static int pkg_cmp(const void *a, const void *b)
+{
+  const uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+  return (x > y) - (x < y);
+}
+
+/* the packages owning target, as pacman -F finds them: a target with a
+ * slash is a path, looked up as is, and anything else is the name of a
+ * file in any directory. Returns how many there are, each once, pointing
+ * pkgs at them. The caller frees *pkgs. */
+ssize_t filesdb_owners(const filesdb_t *files, const char *target,
+    uint32_t **pkgs)
+{
+  size_t count = 0, capacity = 0, kept = 0;
+  cursor_t c;
+  int r = 0;
+
+  *pkgs = NULL;
+  cursor_init(&c);
+
+  if(strchr(target, '/') != NULL) {
+    ssize_t id;
+
+    /* file lists don't have the leading slash */
+    while(*target == '/') {
+      ++target;
+    }
+
+    id = find_path(files, &c, target);
+    if(id < 0) {
+      return 0;
+    }
+
+    r = add_owners(files, id, pkgs, &count, &capacity);
+  } else {
+    for(uint64_t id = 0; id < files->header->npaths; ++id) {
+      const char *base;
+
+      r = cursor_seek(files, &c, id);
+      if(r < 0) {
+        break;
+      }
+
+      base = strrchr(c.buf, '/');
+      if(strcmp(base ? base + 1 : c.buf, target) != 0) {
+        continue;
+      }
+
+      r = add_owners(files, id, pkgs, &count, &capacity);
+      if(r < 0) {
+        break;
+      }
+    }
+  }
+
+  if(r < 0) {
+    free(*pkgs);
+    *pkgs = NULL;
+    return r;
+  }
+
+  /* a package may have the name in several directories */
+  if(count > 1) {
+    qsort(*pkgs, count, sizeof(uint32_t), pkg_cmp);
+  }
+  for(size_t i = 0; i < count; ++i) {
+    if(kept == 0 || (*pkgs)[kept - 1] != (*pkgs)[i]) {
+      (*pkgs)[kept++] = (*pkgs)[i];
+    }
+  }
+
+  return kept;
+}
+
+/* vim: set et ts=2 sw=2: */
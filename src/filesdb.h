@@ -0,0 +1,47 @@
+#ifndef _FILESDB_H
+#define _FILESDB_H
+
+#include <alpm.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+typedef struct filesdb_header_t filesdb_header_t;
+
+/* the file lists of a .files sync DB, mapped from a file which is rebuilt
+ * whenever the DB changes. Each path is stored once, sorted and front coded
+ * in blocks, along with the packages owning it and, for each package, the
+ * paths it owns. */
+typedef struct filesdb_t {
+  void *base;
+  size_t len;
+  bool mapped;
+
+  const filesdb_header_t *header;
+  const uint32_t *pkg_paths;
+  const uint32_t *paths;
+  const uint32_t *path_pkgs;
+  const uint32_t *pkgs;
+  const uint64_t *blocks;
+  const uint32_t *names;
+  const uint32_t *buckets;
+  const unsigned char *coded;
+  const char *strings;
+} filesdb_t;
+
+int filesdb_map(filesdb_t *files, const char *dbfile, const char *cachefile);
+int filesdb_build(filesdb_t *files, alpm_db_t *db, const char *dbfile,
+    const char *cachefile);
+void filesdb_reset(filesdb_t *files);
+
+ssize_t filesdb_find(const filesdb_t *files, const char *name);
+const char *filesdb_pkgname(const filesdb_t *files, uint32_t pkg);
+
+int filesdb_files(const filesdb_t *files, size_t pkg, alpm_filelist_t *out);
+ssize_t filesdb_owners(const filesdb_t *files, const char *target,
+    uint32_t **pkgs);
+
+#endif  /* _FILESDB_H */
+
+/* vim: set et ts=2 sw=2: */
@@ -0,0 +1,652 @@
+#include <errno.h>
+#include <regex.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "filter.h"
+#include "util.h"
+
+typedef enum filter_op_t {
+  FILTER_OP_AND,
+  FILTER_OP_OR,
+  FILTER_OP_NOT,
+  FILTER_OP_TRUTHY,
+  FILTER_OP_EQ,
+  FILTER_OP_NE,
+  FILTER_OP_LT,
+  FILTER_OP_LE,
+  FILTER_OP_GT,
+  FILTER_OP_GE,
+  FILTER_OP_MATCH,
+  FILTER_OP_NOMATCH,
+} filter_op_t;
+
+struct filter_node_t {
+  filter_op_t op;
+
+  /* for AND, OR and NOT */
+  filter_node_t *left;
+  filter_node_t *right;
+
+  /* for everything else, the field and what it's compared to, as parsed
+   * according to the field's type */
+  const field_t *field;
+  char *str;
+  int64_t num;
+  regex_t regex;
+  bool has_regex;
+};
+
+typedef struct parser_t {
+  const char *expr;
+  const char *p;
+  filter_t *filter;
+  filter_error_t *error;
+} parser_t;
+
+/* an operand as written, before it's interpreted for a field */
+typedef struct operand_t {
+  char *text;
+  bool regex;
+  bool icase;
+  const char *pos;
+} operand_t;
+
+static const struct {
+  const char *text;
+  filter_op_t op;
+} comparisons[] = {
+  /* longest first, so that '<=' isn't taken for '<' */
+  { "==", FILTER_OP_EQ },
+  { "!=", FILTER_OP_NE },
+  { "<=", FILTER_OP_LE },
+  { ">=", FILTER_OP_GE },
+  { "!~", FILTER_OP_NOMATCH },
+  { "=",  FILTER_OP_EQ },
+  { "<",  FILTER_OP_LT },
+  { ">",  FILTER_OP_GT },
+  { "~",  FILTER_OP_MATCH },
+};
+
+static filter_node_t *parse_or(parser_t *parser);
+
+static void node_free(filter_node_t *node)
+{
+  if(node == NULL) {
+    return;
+  }
+
+  node_free(node->left);
+  node_free(node->right);
+  if(node->has_regex) {
+    regfree(&node->regex);
+  }
+  free(node->str);
+  free(node);
+}
+
+static filter_node_t *parse_fail(parser_t *parser, const char *pos,
+    const char *message)
+{
+  /* only the first problem is worth reporting */
+  if(parser->error->message == NULL) {
+    parser->error->message = message;
+    parser->error->pos = pos - parser->expr;
+  }
+
+  return NULL;
+}
+
+static void skip_space(parser_t *parser)
+{
+  while(*parser->p == ' ' || *parser->p == '\t' || *parser->p == '\n') {
+    parser->p++;
+  }
+}
+
+static bool accept(parser_t *parser, const char *token)
+{
+  const size_t len = strlen(token);
+
+  skip_space(parser);
+  if(strncmp(parser->p, token, len) == 0) {
+    parser->p += len;
+    return true;
+  }
+
+  return false;
+}
+
+static filter_node_t *node_new(filter_op_t op, filter_node_t *left,
+    filter_node_t *right)
+{
+  filter_node_t *node = calloc(1, sizeof(*node));
+
+  if(node == NULL) {
+    node_free(left);
+    node_free(right);
+    return NULL;
+  }
+
+  node->op = op;
+  node->left = left;
+  node->right = right;
+
+  return node;
+}
+
+/* a quoted string, a /regex/, or a bare word running up to whitespace or
+ * anything that would end the comparison */
+static int parse_operand(parser_t *parser, operand_t *operand)
+{
+  const char *p;
+  char quote = '\0', *out;
+
+  skip_space(parser);
+  p = parser->p;
+
+  memset(operand, 0, sizeof(*operand));
+  operand->pos = p;
+
+  operand->text = out = malloc(strlen(p) + 1);
+  if(out == NULL) {
+    return -ENOMEM;
+  }
+
+  if(*p == '"' || *p == '\'' || *p == '/') {
+    quote = *p++;
+    operand->regex = quote == '/';
+
+    while(*p != quote) {
+      if(*p == '\0') {
+        parse_fail(parser, operand->pos, "unterminated string");
+        return -EINVAL;
+      }
+
+      if(*p == '\\' && (p[1] == quote || (quote != '/' && p[1] == '\\'))) {
+        ++p;
+      }
+      *out++ = *p++;
+    }
+    ++p;
+
+    if(operand->regex && *p == 'i') {
+      operand->icase = true;
+      ++p;
+    }
+  } else {
+    while(*p && strchr(" \t\n()&|", *p) == NULL) {
+      *out++ = *p++;
+    }
+
+    if(p == operand->pos) {
+      parse_fail(parser, p, "expected a value");
+      return -EINVAL;
+    }
+  }
+
+  *out = '\0';
+  parser->p = p;
+
+  return 0;
+}
+
+/* a number of bytes, with an optional binary suffix as --humansize uses */
+static int parse_size(const char *str, int64_t *size)
+{
+  static const char units[] = "BKMGTPE";
+  const char *unit;
+  char *end;
+  double n;
+
+  errno = 0;
+  n = strtod(str, &end);
+  if(errno != 0 || end == str || n < 0) {
+    return -EINVAL;
+  }
+
+  if(*end != '\0') {
+    unit = strchr(units, *end);
+    if(unit == NULL) {
+      return -EINVAL;
+    }
+
+    for(ptrdiff_t i = 0; i < unit - units; ++i) {
+      n *= 1024;
+    }
+
+    ++end;
+    if(strcmp(end, "iB") == 0 || (*unit == 'B' && *end == '\0')) {
+      end += strlen(end);
+    }
+  }
+
+  if(*end != '\0' || n > (double)INT64_MAX) {
+    return -EINVAL;
+  }
+
+  *size = (int64_t)n;
+
+  return 0;
+}
+
+/* seconds since the epoch, or a date and time in local time */
+static int parse_time(const char *str, int64_t *timestamp)
+{
+  static const char *formats[] = {
+    "%Y-%m-%d %H:%M:%S",
+    "%Y-%m-%dT%H:%M:%S",
+    "%Y-%m-%d %H:%M",
+    "%Y-%m-%dT%H:%M",
+    "%Y-%m-%d",
+  };
+  char *end;
+
+  errno = 0;
+  *timestamp = strtoll(str, &end, 10);
+  if(errno == 0 && end != str && *end == '\0') {
+    return 0;
+  }
+
+  for(size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); ++i) {
+    struct tm tm;
+
+    memset(&tm, 0, sizeof(tm));
+    end = strptime(str, formats[i], &tm);
+    if(end != NULL && *end == '\0') {
+      tm.tm_isdst = -1;
+      *timestamp = mktime(&tm);
+      return 0;
+    }
+  }
+
+  return -EINVAL;
+}
+
+/* makes sense of what a field is compared to */
+static int compile_operand(parser_t *parser, filter_node_t *node,
+    operand_t *operand)
+{
+  const bool matching = node->op == FILTER_OP_MATCH ||
+    node->op == FILTER_OP_NOMATCH;
+  const bool ordering = node->op != FILTER_OP_EQ && node->op != FILTER_OP_NE &&
+    !matching;
+
+  if(operand->regex && !matching) {
+    parse_fail(parser, operand->pos, "a regex can only be used with ~ or !~");
+    return -EINVAL;
+  }
+
+  if(matching) {
+    int flags = REG_EXTENDED | REG_NOSUB | (operand->icase ? REG_ICASE : 0);
+
+    if(node->field->type == FIELD_SIZE || node->field->type == FIELD_TIME) {
+      parse_fail(parser, operand->pos, "this field can't be matched against a regex");
+      return -EINVAL;
+    }
+
+    if(regcomp(&node->regex, operand->text, flags) != 0) {
+      parse_fail(parser, operand->pos, "invalid regex");
+      return -EINVAL;
+    }
+    node->has_regex = true;
+
+    return 0;
+  }
+
+  switch (node->field->type) {
+    case FIELD_SIZE:
+      if(parse_size(operand->text, &node->num) < 0) {
+        parse_fail(parser, operand->pos, "invalid size");
+        return -EINVAL;
+      }
+      break;
+    case FIELD_TIME:
+      if(parse_time(operand->text, &node->num) < 0) {
+        parse_fail(parser, operand->pos, "invalid date");
+        return -EINVAL;
+      }
+      break;
+    case FIELD_LIST:
+      /* lists are compared by their length, or checked for an item */
+      if(ordering) {
+        char *end;
+
+        errno = 0;
+        node->num = strtoll(operand->text, &end, 10);
+        if(errno != 0 || end == operand->text || *end != '\0') {
+          parse_fail(parser, operand->pos, "lists can only be ordered by their length");
+          return -EINVAL;
+        }
+        break;
+      }
+      /* fall through */
+    case FIELD_STR:
+    case FIELD_VERSION:
+      node->str = operand->text;
+      operand->text = NULL;
+      break;
+  }
+
+  return 0;
+}
+
+static filter_node_t *parse_comparison(parser_t *parser)
+{
+  _cleanup_free_ char *text = NULL;
+  filter_node_t *node;
+  const field_t *field;
+  const char *start;
+  operand_t operand;
+
+  skip_space(parser);
+  start = parser->p;
+  while((*parser->p >= 'a' && *parser->p <= 'z') || *parser->p == '_') {
+    parser->p++;
+  }
+
+  if(parser->p == start) {
+    return parse_fail(parser, start, "expected a field name");
+  }
+
+  field = field_lookup(start, parser->p - start);
+  if(field == NULL) {
+    return parse_fail(parser, start, "unknown field");
+  }
+
+  parser->filter->uses[(unsigned char)field->token] = true;
+  parser->filter->deferred |= field->deferred;
+
+  node = node_new(FILTER_OP_TRUTHY, NULL, NULL);
+  if(node == NULL) {
+    return parse_fail(parser, start, "out of memory");
+  }
+  node->field = field;
+
+  skip_space(parser);
+  for(size_t i = 0; i < sizeof(comparisons) / sizeof(comparisons[0]); ++i) {
+    if(accept(parser, comparisons[i].text)) {
+      node->op = comparisons[i].op;
+      break;
+    }
+  }
+
+  /* a field on its own asks whether it's set at all */
+  if(node->op == FILTER_OP_TRUTHY) {
+    return node;
+  }
+
+  if(parse_operand(parser, &operand) < 0 ||
+      compile_operand(parser, node, &operand) < 0) {
+    free(operand.text);
+    node_free(node);
+    return parse_fail(parser, start, "out of memory");
+  }
+  free(operand.text);
+
+  return node;
+}
+
+static filter_node_t *parse_unary(parser_t *parser)
+{
+  filter_node_t *node;
+
+  skip_space(parser);
+
+  /* not to be confused with '!=', which needs a field before it */
+  if(*parser->p == '!' && parser->p[1] != '=' && parser->p[1] != '~') {
+    parser->p++;
+    node = parse_unary(parser);
+    return node ? node_new(FILTER_OP_NOT, node, NULL) : NULL;
+  }
+
+  if(accept(parser, "(")) {
+    const char *open = parser->p - 1;
+
+    node = parse_or(parser);
+    if(node && !accept(parser, ")")) {
+      node_free(node);
+      return parse_fail(parser, open, "unbalanced parenthesis");
+    }
+    return node;
+  }
+
+  return parse_comparison(parser);
+}
+
+static filter_node_t *parse_and(parser_t *parser)
+{
+  filter_node_t *left = parse_unary(parser);
+
+  while(left && accept(parser, "&&")) {
+    filter_node_t *right = parse_unary(parser);
+    if(right == NULL) {
+      node_free(left);
+      return NULL;
+    }
+    left = node_new(FILTER_OP_AND, left, right);
+  }
+
+  return left;
+}
+
+static filter_node_t *parse_or(parser_t *parser)
+{
+  filter_node_t *left = parse_and(parser);
+
+  while(left && accept(parser, "||")) {
+    filter_node_t *right = parse_and(parser);
+    if(right == NULL) {
+      node_free(left);
+      return NULL;
+    }
+    left = node_new(FILTER_OP_OR, left, right);
+  }
+
+  return left;
+}
+
+int filter_compile(filter_t *filter, const char *expr, filter_error_t *error)
+{
+  parser_t parser = {
+    .expr = expr,
+    .p = expr,
+    .filter = filter,
+    .error = error,
+  };
+
+  memset(filter, 0, sizeof(*filter));
+  memset(error, 0, sizeof(*error));
+
+  filter->root = parse_or(&parser);
+  if(filter->root != NULL) {
+    skip_space(&parser);
+    if(*parser.p != '\0') {
+      parse_fail(&parser, parser.p, "expected && or ||");
+    }
+  }
+
+  if(error->message != NULL || filter->root == NULL) {
+    if(error->message == NULL) {
+      parse_fail(&parser, parser.p, "out of memory");
+    }
+    filter_reset(filter);
+    return -EINVAL;
+  }
+
+  return 0;
+}
+
+void filter_reset(filter_t *filter)
+{
+  if(filter == NULL) {
+    return;
+  }
+
+  node_free(filter->root);
+  memset(filter, 0, sizeof(*filter));
+}
+
+bool filter_has_token(const filter_t *filter, char token)
+{
+  return filter->root && filter->uses[token & 0x7f];
+}
+
+static int compare(const filter_node_t *node, const char *str)
+{
+  if(str == NULL) {
+    str = "";
+  }
+
+  if(node->field->type == FIELD_VERSION) {
+    return alpm_pkg_vercmp(str, node->str);
+  }
+
+  return strcmp(str, node->str);
+}
+
+static bool ordered(filter_op_t op, int cmp)
+{
+  switch (op) {
+    case FILTER_OP_EQ:
+      return cmp == 0;
+    case FILTER_OP_NE:
+      return cmp != 0;
+    case FILTER_OP_LT:
+      return cmp < 0;
+    case FILTER_OP_LE:
+      return cmp <= 0;
+    case FILTER_OP_GT:
+      return cmp > 0;
+    case FILTER_OP_GE:
+      return cmp >= 0;
+    default:
+      return false;
+  }
+}
+
+static bool matches(const filter_node_t *node, const char *str)
+{
+  return regexec(&node->regex, str ? str : "", 0, NULL, 0) == 0;
+}
+
+static bool list_test(const filter_node_t *node, const alpm_list_t *list)
+{
+  switch (node->op) {
+    case FILTER_OP_TRUTHY:
+      return list != NULL;
+    case FILTER_OP_EQ:
+    case FILTER_OP_NE:
+      for(const alpm_list_t *i = list; i; i = i->next) {
+        if(strcmp(i->data, node->str) == 0) {
+          return node->op == FILTER_OP_EQ;
+        }
+      }
+      return node->op == FILTER_OP_NE;
+    case FILTER_OP_MATCH:
+    case FILTER_OP_NOMATCH:
+      for(const alpm_list_t *i = list; i; i = i->next) {
+        if(matches(node, i->data)) {
+          return node->op == FILTER_OP_MATCH;
+        }
+      }
+      return node->op == FILTER_OP_NOMATCH;
+    default: {
+      const int64_t count = alpm_list_count(list);
+      return ordered(node->op, (count > node->num) - (count < node->num));
+    }
+  }
+}
+
+static bool value_test(const filter_node_t *node, const field_value_t *value)
+{
+  switch (node->field->type) {
+    case FIELD_LIST:
+      return list_test(node, value->list);
+    case FIELD_SIZE:
+    case FIELD_TIME:
+      if(node->op == FILTER_OP_TRUTHY) {
+        return value->num != 0;
+      }
+      return ordered(node->op, (value->num > node->num) - (value->num < node->num));
+    case FIELD_STR:
+    case FIELD_VERSION:
+      switch (node->op) {
+        case FILTER_OP_TRUTHY:
+          return value->str != NULL && *value->str != '\0';
+        case FILTER_OP_MATCH:
+          return matches(node, value->str);
+        case FILTER_OP_NOMATCH:
+          return !matches(node, value->str);
+        default:
+          return ordered(node->op, compare(node, value->str));
+      }
+  }
+
+  return false;
+}
+
+static filter_result_t node_eval(const filter_node_t *node, alpm_pkg_t *pkg,
+    field_get_fn get, void *ctx)
+{
+  filter_result_t left, right;
+  field_value_t value;
+  bool result;
+
+  /* three valued logic, so that what is known can still decide */
+  switch (node->op) {
+    case FILTER_OP_AND:
+      left = node_eval(node->left, pkg, get, ctx);
+      if(left == FILTER_FALSE) {
+        return FILTER_FALSE;
+      }
+      right = node_eval(node->right, pkg, get, ctx);
+      if(right == FILTER_FALSE) {
+        return FILTER_FALSE;
+      }
+      return left == FILTER_TRUE && right == FILTER_TRUE ?
+        FILTER_TRUE : FILTER_UNKNOWN;
+    case FILTER_OP_OR:
+      left = node_eval(node->left, pkg, get, ctx);
+      if(left == FILTER_TRUE) {
+        return FILTER_TRUE;
+      }
+      right = node_eval(node->right, pkg, get, ctx);
+      if(right == FILTER_TRUE) {
+        return FILTER_TRUE;
+      }
+      return left == FILTER_FALSE && right == FILTER_FALSE ?
+        FILTER_FALSE : FILTER_UNKNOWN;
+    case FILTER_OP_NOT:
+      left = node_eval(node->left, pkg, get, ctx);
+      if(left == FILTER_UNKNOWN) {
+        return FILTER_UNKNOWN;
+      }
+      return left == FILTER_TRUE ? FILTER_FALSE : FILTER_TRUE;
+    default:
+      break;
+  }
+
+  memset(&value, 0, sizeof(value));
+  if(get(ctx, pkg, node->field, &value) < 0) {
+    return FILTER_UNKNOWN;
+  }
+
+  result = value_test(node, &value);
+  field_value_reset(&value);
+
+  return result ? FILTER_TRUE : FILTER_FALSE;
+}
+
+filter_result_t filter_eval(const filter_t *filter, alpm_pkg_t *pkg,
+    field_get_fn get, void *ctx)
+{
+  if(filter->root == NULL) {
+    return FILTER_TRUE;
+  }
+
+  return node_eval(filter->root, pkg, get, ctx);
+}
+
+/* vim: set et ts=2 sw=2: */
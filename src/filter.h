@@ -0,0 +1,47 @@
+#ifndef _FILTER_H
+#define _FILTER_H
+
+#include <alpm.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "field.h"
+
+/* where a field the expression depends on isn't known yet, the answer may
+ * be neither */
+typedef enum filter_result_t {
+  FILTER_FALSE,
+  FILTER_TRUE,
+  FILTER_UNKNOWN,
+} filter_result_t;
+
+typedef struct filter_node_t filter_node_t;
+
+/* an expression such as 'isize > 100M && repo ~ /core|extra/', compiled
+ * once and evaluated for each package */
+typedef struct filter_t {
+  filter_node_t *root;
+
+  /* the fields the expression refers to, by token, and whether any of them
+   * is deferred */
+  bool uses[128];
+  bool deferred;
+} filter_t;
+
+/* what filter_compile didn't like, and where in the expression */
+typedef struct filter_error_t {
+  const char *message;
+  size_t pos;
+} filter_error_t;
+
+int filter_compile(filter_t *filter, const char *expr, filter_error_t *error);
+void filter_reset(filter_t *filter);
+
+bool filter_has_token(const filter_t *filter, char token);
+
+filter_result_t filter_eval(const filter_t *filter, alpm_pkg_t *pkg,
+    field_get_fn get, void *ctx);
+
+#endif  /* _FILTER_H */
+
+/* vim: set et ts=2 sw=2: */
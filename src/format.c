@@ -0,0 +1,253 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "format.h"
+#include "util.h"
+
+static char const digits[] = "0123456789";
+static char const printf_flags[] = "'-+ #0I";
+static char const field_tokens[] = "aBbCDdEefFgGHhiJKklLmMnNOopPRrsSTuVvWwXxYy!";
+
+static char unescape(char c)
+{
+  switch (c) {
+    case 'a':
+      return '\a';
+    case 'b':
+      return '\b';
+    case 'e': /* \e is nonstandard */
+      return '\033';
+    case 'n':
+      return '\n';
+    case 'r':
+      return '\r';
+    case 't':
+      return '\t';
+    case 'v':
+      return '\v';
+    case '0':
+      return '\0';
+    default:
+      /* covers \\ and \" as well */
+      return c;
+  }
+}
+
+static int decode_escapes(const char *in, char **out, size_t *len)
+{
+  char *buf;
+  size_t n = 0;
+
+  buf = malloc(strlen(in) + 1);
+  if(buf == NULL) {
+    return -ENOMEM;
+  }
+
+  for(const char *f = in; *f != '\0'; f++) {
+    if(*f == '\\') {
+      buf[n++] = unescape(*++f);
+      if(*f == '\0') {
+        break;
+      }
+    } else {
+      buf[n++] = *f;
+    }
+  }
+  buf[n] = '\0';
+
+  *out = buf;
+  *len = n;
+
+  return 0;
+}
+
+static int format_add_op(format_t *format, const format_op_t *op)
+{
+  /* grow when needed */
+  if(format->size == format->capacity) {
+    void *ptr;
+    const size_t newcap = format->capacity ? format->capacity * 2 : 16;
+
+    ptr = realloc(format->ops, newcap * sizeof(format_op_t));
+    if(ptr == NULL) {
+      return -ENOMEM;
+    }
+
+    format->ops = ptr;
+    format->capacity = newcap;
+  }
+
+  format->ops[format->size++] = *op;
+
+  return 0;
+}
+
+static int flush_literal(format_t *format, const char *lit, size_t *len)
+{
+  format_op_t op = { .type = FORMAT_OP_LITERAL };
+  int r;
+
+  if(*len == 0) {
+    return 0;
+  }
+
+  op.literal = malloc(*len);
+  if(op.literal == NULL) {
+    return -ENOMEM;
+  }
+  memcpy(op.literal, lit, *len);
+  op.len = *len;
+
+  r = format_add_op(format, &op);
+  if(r < 0) {
+    free(op.literal);
+    return r;
+  }
+
+  *len = 0;
+
+  return 0;
+}
+
+static int add_field(format_t *format, const char *flags, size_t flagslen,
+    char token)
+{
+  format_op_t op = { .type = FORMAT_OP_FIELD, .token = token };
+  int r;
+
+  /* the result counter is the only numeric conversion. All other tokens
+   * only need a spec if the user asked for padding or flags. */
+  if(flagslen > 0 || token == '!') {
+    if(asprintf(&op.spec, "%%%.*s%c", (int)flagslen, flags,
+          token == '!' ? 'd' : 's') < 0) {
+      return -ENOMEM;
+    }
+  }
+
+  r = format_add_op(format, &op);
+  if(r < 0) {
+    free(op.spec);
+    return r;
+  }
+
+  if(token == '!') {
+    ++format->counters;
+  }
+
+  return 0;
+}
+
+static int compile_ops(format_t *format, const char *fmt)
+{
+  _cleanup_free_ char *lit = NULL;
+  size_t litlen = 0;
+  int r;
+
+  /* a literal run is never longer than the format it came from */
+  lit = malloc(strlen(fmt) + 1);
+  if(lit == NULL) {
+    return -ENOMEM;
+  }
+
+  for(const char *f = fmt; *f != '\0'; f++) {
+    if(*f == '%') {
+      size_t l = 1;
+      char token;
+
+      l += strspn(f + l, printf_flags);
+      l += strspn(f + l, digits);
+      token = f[l];
+
+      if(token == '%') {
+        lit[litlen++] = '%';
+      } else if(token == '\0' || strchr(field_tokens, token) == NULL) {
+        lit[litlen++] = '?';
+      } else {
+        r = flush_literal(format, lit, &litlen);
+        if(r < 0) {
+          return r;
+        }
+
+        r = add_field(format, f + 1, l - 1, token);
+        if(r < 0) {
+          return r;
+        }
+      }
+
+      f += l;
+      if(*f == '\0') {
+        break;
+      }
+    } else if(*f == '\\') {
+      lit[litlen++] = unescape(*++f);
+      if(*f == '\0') {
+        break;
+      }
+    } else {
+      lit[litlen++] = *f;
+    }
+  }
+
+  return flush_literal(format, lit, &litlen);
+}
+
+void format_reset(format_t *format)
+{
+  if(format == NULL) {
+    return;
+  }
+
+  for(size_t i = 0; i < format->size; ++i) {
+    free(format->ops[i].literal);
+    free(format->ops[i].spec);
+  }
+
+  free(format->ops);
+  free(format->delim);
+  free(format->listdelim);
+
+  memset(format, 0, sizeof(*format));
+}
+
+bool format_has_token(const format_t *format, char token)
+{
+  for(size_t i = 0; i < format->size; ++i) {
+    if(format->ops[i].type == FORMAT_OP_FIELD && format->ops[i].token == token) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+int format_compile(format_t *format, const char *fmt, const char *delim,
+    const char *listdelim)
+{
+  int r;
+
+  memset(format, 0, sizeof(*format));
+
+  r = compile_ops(format, fmt);
+  if(r < 0) {
+    goto fail;
+  }
+
+  r = decode_escapes(delim, &format->delim, &format->delim_len);
+  if(r < 0) {
+    goto fail;
+  }
+
+  r = decode_escapes(listdelim, &format->listdelim, &format->listdelim_len);
+  if(r < 0) {
+    goto fail;
+  }
+
+  return 0;
+
+fail:
+  format_reset(format);
+  return r;
+}
+
+/* vim: set et ts=2 sw=2: */
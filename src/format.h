@@ -0,0 +1,47 @@
+#ifndef _FORMAT_H
+#define _FORMAT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef enum format_op_type_t {
+  FORMAT_OP_LITERAL,
+  FORMAT_OP_FIELD,
+} format_op_type_t;
+
+typedef struct format_op_t {
+  format_op_type_t type;
+
+  /* FORMAT_OP_LITERAL: escape sequences already decoded, may contain NULs */
+  char *literal;
+  size_t len;
+
+  /* FORMAT_OP_FIELD: the token, and its printf conversion when flags or a
+   * width were given (NULL otherwise) */
+  char token;
+  char *spec;
+} format_op_t;
+
+typedef struct format_t {
+  format_op_t *ops;
+  size_t size;
+  size_t capacity;
+
+  /* number of %! fields, i.e. how far each package advances the counter */
+  int counters;
+
+  /* pre-escaped package and list delimiters */
+  char *delim;
+  size_t delim_len;
+  char *listdelim;
+  size_t listdelim_len;
+} format_t;
+
+int format_compile(format_t *format, const char *fmt, const char *delim,
+    const char *listdelim);
+void format_reset(format_t *format);
+bool format_has_token(const format_t *format, char token);
+
+#endif  /* _FORMAT_H */
+
+/* vim: set et ts=2 sw=2: */
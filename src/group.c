@@ -0,0 +1,320 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "group.h"
+
+static const struct {
+  const char *name;
+  aggregate_fn_t fn;
+} functions[] = {
+  { "count", AGGREGATE_COUNT },
+  { "sum",   AGGREGATE_SUM },
+  { "min",   AGGREGATE_MIN },
+  { "max",   AGGREGATE_MAX },
+};
+
+static int compile_fail(grouping_error_t *error, const char *message,
+    const char *where, size_t len)
+{
+  error->message = message;
+  error->where = where;
+  error->len = len;
+
+  return -EINVAL;
+}
+
+/* one of count, or fn(field) for the others */
+static int compile_aggregate(aggregate_t *aggregate, const char *spec,
+    size_t len, grouping_error_t *error)
+{
+  const char *open = memchr(spec, '(', len);
+  const size_t namelen = open ? (size_t)(open - spec) : len;
+  size_t i;
+
+  for(i = 0; i < sizeof(functions) / sizeof(functions[0]); ++i) {
+    if(strlen(functions[i].name) == namelen &&
+        memcmp(functions[i].name, spec, namelen) == 0) {
+      break;
+    }
+  }
+  if(i == sizeof(functions) / sizeof(functions[0])) {
+    return compile_fail(error, "unknown aggregate", spec, len);
+  }
+
+  aggregate->fn = functions[i].fn;
+  aggregate->field = NULL;
+
+  if(aggregate->fn == AGGREGATE_COUNT) {
+    return open ? compile_fail(error, "count takes no field", spec, len) : 0;
+  }
+
+  if(open == NULL || spec[len - 1] != ')') {
+    return compile_fail(error, "expected a field in parentheses", spec, len);
+  }
+
+  aggregate->field = field_lookup(open + 1, spec + len - 1 - (open + 1));
+  if(aggregate->field == NULL) {
+    return compile_fail(error, "unknown field", spec, len);
+  }
+
+  switch (aggregate->field->type) {
+    case FIELD_SIZE:
+    case FIELD_LIST:
+      return 0;
+    case FIELD_TIME:
+      if(aggregate->fn != AGGREGATE_SUM) {
+        return 0;
+      }
+      /* fall through */
+    default:
+      return compile_fail(error, "field can't be aggregated this way", spec, len);
+  }
+}
+
+int grouping_compile(grouping_t *grouping, const char *key,
+    const char *aggregates, grouping_error_t *error)
+{
+  int r;
+
+  memset(grouping, 0, sizeof(*grouping));
+  memset(error, 0, sizeof(*error));
+
+  grouping->key = field_lookup(key, strlen(key));
+  if(grouping->key == NULL) {
+    return compile_fail(error, "unknown field", key, strlen(key));
+  }
+  if(grouping->key->type == FIELD_SIZE || grouping->key->type == FIELD_TIME) {
+    return compile_fail(error, "can't group by a size or date", key, strlen(key));
+  }
+  grouping->deferred = grouping->key->deferred;
+
+  for(const char *p = aggregates; *p; ) {
+    const size_t len = strcspn(p, ",");
+    aggregate_t *grown;
+
+    grown = realloc(grouping->aggregates,
+        (grouping->naggregates + 1) * sizeof(aggregate_t));
+    if(grown == NULL) {
+      grouping_reset(grouping);
+      return -ENOMEM;
+    }
+    grouping->aggregates = grown;
+
+    r = compile_aggregate(&grouping->aggregates[grouping->naggregates], p, len,
+        error);
+    if(r < 0) {
+      grouping_reset(grouping);
+      return r;
+    }
+
+    if(grouping->aggregates[grouping->naggregates].field) {
+      grouping->deferred |= grouping->aggregates[grouping->naggregates].field->deferred;
+    }
+    grouping->naggregates++;
+
+    p += len;
+    if(*p == ',') {
+      ++p;
+    }
+  }
+
+  return hashmap_init(&grouping->index, 64);
+}
+
+void grouping_reset(grouping_t *grouping)
+{
+  for(size_t i = 0; i < grouping->size; ++i) {
+    free(grouping->keys[i]);
+  }
+  free(grouping->keys);
+  free(grouping->values);
+  free(grouping->aggregates);
+  hashmap_reset(&grouping->index);
+
+  memset(grouping, 0, sizeof(*grouping));
+}
+
+bool grouping_has_token(const grouping_t *grouping, char token)
+{
+  if(grouping->key == NULL) {
+    return false;
+  }
+
+  if(grouping->key->token == token) {
+    return true;
+  }
+
+  for(size_t a = 0; a < grouping->naggregates; ++a) {
+    if(grouping->aggregates[a].field &&
+        grouping->aggregates[a].field->token == token) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/* the row for key, added if it's new. Keys are copied, as list items needn't
+ * outlive the package's value. */
+static ssize_t grouping_row(grouping_t *grouping, const char *key)
+{
+  uintptr_t n;
+  int64_t *values;
+
+  /* the index holds the row plus one */
+  n = (uintptr_t)hashmap_get(&grouping->index, key);
+  if(n > 0) {
+    return n - 1;
+  }
+
+  if(grouping->size == grouping->capacity) {
+    const size_t newcap = grouping->capacity ? grouping->capacity * 2 : 64;
+    void *ptr;
+
+    ptr = realloc(grouping->keys, newcap * sizeof(char *));
+    if(ptr == NULL) {
+      return -ENOMEM;
+    }
+    grouping->keys = ptr;
+
+    ptr = realloc(grouping->values,
+        newcap * grouping->naggregates * sizeof(int64_t));
+    if(ptr == NULL && grouping->naggregates > 0) {
+      return -ENOMEM;
+    }
+    grouping->values = ptr;
+    grouping->capacity = newcap;
+  }
+
+  grouping->keys[grouping->size] = strdup(key);
+  if(grouping->keys[grouping->size] == NULL) {
+    return -ENOMEM;
+  }
+
+  if(hashmap_put(&grouping->index, grouping->keys[grouping->size],
+        (void *)(uintptr_t)(grouping->size + 1)) < 0) {
+    free(grouping->keys[grouping->size]);
+    return -ENOMEM;
+  }
+
+  values = grouping->values + grouping->size * grouping->naggregates;
+  for(size_t a = 0; a < grouping->naggregates; ++a) {
+    switch (grouping->aggregates[a].fn) {
+      case AGGREGATE_MIN:
+        values[a] = INT64_MAX;
+        break;
+      case AGGREGATE_MAX:
+        values[a] = INT64_MIN;
+        break;
+      default:
+        values[a] = 0;
+        break;
+    }
+  }
+
+  return grouping->size++;
+}
+
+static void aggregate_update(const aggregate_t *aggregate, int64_t *acc,
+    int64_t value)
+{
+  switch (aggregate->fn) {
+    case AGGREGATE_COUNT:
+      ++*acc;
+      break;
+    case AGGREGATE_SUM:
+      *acc += value;
+      break;
+    case AGGREGATE_MIN:
+      if(value < *acc) {
+        *acc = value;
+      }
+      break;
+    case AGGREGATE_MAX:
+      if(value > *acc) {
+        *acc = value;
+      }
+      break;
+  }
+}
+
+static int grouping_add_one(grouping_t *grouping, alpm_pkg_t *pkg,
+    field_get_fn get, void *ctx, int64_t *values)
+{
+  field_value_t key;
+  alpm_list_t single = { 0 };
+  int r = 0;
+
+  for(size_t a = 0; a < grouping->naggregates; ++a) {
+    const field_t *field = grouping->aggregates[a].field;
+    field_value_t value;
+
+    values[a] = 0;
+    if(field == NULL) {
+      continue;
+    }
+
+    memset(&value, 0, sizeof(value));
+    get(ctx, pkg, field, &value);
+    values[a] = field->type == FIELD_LIST ?
+      (int64_t)alpm_list_count(value.list) : value.num;
+    field_value_reset(&value);
+  }
+
+  memset(&key, 0, sizeof(key));
+  get(ctx, pkg, grouping->key, &key);
+
+  /* a list counts towards a group for each of its items, or the empty one
+   * if it has none */
+  if(grouping->key->type != FIELD_LIST) {
+    single.data = (void *)(key.str ? key.str : "");
+    key.list = &single;
+  } else if(key.list == NULL) {
+    single.data = "";
+    key.list = &single;
+  }
+
+  for(alpm_list_t *i = key.list; i; i = i->next) {
+    ssize_t row = grouping_row(grouping, i->data);
+    if(row < 0) {
+      r = (int)row;
+      break;
+    }
+
+    for(size_t a = 0; a < grouping->naggregates; ++a) {
+      aggregate_update(&grouping->aggregates[a],
+          &grouping->values[row * grouping->naggregates + a], values[a]);
+    }
+  }
+
+  if(key.list == &single) {
+    key.list = NULL;
+  }
+  field_value_reset(&key);
+
+  return r;
+}
+
+/* adds each of pkgs to the groups its key puts it in, in a single pass */
+int grouping_add(grouping_t *grouping, alpm_list_t *pkgs, field_get_fn get,
+    void *ctx)
+{
+  int64_t *values = malloc((grouping->naggregates + 1) * sizeof(int64_t));
+  int r = 0;
+
+  if(values == NULL) {
+    return -ENOMEM;
+  }
+
+  for(alpm_list_t *i = pkgs; i && r == 0; i = i->next) {
+    r = grouping_add_one(grouping, i->data, get, ctx, values);
+  }
+
+  free(values);
+
+  return r;
+}
+
+/* vim: set et ts=2 sw=2: */
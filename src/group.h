@@ -0,0 +1,65 @@
+#ifndef _GROUP_H
+#define _GROUP_H
+
+#include <alpm.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "field.h"
+#include "hashmap.h"
+
+typedef enum aggregate_fn_t {
+  AGGREGATE_COUNT,
+  AGGREGATE_SUM,
+  AGGREGATE_MIN,
+  AGGREGATE_MAX,
+} aggregate_fn_t;
+
+/* sizes and dates aggregate as numbers, lists by their length */
+typedef struct aggregate_t {
+  aggregate_fn_t fn;
+  const field_t *field;
+} aggregate_t;
+
+/* results grouped by the value of a field, or by each item of a list, with
+ * aggregates kept for each group in the order its key was first seen */
+typedef struct grouping_t {
+  const field_t *key;
+  aggregate_t *aggregates;
+  size_t naggregates;
+
+  /* whether the key or any aggregate is deferred */
+  bool deferred;
+
+  char **keys;
+  int64_t *values;
+  size_t size;
+  size_t capacity;
+  hashmap_t index;
+} grouping_t;
+
+/* what grouping_compile didn't like, and which part of its input */
+typedef struct grouping_error_t {
+  const char *message;
+  const char *where;
+  size_t len;
+} grouping_error_t;
+
+int grouping_compile(grouping_t *grouping, const char *key,
+    const char *aggregates, grouping_error_t *error);
+void grouping_reset(grouping_t *grouping);
+bool grouping_has_token(const grouping_t *grouping, char token);
+
+int grouping_add(grouping_t *grouping, alpm_list_t *pkgs, field_get_fn get,
+    void *ctx);
+
+static inline const int64_t *grouping_values(const grouping_t *grouping,
+    size_t row)
+{
+  return grouping->values + row * grouping->naggregates;
+}
+
+#endif  /* _GROUP_H */
+
+/* vim: set et ts=2 sw=2: */
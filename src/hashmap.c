@@ -0,0 +1,120 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hashmap.h"
+
+/* 64-bit FNV-1a */
+uint64_t hashmap_hash(const char *key, size_t len)
+{
+  uint64_t hash = 0xcbf29ce484222325ULL;
+
+  for(size_t i = 0; i < len; ++i) {
+    hash ^= (unsigned char)key[i];
+    hash *= 0x100000001b3ULL;
+  }
+
+  return hash;
+}
+
+static hashmap_entry_t *hashmap_find(const hashmap_entry_t *entries,
+    size_t capacity, const char *key, uint64_t hash)
+{
+  size_t mask = capacity - 1;
+
+  for(size_t i = hash & mask;; i = (i + 1) & mask) {
+    const hashmap_entry_t *entry = &entries[i];
+
+    if(entry->key == NULL ||
+        (entry->hash == hash && strcmp(entry->key, key) == 0)) {
+      return (hashmap_entry_t *)entry;
+    }
+  }
+}
+
+static int hashmap_resize(hashmap_t *map, size_t capacity)
+{
+  hashmap_entry_t *entries;
+
+  entries = calloc(capacity, sizeof(hashmap_entry_t));
+  if(entries == NULL) {
+    return -ENOMEM;
+  }
+
+  for(size_t i = 0; i < map->capacity; ++i) {
+    const hashmap_entry_t *old = &map->entries[i];
+    if(old->key != NULL) {
+      *hashmap_find(entries, capacity, old->key, old->hash) = *old;
+    }
+  }
+
+  free(map->entries);
+  map->entries = entries;
+  map->capacity = capacity;
+
+  return 0;
+}
+
+int hashmap_init(hashmap_t *map, size_t hint)
+{
+  size_t capacity = 16;
+
+  memset(map, 0, sizeof(*map));
+
+  /* keep the load factor under a half */
+  while(capacity < hint * 2) {
+    capacity *= 2;
+  }
+
+  return hashmap_resize(map, capacity);
+}
+
+void hashmap_reset(hashmap_t *map)
+{
+  if(map == NULL) {
+    return;
+  }
+
+  free(map->entries);
+  memset(map, 0, sizeof(*map));
+}
+
+void *hashmap_get(const hashmap_t *map, const char *key)
+{
+  const hashmap_entry_t *entry;
+
+  if(map->capacity == 0) {
+    return NULL;
+  }
+
+  entry = hashmap_find(map->entries, map->capacity, key,
+      hashmap_hash(key, strlen(key)));
+
+  return entry->key ? entry->value : NULL;
+}
+
+int hashmap_put(hashmap_t *map, const char *key, void *value)
+{
+  hashmap_entry_t *entry;
+  uint64_t hash;
+
+  if((map->size + 1) * 2 > map->capacity) {
+    int r = hashmap_resize(map, map->capacity ? map->capacity * 2 : 16);
+    if(r < 0) {
+      return r;
+    }
+  }
+
+  hash = hashmap_hash(key, strlen(key));
+  entry = hashmap_find(map->entries, map->capacity, key, hash);
+  if(entry->key == NULL) {
+    entry->key = key;
+    entry->hash = hash;
+    ++map->size;
+  }
+  entry->value = value;
+
+  return 0;
+}
+
+/* vim: set et ts=2 sw=2: */
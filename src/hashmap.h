@@ -0,0 +1,30 @@
+#ifndef _HASHMAP_H
+#define _HASHMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct hashmap_entry_t {
+  const char *key;
+  void *value;
+  uint64_t hash;
+} hashmap_entry_t;
+
+/* open addressing map from strings to pointers. Keys are not copied and
+ * must outlive the map. */
+typedef struct hashmap_t {
+  hashmap_entry_t *entries;
+  size_t size;
+  size_t capacity;
+} hashmap_t;
+
+uint64_t hashmap_hash(const char *key, size_t len);
+
+int hashmap_init(hashmap_t *map, size_t hint);
+void hashmap_reset(hashmap_t *map);
+void *hashmap_get(const hashmap_t *map, const char *key);
+int hashmap_put(hashmap_t *map, const char *key, void *value);
+
+#endif  /* _HASHMAP_H */
+
+/* vim: set et ts=2 sw=2: */
@@ -0,0 +1,440 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hashmap.h"
+#include "modified.h"
+#include "output.h"
+#include "pool.h"
+#include "util.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX  4096
+#endif
+
+/* hashing is mostly waiting on the disk, but past this point more threads
+ * only add contention */
+#define MODIFIED_MAX_THREADS  16
+
+#define MD5CACHE_FILENAME  "backup-md5sums"
+#define MD5CACHE_HEADER    "# expac backup md5sums v1\n"
+
+/* digests of backup files from a previous run, trusted for as long as the
+ * file's device, inode, size and mtime stay the same */
+typedef struct md5cache_entry_t {
+  char *path;
+  dev_t dev;
+  ino_t ino;
+  off_t size;
+  int64_t mtime_ns;
+  char md5[MD5_HEX_LEN + 1];
+} md5cache_entry_t;
+
+typedef struct md5cache_t {
+  char *filename;
+  md5cache_entry_t **entries;
+  size_t size;
+  size_t capacity;
+  hashmap_t index;
+  bool dirty;
+} md5cache_t;
+
+typedef struct compute_t {
+  modified_t *modified;
+  const md5cache_t *cache;
+  bool rehash;
+} compute_t;
+
+static void md5cache_reset(md5cache_t *cache)
+{
+  for(size_t i = 0; i < cache->size; ++i) {
+    free(cache->entries[i]->path);
+    free(cache->entries[i]);
+  }
+
+  free(cache->entries);
+  free(cache->filename);
+  hashmap_reset(&cache->index);
+}
+
+static const md5cache_entry_t *md5cache_lookup(const md5cache_t *cache,
+    const char *path)
+{
+  return hashmap_get(&cache->index, path);
+}
+
+static int md5cache_update(md5cache_t *cache, const char *path,
+    const modified_entry_t *result)
+{
+  md5cache_entry_t *entry;
+
+  /* the cache is line based */
+  if(strchr(path, '\n') != NULL) {
+    return 0;
+  }
+
+  entry = hashmap_get(&cache->index, path);
+  if(entry == NULL) {
+    int r;
+
+    if(cache->size == cache->capacity) {
+      void *ptr;
+      const size_t newcap = cache->capacity ? cache->capacity * 2 : 64;
+
+      ptr = realloc(cache->entries, newcap * sizeof(md5cache_entry_t *));
+      if(ptr == NULL) {
+        return -ENOMEM;
+      }
+
+      cache->entries = ptr;
+      cache->capacity = newcap;
+    }
+
+    entry = calloc(1, sizeof(*entry));
+    if(entry == NULL) {
+      return -ENOMEM;
+    }
+
+    entry->path = strdup(path);
+    if(entry->path == NULL) {
+      free(entry);
+      return -ENOMEM;
+    }
+
+    r = hashmap_put(&cache->index, entry->path, entry);
+    if(r < 0) {
+      free(entry->path);
+      free(entry);
+      return r;
+    }
+
+    cache->entries[cache->size++] = entry;
+  }
+
+  entry->dev = result->dev;
+  entry->ino = result->ino;
+  entry->size = result->size;
+  entry->mtime_ns = result->mtime_ns;
+  memcpy(entry->md5, result->md5, sizeof(entry->md5));
+
+  cache->dirty = true;
+
+  return 0;
+}
+
+static int md5cache_parse_line(char *line, modified_entry_t *fields,
+    char **path)
+{
+  unsigned long long dev, ino, size;
+  long long mtime_ns;
+  int pathoffset;
+
+  if(sscanf(line, "%32s %llu %llu %llu %lld %n", fields->md5, &dev, &ino,
+        &size, &mtime_ns, &pathoffset) != 5) {
+    return -EINVAL;
+  }
+
+  if(strlen(fields->md5) != MD5_HEX_LEN || line[pathoffset] == '\0') {
+    return -EINVAL;
+  }
+
+  fields->dev = dev;
+  fields->ino = ino;
+  fields->size = size;
+  fields->mtime_ns = mtime_ns;
+  *path = &line[pathoffset];
+
+  return 0;
+}
+
+static int md5cache_load(md5cache_t *cache, const char *cachedir)
+{
+  _cleanup_(fclosep) FILE *fp = NULL;
+  _cleanup_free_ char *line = NULL;
+  size_t n = 0;
+  int r;
+
+  memset(cache, 0, sizeof(*cache));
+
+  r = hashmap_init(&cache->index, 0);
+  if(r < 0) {
+    return r;
+  }
+
+  if(asprintf(&cache->filename, "%s/%s", cachedir, MD5CACHE_FILENAME) < 0) {
+    cache->filename = NULL;
+    return -ENOMEM;
+  }
+
+  fp = fopen(cache->filename, "r");
+  if(fp == NULL) {
+    /* a missing cache is just an empty one */
+    return errno == ENOENT ? 0 : -errno;
+  }
+
+  for(;;) {
+    modified_entry_t fields;
+    ssize_t len;
+    char *path;
+
+    len = getline(&line, &n, fp);
+    if(len < 0) {
+      break;
+    }
+
+    if(line[0] == '#') {
+      continue;
+    }
+
+    if(line[len - 1] == '\n') {
+      line[len - 1] = '\0';
+    }
+
+    /* skip over anything damaged, it'll be rewritten on the next save */
+    if(md5cache_parse_line(line, &fields, &path) < 0) {
+      continue;
+    }
+
+    r = md5cache_update(cache, path, &fields);
+    if(r < 0) {
+      return r;
+    }
+  }
+
+  cache->dirty = false;
+
+  return 0;
+}
+
+static int md5cache_save(md5cache_t *cache)
+{
+  _cleanup_(outbuf_reset) outbuf_t out;
+  int r;
+
+  memset(&out, 0, sizeof(out));
+
+  if(!cache->dirty) {
+    return 0;
+  }
+
+  r = outbuf_init(&out, -1, 0);
+  if(r < 0) {
+    return r;
+  }
+
+  outbuf_puts(&out, MD5CACHE_HEADER);
+  for(size_t i = 0; i < cache->size; ++i) {
+    const md5cache_entry_t *entry = cache->entries[i];
+
+    outbuf_printf(&out, "%s %llu %llu %llu %lld %s\n", entry->md5,
+        (unsigned long long)entry->dev, (unsigned long long)entry->ino,
+        (unsigned long long)entry->size, (long long)entry->mtime_ns,
+        entry->path);
+  }
+
+  if(out.error < 0) {
+    return out.error;
+  }
+
+  /* swapped in atomically so concurrent runs never see a partial file */
+  return write_file_atomic(cache->filename, out.buf, out.len);
+}
+
+static void backup_fullpath(char *buf, size_t size, const char *root,
+    const alpm_backup_t *backup_file)
+{
+  snprintf(buf, size, "%s%s", root, backup_file->name);
+}
+
+static bool backup_file_is_modified(const char *root,
+    const alpm_backup_t *backup_file)
+{
+  char fullpath[PATH_MAX];
+  _cleanup_free_ char *md5sum = NULL;
+
+  backup_fullpath(fullpath, sizeof(fullpath), root, backup_file);
+
+  md5sum = alpm_compute_md5sum(fullpath);
+  if(md5sum == NULL) {
+    return false;
+  }
+
+  return strcmp(md5sum, backup_file->hash) != 0;
+}
+
+static int entry_cmp(const void *a, const void *b)
+{
+  const modified_entry_t *ea = a, *eb = b;
+
+  if(ea->backup == eb->backup) {
+    return 0;
+  }
+
+  return ea->backup < eb->backup ? -1 : 1;
+}
+
+static void hash_one(void *ctx, size_t worker, size_t job)
+{
+  compute_t *compute = ctx;
+  modified_entry_t *entry = &compute->modified->entries[job];
+  const alpm_backup_t *backup = entry->backup;
+  char fullpath[PATH_MAX];
+  _cleanup_free_ char *md5sum = NULL;
+  struct stat st;
+  bool have_stat = false;
+
+  (void)worker;
+
+  backup_fullpath(fullpath, sizeof(fullpath), compute->modified->root, backup);
+
+  if(compute->cache != NULL && stat(fullpath, &st) == 0) {
+    const md5cache_entry_t *cached;
+
+    entry->dev = st.st_dev;
+    entry->ino = st.st_ino;
+    entry->size = st.st_size;
+    entry->mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    have_stat = true;
+
+    cached = md5cache_lookup(compute->cache, fullpath);
+    if(!compute->rehash && cached != NULL &&
+        cached->dev == entry->dev && cached->ino == entry->ino &&
+        cached->size == entry->size && cached->mtime_ns == entry->mtime_ns) {
+      entry->modified = strcmp(cached->md5, backup->hash) != 0;
+      return;
+    }
+  }
+
+  md5sum = alpm_compute_md5sum(fullpath);
+  if(md5sum == NULL) {
+    entry->modified = false;
+    return;
+  }
+
+  entry->modified = strcmp(md5sum, backup->hash) != 0;
+
+  if(have_stat && strlen(md5sum) == MD5_HEX_LEN) {
+    memcpy(entry->md5, md5sum, sizeof(entry->md5));
+    entry->fresh = true;
+  }
+}
+
+static void update_cache(md5cache_t *cache, const modified_t *modified)
+{
+  for(size_t i = 0; i < modified->size; ++i) {
+    const modified_entry_t *entry = &modified->entries[i];
+    char fullpath[PATH_MAX];
+
+    if(!entry->fresh) {
+      continue;
+    }
+
+    backup_fullpath(fullpath, sizeof(fullpath), modified->root, entry->backup);
+    if(md5cache_update(cache, fullpath, entry) < 0) {
+      break;
+    }
+  }
+}
+
+int modified_compute(modified_t *modified, alpm_list_t *pkgs, const char *root,
+    const char *cachedir, bool rehash, size_t nthreads)
+{
+  _cleanup_(md5cache_reset) md5cache_t cache;
+  compute_t compute = { .modified = modified, .rehash = rehash };
+  size_t count = 0;
+  int r;
+
+  memset(modified, 0, sizeof(*modified));
+  memset(&cache, 0, sizeof(cache));
+  modified->root = root;
+
+  /* alpm loads backup lists lazily, so walk them here rather than from
+   * the workers */
+  for(alpm_list_t *i = pkgs; i; i = i->next) {
+    for(alpm_list_t *j = alpm_pkg_get_backup(i->data); j; j = j->next) {
+      const alpm_backup_t *backup = j->data;
+      if(backup->hash) {
+        ++count;
+      }
+    }
+  }
+
+  if(count == 0) {
+    return 0;
+  }
+
+  modified->entries = calloc(count, sizeof(modified_entry_t));
+  if(modified->entries == NULL) {
+    return -ENOMEM;
+  }
+
+  for(alpm_list_t *i = pkgs; i; i = i->next) {
+    for(alpm_list_t *j = alpm_pkg_get_backup(i->data); j; j = j->next) {
+      const alpm_backup_t *backup = j->data;
+      if(backup->hash) {
+        modified->entries[modified->size++].backup = backup;
+      }
+    }
+  }
+
+  if(cachedir != NULL) {
+    r = md5cache_load(&cache, cachedir);
+    if(r < 0) {
+      fprintf(stderr, "warning: failed to read checksum cache in %s: %s\n",
+          cachedir, strerror(-r));
+    } else {
+      compute.cache = &cache;
+    }
+  }
+
+  if(nthreads > MODIFIED_MAX_THREADS) {
+    nthreads = MODIFIED_MAX_THREADS;
+  }
+
+  pool_run(nthreads, modified->size, hash_one, &compute);
+
+  if(compute.cache != NULL) {
+    update_cache(&cache, modified);
+
+    r = md5cache_save(&cache);
+    if(r < 0) {
+      fprintf(stderr, "warning: failed to write checksum cache in %s: %s\n",
+          cachedir, strerror(-r));
+    }
+  }
+
+  qsort(modified->entries, modified->size, sizeof(modified_entry_t), entry_cmp);
+
+  return 0;
+}
+
+bool modified_check(const modified_t *modified, const alpm_backup_t *backup)
+{
+  const modified_entry_t key = { .backup = backup }, *entry = NULL;
+
+  if(modified->size > 0) {
+    entry = bsearch(&key, modified->entries, modified->size,
+        sizeof(modified_entry_t), entry_cmp);
+  }
+
+  if(entry != NULL) {
+    return entry->modified;
+  }
+
+  return backup_file_is_modified(modified->root ? modified->root : "/", backup);
+}
+
+void modified_reset(modified_t *modified)
+{
+  if(modified == NULL) {
+    return;
+  }
+
+  free(modified->entries);
+  memset(modified, 0, sizeof(*modified));
+}
+
+/* vim: set et ts=2 sw=2: */
@@ -0,0 +1,39 @@
+#ifndef _MODIFIED_H
+#define _MODIFIED_H
+
+#include <alpm.h>
+#include <stdbool.h>
+
+#define MD5_HEX_LEN  32
+
+typedef struct modified_entry_t {
+  const alpm_backup_t *backup;
+  int modified;
+
+  /* filled in when a digest had to be computed and should be cached */
+  bool fresh;
+  dev_t dev;
+  ino_t ino;
+  off_t size;
+  int64_t mtime_ns;
+  char md5[MD5_HEX_LEN + 1];
+} modified_entry_t;
+
+/* verdicts for the backup files of a set of packages, computed up front
+ * so that the hashing can be spread over several threads */
+typedef struct modified_t {
+  modified_entry_t *entries;
+  size_t size;
+
+  /* prefix of every backup file, with a trailing slash */
+  const char *root;
+} modified_t;
+
+int modified_compute(modified_t *modified, alpm_list_t *pkgs, const char *root,
+    const char *cachedir, bool rehash, size_t nthreads);
+bool modified_check(const modified_t *modified, const alpm_backup_t *backup);
+void modified_reset(modified_t *modified);
+
+#endif  /* _MODIFIED_H */
+
+/* vim: set et ts=2 sw=2: */
@@ -0,0 +1,326 @@
+#include <errno.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "output.h"
+#include "stats.h"
+#include "util.h"
+
+static int full_writev(int fd, struct iovec *iov, int iovcnt)
+{
+  while(iovcnt > 0) {
+    ssize_t n;
+
+    n = writev(fd, iov, iovcnt);
+    if(n < 0) {
+      if(errno == EINTR) {
+        continue;
+      }
+      return -errno;
+    }
+
+    /* skip over whatever was fully written, and adjust a partial write */
+    while(iovcnt > 0 && (size_t)n >= iov->iov_len) {
+      n -= iov->iov_len;
+      ++iov;
+      --iovcnt;
+    }
+    if(iovcnt > 0) {
+      iov->iov_base = (char *)iov->iov_base + n;
+      iov->iov_len -= n;
+    }
+  }
+
+  return 0;
+}
+
+/* full_writev, keeping track of the time it takes */
+static int outbuf_writev(outbuf_t *out, struct iovec *iov, int iovcnt)
+{
+  const uint64_t wall = stats_now(), cpu = stats_thread_cpu();
+  int r;
+
+  r = full_writev(out->fd, iov, iovcnt);
+  if(r < 0 && out->error == 0) {
+    out->error = r;
+  }
+
+  out->write_ns += stats_now() - wall;
+  out->write_cpu_ns += stats_thread_cpu() - cpu;
+
+  return r;
+}
+
+static int outbuf_grow(outbuf_t *out, size_t need)
+{
+  size_t newcap = out->capacity;
+  void *ptr;
+
+  while(newcap - out->len < need) {
+    newcap *= 2;
+  }
+
+  ptr = realloc(out->buf, newcap);
+  if(ptr == NULL) {
+    return -ENOMEM;
+  }
+
+  out->buf = ptr;
+  out->capacity = newcap;
+
+  return 0;
+}
+
+/* make room for at least need bytes at the end of the buffer. Returns 1 if
+ * the data is too large to ever fit and should bypass the buffer. */
+static int outbuf_reserve(outbuf_t *out, size_t need)
+{
+  int r;
+
+  if(out->capacity - out->len >= need) {
+    return 0;
+  }
+
+  if(out->fd < 0) {
+    r = outbuf_grow(out, need);
+    if(r < 0) {
+      out->error = out->error ? out->error : r;
+    }
+    return r;
+  }
+
+  if(need >= out->capacity) {
+    return 1;
+  }
+
+  return outbuf_flush(out);
+}
+
+int outbuf_init(outbuf_t *out, int fd, size_t capacity)
+{
+  memset(out, 0, sizeof(*out));
+
+  if(capacity == 0) {
+    capacity = OUTBUF_DEFAULT_SIZE;
+  }
+
+  out->buf = malloc(capacity);
+  if(out->buf == NULL) {
+    return -ENOMEM;
+  }
+
+  out->capacity = capacity;
+  out->fd = fd;
+
+  return 0;
+}
+
+void outbuf_reset(outbuf_t *out)
+{
+  if(out == NULL) {
+    return;
+  }
+
+  free(out->buf);
+  memset(out, 0, sizeof(*out));
+  out->fd = -1;
+}
+
+int outbuf_flush(outbuf_t *out)
+{
+  struct iovec iov;
+
+  if(out->fd < 0 || out->len == 0) {
+    return 0;
+  }
+
+  iov.iov_base = out->buf;
+  iov.iov_len = out->len;
+  out->len = 0;
+
+  return outbuf_writev(out, &iov, 1);
+}
+
+int outbuf_write(outbuf_t *out, const void *data, size_t len)
+{
+  int r;
+
+  if(len == 0) {
+    return 0;
+  }
+
+  r = outbuf_reserve(out, len);
+  if(r < 0) {
+    return 0;
+  }
+
+  if(r > 0) {
+    /* too large to stage: send what's buffered and the data in one go */
+    struct iovec iov[2] = {
+      { .iov_base = out->buf, .iov_len = out->len },
+      { .iov_base = (void *)data, .iov_len = len },
+    };
+
+    out->len = 0;
+    outbuf_writev(out, iov, 2);
+  } else {
+    memcpy(out->buf + out->len, data, len);
+    out->len += len;
+  }
+
+  out->total += len;
+
+  return len;
+}
+
+int outbuf_puts(outbuf_t *out, const char *s)
+{
+  return outbuf_write(out, s, strlen(s));
+}
+
+int outbuf_putc(outbuf_t *out, char c)
+{
+  if(out->len == out->capacity && outbuf_reserve(out, 1) != 0) {
+    return 0;
+  }
+
+  out->buf[out->len++] = c;
+  out->total++;
+
+  return 1;
+}
+
+int outbuf_printf(outbuf_t *out, const char *fmt, ...)
+{
+  va_list ap;
+  int n;
+
+  va_start(ap, fmt);
+  n = vsnprintf(out->buf + out->len, out->capacity - out->len, fmt, ap);
+  va_end(ap);
+
+  if(n < 0) {
+    return 0;
+  }
+
+  if((size_t)n < out->capacity - out->len) {
+    out->len += n;
+    out->total += n;
+    return n;
+  }
+
+  /* didn't fit in what was left. If it would fit in an empty buffer, make
+   * room and format in place, otherwise go through the heap. */
+  if(outbuf_reserve(out, n + 1) == 0) {
+    va_start(ap, fmt);
+    vsnprintf(out->buf + out->len, out->capacity - out->len, fmt, ap);
+    va_end(ap);
+
+    out->len += n;
+    out->total += n;
+  } else {
+    _cleanup_free_ char *tmp = NULL;
+
+    va_start(ap, fmt);
+    n = vasprintf(&tmp, fmt, ap);
+    va_end(ap);
+    if(n < 0) {
+      return 0;
+    }
+
+    outbuf_write(out, tmp, n);
+  }
+
+  return n;
+}
+
+#define ONES  UINT64_C(0x0101010101010101)
+#define HIGHS UINT64_C(0x8080808080808080)
+
+/* nonzero if any byte of w is a control character, a quote or a backslash.
+ * Bytes from 0x80 up never are, so UTF-8 passes through untouched. */
+static inline uint64_t json_special(uint64_t w)
+{
+  const uint64_t quote = w ^ (ONES * '"');
+  const uint64_t backslash = w ^ (ONES * '\\');
+
+  return ((w - ONES * 0x20) | (quote - ONES) | (backslash - ONES)) &
+    ~w & HIGHS;
+}
+
+static int json_escape(outbuf_t *out, unsigned char c)
+{
+  static const char hex[] = "0123456789abcdef";
+  char esc[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf] };
+
+  switch (c) {
+    case '"':
+    case '\\':
+      esc[1] = c;
+      return outbuf_write(out, esc, 2);
+    case '\b':
+      esc[1] = 'b';
+      return outbuf_write(out, esc, 2);
+    case '\f':
+      esc[1] = 'f';
+      return outbuf_write(out, esc, 2);
+    case '\n':
+      esc[1] = 'n';
+      return outbuf_write(out, esc, 2);
+    case '\r':
+      esc[1] = 'r';
+      return outbuf_write(out, esc, 2);
+    case '\t':
+      esc[1] = 't';
+      return outbuf_write(out, esc, 2);
+    default:
+      return outbuf_write(out, esc, 6);
+  }
+}
+
+static inline bool json_plain(unsigned char c)
+{
+  return c >= 0x20 && c != '"' && c != '\\';
+}
+
+/* s as a quoted JSON string. Eight bytes are checked at a time, and runs
+ * without anything to escape are copied as they are. */
+int outbuf_json_string(outbuf_t *out, const char *s)
+{
+  const size_t len = strlen(s);
+  size_t run = 0, i = 0;
+  int n = outbuf_putc(out, '"');
+
+  while(i < len) {
+    uint64_t w;
+
+    if(i + 8 <= len) {
+      memcpy(&w, s + i, 8);
+      if(!json_special(w)) {
+        i += 8;
+        continue;
+      }
+    }
+
+    /* something in the next word needs escaping, or this is the tail */
+    for(const size_t end = i + 8 < len ? i + 8 : len; i < end; ++i) {
+      if(!json_plain(s[i])) {
+        n += outbuf_write(out, s + run, i - run);
+        n += json_escape(out, s[i]);
+        run = i + 1;
+      }
+    }
+  }
+
+  n += outbuf_write(out, s + run, len - run);
+  n += outbuf_putc(out, '"');
+
+  return n;
+}
+
+/* vim: set et ts=2 sw=2: */
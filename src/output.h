@@ -0,0 +1,42 @@
+#ifndef _OUTPUT_H
+#define _OUTPUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define OUTBUF_DEFAULT_SIZE  (128 * 1024)
+
+typedef struct outbuf_t {
+  char *buf;
+  size_t len;
+  size_t capacity;
+
+  /* destination of flushes. -1 keeps everything in memory, growing the
+   * buffer as needed. */
+  int fd;
+
+  /* bytes appended over the lifetime of the buffer */
+  size_t total;
+
+  /* first write error seen, as a negative errno */
+  int error;
+
+  /* nanoseconds spent writing, of wall clock and of the writer's CPU */
+  uint64_t write_ns;
+  uint64_t write_cpu_ns;
+} outbuf_t;
+
+int outbuf_init(outbuf_t *out, int fd, size_t capacity);
+void outbuf_reset(outbuf_t *out);
+int outbuf_flush(outbuf_t *out);
+
+int outbuf_write(outbuf_t *out, const void *data, size_t len);
+int outbuf_puts(outbuf_t *out, const char *s);
+int outbuf_putc(outbuf_t *out, char c);
+int outbuf_printf(outbuf_t *out, const char *fmt, ...)
+  __attribute__((format(printf, 2, 3)));
+int outbuf_json_string(outbuf_t *out, const char *s);
+
+#endif  /* _OUTPUT_H */
+
+/* vim: set et ts=2 sw=2: */
@@ -0,0 +1,420 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hashmap.h"
+#include "output.h"
+#include "owners.h"
+#include "util.h"
+
+#define OWNERS_MAGIC  "expacow1"
+#define OWNERS_BOM    0x01020304u
+
+struct owners_header_t {
+  char magic[8];
+  uint32_t bom;
+  uint32_t npkgs;
+  uint64_t nentries;
+
+  /* the DB this was built from, and the packages that were in it */
+  uint64_t db_dev;
+  uint64_t db_ino;
+  int64_t db_mtime_ns;
+  uint64_t pkgs_hash;
+
+  uint64_t entries_off;
+  uint64_t names_off;
+  uint64_t strings_off;
+  uint64_t strings_len;
+};
+
+/* a path and the package owning it, as offsets into the string table and
+ * the name table respectively */
+struct owners_entry_t {
+  uint32_t path;
+  uint32_t pkg;
+};
+
+typedef struct pending_entry_t {
+  const char *path;
+  uint32_t pkg;
+} pending_entry_t;
+
+static size_t align8(size_t n)
+{
+  return (n + 7) & ~(size_t)7;
+}
+
+static int64_t stat_mtime_ns(const struct stat *st)
+{
+  return (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+}
+
+/* the name and version of each package, in no particular order. Local
+ * packages have both without reading anything but the DB's directory. */
+static uint64_t hash_pkgs(alpm_list_t *pkgs, size_t *npkgs)
+{
+  uint64_t hash = 0;
+
+  *npkgs = 0;
+  for(alpm_list_t *i = pkgs; i; i = i->next) {
+    const char *name = alpm_pkg_get_name(i->data);
+    const char *version = alpm_pkg_get_version(i->data);
+
+    hash += hashmap_hash(name, strlen(name)) * 31 +
+      hashmap_hash(version, strlen(version));
+    ++*npkgs;
+  }
+
+  return hash;
+}
+
+static bool region_fits(size_t len, uint64_t off, uint64_t count, size_t size)
+{
+  return off <= len && count <= (len - off) / size;
+}
+
+/* checks the header and that every table stays inside of the file. The
+ * offsets stored in entries and names are checked as they're read. */
+static int owners_attach(owners_t *owners)
+{
+  const owners_header_t *h = owners->base;
+
+  if(owners->len < sizeof(*h) ||
+      memcmp(h->magic, OWNERS_MAGIC, sizeof(h->magic)) != 0 ||
+      h->bom != OWNERS_BOM) {
+    return -EINVAL;
+  }
+
+  if(!region_fits(owners->len, h->entries_off, h->nentries,
+        sizeof(owners_entry_t)) ||
+      !region_fits(owners->len, h->names_off, h->npkgs, sizeof(uint32_t)) ||
+      !region_fits(owners->len, h->strings_off, h->strings_len, 1) ||
+      h->strings_len == 0) {
+    return -EINVAL;
+  }
+
+  owners->header = h;
+  owners->entries = (const owners_entry_t *)((const char *)owners->base +
+      h->entries_off);
+  owners->names = (const uint32_t *)((const char *)owners->base +
+      h->names_off);
+  owners->strings = (const char *)owners->base + h->strings_off;
+
+  if(owners->strings[h->strings_len - 1] != '\0') {
+    return -EINVAL;
+  }
+
+  return 0;
+}
+
+static int owners_map(owners_t *owners, const char *filename)
+{
+  struct stat st;
+  int fd, r;
+
+  fd = open(filename, O_RDONLY | O_CLOEXEC);
+  if(fd < 0) {
+    return -errno;
+  }
+
+  if(fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(owners_header_t)) {
+    close(fd);
+    return -EINVAL;
+  }
+
+  owners->base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(owners->base == MAP_FAILED) {
+    owners->base = NULL;
+    return -errno;
+  }
+
+  owners->len = st.st_size;
+  owners->mapped = true;
+
+  r = owners_attach(owners);
+  if(r < 0) {
+    owners_reset(owners);
+    return r;
+  }
+
+  return 0;
+}
+
+static bool owners_matches(const owners_t *owners, const struct stat *st,
+    uint64_t pkgs_hash, size_t npkgs)
+{
+  const owners_header_t *h = owners->header;
+
+  return h->db_dev == (uint64_t)st->st_dev &&
+    h->db_ino == (uint64_t)st->st_ino &&
+    h->db_mtime_ns == stat_mtime_ns(st) &&
+    h->pkgs_hash == pkgs_hash &&
+    h->npkgs == npkgs;
+}
+
+static int pending_cmp(const void *a, const void *b)
+{
+  const pending_entry_t *x = a, *y = b;
+  int r = strcmp(x->path, y->path);
+
+  if(r != 0) {
+    return r;
+  }
+
+  return (x->pkg > y->pkg) - (x->pkg < y->pkg);
+}
+
+static int strings_add(outbuf_t *strings, const char *s, uint32_t *offset)
+{
+  const size_t len = strlen(s);
+
+  if(strings->len + len + 1 > UINT32_MAX) {
+    return -EFBIG;
+  }
+
+  *offset = strings->len;
+  outbuf_write(strings, s, len + 1);
+
+  return strings->error;
+}
+
+static int owners_layout(owners_t *owners, alpm_list_t *pkgs,
+    pending_entry_t *pending, size_t nentries, outbuf_t *strings,
+    const struct stat *st, uint64_t pkgs_hash, size_t npkgs)
+{
+  _cleanup_free_ uint32_t *names = NULL;
+  _cleanup_free_ owners_entry_t *entries = NULL;
+  owners_header_t *h;
+  size_t n = 0, len;
+  int r;
+
+  names = malloc((npkgs + 1) * sizeof(uint32_t));
+  entries = malloc((nentries + 1) * sizeof(owners_entry_t));
+  if(names == NULL || entries == NULL) {
+    return -ENOMEM;
+  }
+
+  /* offset 0 is the empty string */
+  outbuf_putc(strings, '\0');
+
+  for(alpm_list_t *i = pkgs; i; i = i->next) {
+    r = strings_add(strings, alpm_pkg_get_name(i->data), &names[n++]);
+    if(r < 0) {
+      return r;
+    }
+  }
+
+  /* entries for the same path are next to each other once sorted, so each
+   * path is only stored once */
+  for(size_t i = 0; i < nentries; ++i) {
+    entries[i].pkg = pending[i].pkg;
+    if(i > 0 && strcmp(pending[i].path, pending[i - 1].path) == 0) {
+      entries[i].path = entries[i - 1].path;
+      continue;
+    }
+
+    r = strings_add(strings, pending[i].path, &entries[i].path);
+    if(r < 0) {
+      return r;
+    }
+  }
+
+  len = align8(sizeof(*h));
+  len += align8(nentries * sizeof(owners_entry_t));
+  len += align8(npkgs * sizeof(uint32_t));
+  len += strings->len;
+
+  owners->base = calloc(1, len);
+  if(owners->base == NULL) {
+    return -ENOMEM;
+  }
+  owners->len = len;
+  owners->mapped = false;
+
+  h = owners->base;
+  memcpy(h->magic, OWNERS_MAGIC, sizeof(h->magic));
+  h->bom = OWNERS_BOM;
+  h->npkgs = npkgs;
+  h->nentries = nentries;
+  h->db_dev = st->st_dev;
+  h->db_ino = st->st_ino;
+  h->db_mtime_ns = stat_mtime_ns(st);
+  h->pkgs_hash = pkgs_hash;
+
+  h->entries_off = align8(sizeof(*h));
+  h->names_off = h->entries_off + align8(nentries * sizeof(owners_entry_t));
+  h->strings_off = h->names_off + align8(npkgs * sizeof(uint32_t));
+  h->strings_len = strings->len;
+
+  memcpy((char *)owners->base + h->entries_off, entries,
+      nentries * sizeof(owners_entry_t));
+  memcpy((char *)owners->base + h->names_off, names,
+      npkgs * sizeof(uint32_t));
+  memcpy((char *)owners->base + h->strings_off, strings->buf, strings->len);
+
+  return owners_attach(owners);
+}
+
+static int owners_build(owners_t *owners, alpm_list_t *pkgs,
+    const struct stat *st, uint64_t pkgs_hash, size_t npkgs)
+{
+  _cleanup_free_ pending_entry_t *pending = NULL;
+  _cleanup_(outbuf_reset) outbuf_t strings;
+  size_t nentries = 0, capacity = 0, n = 0;
+  int r;
+
+  memset(&strings, 0, sizeof(strings));
+
+  if(npkgs > UINT32_MAX) {
+    return -EFBIG;
+  }
+
+  for(alpm_list_t *i = pkgs; i; i = i->next, ++n) {
+    alpm_filelist_t *files = alpm_pkg_get_files(i->data);
+
+    if(nentries + files->count > capacity) {
+      size_t newcap = capacity ? capacity : 4096;
+      void *ptr;
+
+      while(newcap < nentries + files->count) {
+        newcap *= 2;
+      }
+
+      ptr = realloc(pending, newcap * sizeof(pending_entry_t));
+      if(ptr == NULL) {
+        return -ENOMEM;
+      }
+      pending = ptr;
+      capacity = newcap;
+    }
+
+    for(size_t f = 0; f < files->count; ++f) {
+      pending[nentries++] = (pending_entry_t){ files->files[f].name, n };
+    }
+  }
+
+  qsort(pending, nentries, sizeof(pending_entry_t), pending_cmp);
+
+  r = outbuf_init(&strings, -1, 0);
+  if(r < 0) {
+    return r;
+  }
+
+  return owners_layout(owners, pkgs, pending, nentries, &strings, st,
+      pkgs_hash, npkgs);
+}
+
+/* maps the index of db from cachefile, rebuilding it first if dbdir or the
+ * packages in db have changed since. Without a cachefile, the index is only
+ * built in memory. */
+int owners_open(owners_t *owners, alpm_db_t *db, const char *dbdir,
+    const char *cachefile)
+{
+  alpm_list_t *pkgs = alpm_db_get_pkgcache(db);
+  struct stat st;
+  uint64_t pkgs_hash;
+  size_t npkgs;
+  int r;
+
+  memset(owners, 0, sizeof(*owners));
+
+  if(stat(dbdir, &st) < 0) {
+    return -errno;
+  }
+
+  pkgs_hash = hash_pkgs(pkgs, &npkgs);
+
+  if(cachefile && owners_map(owners, cachefile) == 0) {
+    if(owners_matches(owners, &st, pkgs_hash, npkgs)) {
+      return 0;
+    }
+    owners_reset(owners);
+  }
+
+  r = owners_build(owners, pkgs, &st, pkgs_hash, npkgs);
+  if(r < 0) {
+    owners_reset(owners);
+    return r;
+  }
+
+  /* an index that can't be saved is still usable */
+  if(cachefile) {
+    write_file_atomic(cachefile, owners->base, owners->len);
+  }
+
+  return 0;
+}
+
+void owners_reset(owners_t *owners)
+{
+  if(owners == NULL) {
+    return;
+  }
+
+  if(owners->mapped) {
+    munmap(owners->base, owners->len);
+  } else {
+    free(owners->base);
+  }
+
+  memset(owners, 0, sizeof(*owners));
+}
+
+/* an offset outside of the string table reads as the empty string */
+static const char *owners_string(const owners_t *owners, uint32_t offset)
+{
+  if(offset >= owners->header->strings_len) {
+    return "";
+  }
+
+  return owners->strings + offset;
+}
+
+/* returns how many packages own path, pointing first at the entry of the
+ * first of them */
+size_t owners_find(const owners_t *owners, const char *path, size_t *first)
+{
+  size_t lo = 0, hi = owners->header->nentries, end;
+
+  while(lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+
+    if(strcmp(owners_string(owners, owners->entries[mid].path), path) < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  *first = lo;
+
+  if(lo == owners->header->nentries ||
+      strcmp(owners_string(owners, owners->entries[lo].path), path) != 0) {
+    return 0;
+  }
+
+  /* and the others share its string */
+  for(end = lo + 1; end < owners->header->nentries &&
+      owners->entries[end].path == owners->entries[lo].path; ++end);
+
+  return end - lo;
+}
+
+const char *owners_pkgname(const owners_t *owners, size_t entry)
+{
+  const uint32_t pkg = owners->entries[entry].pkg;
+
+  if(pkg >= owners->header->npkgs) {
+    return "";
+  }
+
+  return owners_string(owners, owners->names[pkg]);
+}
+
+/* vim: set et ts=2 sw=2: */
@@ -0,0 +1,36 @@
+#ifndef _OWNERS_H
+#define _OWNERS_H
+
+#include <alpm.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct owners_header_t owners_header_t;
+typedef struct owners_entry_t owners_entry_t;
+
+/* every file of every package in a DB, sorted by path so that owners can be
+ * found with a binary search. Paths owned by several packages, such as
+ * directories, have an entry for each. Kept in a file which is rebuilt
+ * whenever a package in the DB changes. */
+typedef struct owners_t {
+  void *base;
+  size_t len;
+  bool mapped;
+
+  const owners_header_t *header;
+  const owners_entry_t *entries;
+  const uint32_t *names;
+  const char *strings;
+} owners_t;
+
+int owners_open(owners_t *owners, alpm_db_t *db, const char *dbdir,
+    const char *cachefile);
+void owners_reset(owners_t *owners);
+
+size_t owners_find(const owners_t *owners, const char *path, size_t *first);
+const char *owners_pkgname(const owners_t *owners, size_t entry);
+
+#endif  /* _OWNERS_H */
+
+/* vim: set et ts=2 sw=2: */
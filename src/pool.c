@@ -0,0 +1,92 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "pool.h"
+#include "util.h"
+
+typedef struct pool_t {
+  pool_fn fn;
+  void *ctx;
+  size_t njobs;
+  atomic_size_t next;
+} pool_t;
+
+typedef struct pool_worker_t {
+  pool_t *pool;
+  size_t id;
+  pthread_t thread;
+} pool_worker_t;
+
+static void *pool_worker(void *arg)
+{
+  pool_worker_t *worker = arg;
+  pool_t *pool = worker->pool;
+
+  for(;;) {
+    size_t job = atomic_fetch_add(&pool->next, 1);
+    if(job >= pool->njobs) {
+      break;
+    }
+
+    pool->fn(pool->ctx, worker->id, job);
+  }
+
+  return NULL;
+}
+
+size_t pool_online_cpus(void)
+{
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+  return n > 0 ? (size_t)n : 1;
+}
+
+/* runs fn for each of njobs jobs on up to nworkers threads, the calling one
+ * included. Whatever threads can't be had, the jobs still all run. */
+void pool_run(size_t nworkers, size_t njobs, pool_fn fn, void *ctx)
+{
+  _cleanup_free_ pool_worker_t *workers = NULL;
+  pool_t pool = { .fn = fn, .ctx = ctx, .njobs = njobs };
+  size_t started;
+
+  atomic_init(&pool.next, 0);
+
+  if(nworkers > njobs) {
+    nworkers = njobs;
+  }
+
+  if(nworkers > 1) {
+    workers = calloc(nworkers, sizeof(*workers));
+  }
+
+  /* nothing to gain from threads, or no memory to keep track of them. Run
+   * everything here, as when they can't be started. */
+  if(workers == NULL) {
+    for(size_t i = 0; i < njobs; ++i) {
+      fn(ctx, 0, i);
+    }
+    return;
+  }
+
+  /* the calling thread is worker 0 and does its share too */
+  for(started = 1; started < nworkers; ++started) {
+    workers[started].pool = &pool;
+    workers[started].id = started;
+    if(pthread_create(&workers[started].thread, NULL, pool_worker,
+          &workers[started]) != 0) {
+      break;
+    }
+  }
+
+  workers[0].pool = &pool;
+  workers[0].id = 0;
+  pool_worker(&workers[0]);
+
+  for(size_t i = 1; i < started; ++i) {
+    pthread_join(workers[i].thread, NULL);
+  }
+}
+
+/* vim: set et ts=2 sw=2: */
@@ -0,0 +1,15 @@
+#ifndef _POOL_H
+#define _POOL_H
+
+#include <stddef.h>
+
+/* called once per job. worker identifies the calling thread and is always
+ * less than the number of workers passed to pool_run. */
+typedef void (*pool_fn)(void *ctx, size_t worker, size_t job);
+
+size_t pool_online_cpus(void);
+void pool_run(size_t nworkers, size_t njobs, pool_fn fn, void *ctx);
+
+#endif  /* _POOL_H */
+
+/* vim: set et ts=2 sw=2: */
@@ -0,0 +1,247 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "request.h"
+#include "util.h"
+
+static int request_set_error(request_t *req, const char *fmt, const char *arg)
+{
+  /* only the first problem is reported */
+  if(req->error != NULL) {
+    return 0;
+  }
+
+  if(asprintf(&req->error, fmt, arg) < 0) {
+    req->error = NULL;
+    return -ENOMEM;
+  }
+
+  return 0;
+}
+
+static int set_string(char **field, const char *value)
+{
+  char *dup = strdup(value);
+
+  if(dup == NULL) {
+    return -ENOMEM;
+  }
+
+  free(*field);
+  *field = dup;
+
+  return 0;
+}
+
+static int request_add_line(request_t *req, char *line)
+{
+  char *key = line, *value;
+
+  value = strchr(line, ' ');
+  if(value != NULL) {
+    *value++ = '\0';
+  } else {
+    value = line + strlen(line);
+  }
+
+  if(strcmp(key, "format") == 0) {
+    return set_string(&req->format, value);
+  } else if(strcmp(key, "corpus") == 0) {
+    return set_string(&req->corpus, value);
+  } else if(strcmp(key, "search") == 0) {
+    return set_string(&req->search, value);
+  } else if(strcmp(key, "delim") == 0) {
+    return set_string(&req->delim, value);
+  } else if(strcmp(key, "listdelim") == 0) {
+    return set_string(&req->listdelim, value);
+  } else if(strcmp(key, "timefmt") == 0) {
+    return set_string(&req->timefmt, value);
+  } else if(strcmp(key, "humansize") == 0) {
+    return set_string(&req->humansize, value);
+  } else if(strcmp(key, "filter") == 0) {
+    return set_string(&req->filter, value);
+  } else if(strcmp(key, "sort") == 0) {
+    return set_string(&req->sort, value);
+  } else if(strcmp(key, "limit") == 0) {
+    return set_string(&req->limit, value);
+  } else if(strcmp(key, "groupby") == 0) {
+    return set_string(&req->groupby, value);
+  } else if(strcmp(key, "aggregate") == 0) {
+    return set_string(&req->aggregate, value);
+  } else if(strcmp(key, "output") == 0) {
+    return set_string(&req->output, value);
+  } else if(strcmp(key, "readone") == 0) {
+    req->readone = true;
+    return 0;
+  } else if(strcmp(key, "reverse") == 0) {
+    req->reverse = true;
+    return 0;
+  } else if(strcmp(key, "target") == 0) {
+    char *target = strdup(value);
+    if(target == NULL) {
+      return -ENOMEM;
+    }
+    req->targets = alpm_list_add(req->targets, target);
+    return 0;
+  }
+
+  return request_set_error(req, "unknown request field '%s'", key);
+}
+
+/* reads a single request, which is a series of "key value" lines ended by
+ * an empty line. Returns 1 if a request was read, 0 at the end of input
+ * and a negative errno on failure. */
+int request_read(FILE *in, request_t *req)
+{
+  _cleanup_free_ char *line = NULL;
+  size_t n = 0;
+  bool empty = true;
+
+  memset(req, 0, sizeof(*req));
+
+  for(;;) {
+    ssize_t len;
+    int r;
+
+    errno = 0;
+    len = getline(&line, &n, in);
+    if(len < 0) {
+      if(errno != 0) {
+        return -errno;
+      }
+
+      /* EOF also ends a request that's missing its final empty line */
+      return empty ? 0 : 1;
+    }
+
+    if(len > 0 && line[len - 1] == '\n') {
+      line[--len] = '\0';
+    }
+
+    if(len == 0) {
+      /* ignore stray empty lines between requests */
+      if(empty) {
+        continue;
+      }
+      break;
+    }
+
+    empty = false;
+
+    r = request_add_line(req, line);
+    if(r < 0) {
+      return r;
+    }
+  }
+
+  return 1;
+}
+
+void request_reset(request_t *req)
+{
+  if(req == NULL) {
+    return;
+  }
+
+  free(req->format);
+  free(req->corpus);
+  free(req->search);
+  free(req->delim);
+  free(req->listdelim);
+  free(req->timefmt);
+  free(req->humansize);
+  free(req->filter);
+  free(req->sort);
+  free(req->limit);
+  free(req->groupby);
+  free(req->aggregate);
+  free(req->output);
+  free(req->error);
+
+  alpm_list_free_inner(req->targets, free);
+  alpm_list_free(req->targets);
+
+  memset(req, 0, sizeof(*req));
+}
+
+static int write_field(outbuf_t *out, const char *key, const char *value,
+    bool escape)
+{
+  if(value == NULL) {
+    return 0;
+  }
+
+  outbuf_printf(out, "%s ", key);
+
+  /* a newline would end the field. Formats and delimiters have their
+   * escapes decoded, so those can carry one as "\n". */
+  for(const char *v = value; *v != '\0'; v++) {
+    if(*v != '\n') {
+      outbuf_putc(out, *v);
+    } else if(escape) {
+      outbuf_write(out, "\\n", 2);
+    } else {
+      return -EINVAL;
+    }
+  }
+
+  outbuf_putc(out, '\n');
+
+  return 0;
+}
+
+/* serializes a request in the form request_read expects, ending it with an
+ * empty line */
+int request_write(outbuf_t *out, const request_t *req)
+{
+  int r = 0;
+
+  r |= write_field(out, "format", req->format, true);
+  r |= write_field(out, "corpus", req->corpus, false);
+  r |= write_field(out, "search", req->search, false);
+  r |= write_field(out, "delim", req->delim, true);
+  r |= write_field(out, "listdelim", req->listdelim, true);
+  r |= write_field(out, "timefmt", req->timefmt, false);
+  r |= write_field(out, "humansize", req->humansize, false);
+  r |= write_field(out, "filter", req->filter, false);
+  r |= write_field(out, "sort", req->sort, false);
+  r |= write_field(out, "limit", req->limit, false);
+  r |= write_field(out, "groupby", req->groupby, false);
+  r |= write_field(out, "aggregate", req->aggregate, false);
+  r |= write_field(out, "output", req->output, false);
+  if(req->readone) {
+    outbuf_puts(out, "readone\n");
+  }
+  if(req->reverse) {
+    outbuf_puts(out, "reverse\n");
+  }
+  for(alpm_list_t *i = req->targets; i; i = i->next) {
+    r |= write_field(out, "target", i->data, false);
+  }
+  if(r != 0) {
+    return -EINVAL;
+  }
+
+  outbuf_putc(out, '\n');
+
+  return out->error;
+}
+
+/* each response is a header line giving its status and the length of the
+ * payload which follows it. Answers to queries also give the number of
+ * results, which the output alone doesn't tell. */
+int response_write(outbuf_t *out, bool ok, size_t count, const char *payload,
+    size_t len)
+{
+  if(ok) {
+    outbuf_printf(out, "ok %zu %zu\n", len, count);
+  } else {
+    outbuf_printf(out, "error %zu\n", len);
+  }
+  outbuf_write(out, payload, len);
+
+  return outbuf_flush(out);
+}
+
+/* vim: set et ts=2 sw=2: */
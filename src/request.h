@@ -0,0 +1,43 @@
+#ifndef _REQUEST_H
+#define _REQUEST_H
+
+#include <alpm.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "output.h"
+
+/* a query read in batch mode. Fields left NULL fall back to whatever was
+ * given on the command line. */
+typedef struct request_t {
+  char *format;
+  char *corpus;
+  char *search;
+  char *delim;
+  char *listdelim;
+  char *timefmt;
+  char *humansize;
+  char *filter;
+  char *sort;
+  char *limit;
+  char *groupby;
+  char *aggregate;
+  char *output;
+  bool readone;
+  bool reverse;
+  alpm_list_t *targets;
+
+  /* set if the request was malformed, describing the first problem */
+  char *error;
+} request_t;
+
+int request_read(FILE *in, request_t *req);
+void request_reset(request_t *req);
+int request_write(outbuf_t *out, const request_t *req);
+
+int response_write(outbuf_t *out, bool ok, size_t count, const char *payload,
+    size_t len);
+
+#endif  /* _REQUEST_H */
+
+/* vim: set et ts=2 sw=2: */
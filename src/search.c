@@ -0,0 +1,427 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "search.h"
+#include "util.h"
+
+#define ONES   UINT64_C(0x0101010101010101)
+#define HIGHS  UINT64_C(0x8080808080808080)
+
+static char fold(char c)
+{
+  return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+/* fold() on each byte of w at once */
+static inline uint64_t fold_word(uint64_t w)
+{
+  const uint64_t low = w & ~HIGHS;
+  const uint64_t from_a = low + ONES * (0x80 - 'A');
+  const uint64_t past_z = low + ONES * (0x80 - 'Z' - 1);
+
+  return w | ((from_a & ~past_z & ~w & HIGHS) >> 2);
+}
+
+static const char *skip_bracket(const char *p)
+{
+  /* p is on the opening '['. A ']' right after it, or after the '^', is a
+   * member rather than the end. */
+  ++p;
+  if(*p == '^') {
+    ++p;
+  }
+  if(*p == ']') {
+    ++p;
+  }
+
+  for(; *p; ++p) {
+    if(*p == ']') {
+      return p + 1;
+    }
+
+    /* [:class:], [.coll.] and [=equiv=] */
+    if(*p == '[' && (p[1] == ':' || p[1] == '.' || p[1] == '=')) {
+      char delim = p[1];
+      for(p += 2; *p && !(p[0] == delim && p[1] == ']'); ++p);
+      if(*p == '\0') {
+        return NULL;
+      }
+      ++p;
+    }
+  }
+
+  return NULL;
+}
+
+static const char *skip_group(const char *p)
+{
+  int depth = 0;
+
+  while(*p) {
+    switch (*p) {
+      case '\\':
+        if(p[1] == '\0') {
+          return NULL;
+        }
+        p += 2;
+        break;
+      case '[':
+        p = skip_bracket(p);
+        if(p == NULL) {
+          return NULL;
+        }
+        break;
+      case '(':
+        ++depth;
+        ++p;
+        break;
+      case ')':
+        ++p;
+        if(--depth == 0) {
+          return p;
+        }
+        break;
+      default:
+        ++p;
+        break;
+    }
+  }
+
+  return NULL;
+}
+
+/* the longest run of ordinary characters in an extended regex that nothing
+ * can match without. Anything the scan isn't sure of ends the run, so at
+ * worst a literal is missed, never made up. Only ASCII is taken, as that's
+ * all fold() knows the case of. */
+static int required_literal(const char *pattern, char **literal, size_t *len)
+{
+  size_t patlen = strlen(pattern), runlen = 0, bestlen = 0;
+  _cleanup_free_ char *run = NULL;
+  _cleanup_free_ char *best = NULL;
+  const char *p = pattern;
+
+  *literal = NULL;
+  *len = 0;
+
+  run = malloc(patlen + 1);
+  best = malloc(patlen + 1);
+  if(run == NULL || best == NULL) {
+    return -ENOMEM;
+  }
+
+#define END_RUN() do { \
+    if(runlen > bestlen) { \
+      memcpy(best, run, runlen); \
+      bestlen = runlen; \
+    } \
+    runlen = 0; \
+  } while(0)
+
+  while(*p) {
+    char c = *p;
+
+    switch (c) {
+      case '|':
+        /* either side might be the one that matches */
+        return 0;
+      case ')':
+        return 0;
+      case '(':
+        END_RUN();
+        p = skip_group(p);
+        if(p == NULL) {
+          return 0;
+        }
+        continue;
+      case '[':
+        END_RUN();
+        p = skip_bracket(p);
+        if(p == NULL) {
+          return 0;
+        }
+        continue;
+      case '*':
+      case '+':
+      case '?':
+      case '{': {
+        /* quantifiers may be stacked, and unless they're all + the
+         * character before might not be there at all */
+        bool optional = false;
+
+        for(; *p && strchr("*+?{", *p); ++p) {
+          if(*p == '+') {
+            continue;
+          }
+          optional = true;
+          if(*p == '{') {
+            p = strchr(p, '}');
+            if(p == NULL) {
+              return 0;
+            }
+          }
+        }
+
+        if(optional && runlen > 0) {
+          --runlen;
+        }
+        END_RUN();
+        continue;
+      }
+      case '.':
+      case '^':
+      case '$':
+        END_RUN();
+        ++p;
+        continue;
+      case '\\':
+        if(p[1] == '\0') {
+          return 0;
+        }
+        /* \w, \<, backreferences and the like */
+        if(strchr("^.[]$()|*+?{}\\", p[1]) == NULL) {
+          END_RUN();
+          p += 2;
+          continue;
+        }
+        c = p[1];
+        ++p;
+        break;
+    }
+
+    if((unsigned char)c < 0x20 || (unsigned char)c >= 0x80) {
+      END_RUN();
+    } else {
+      run[runlen++] = fold(c);
+    }
+    ++p;
+  }
+
+  END_RUN();
+
+#undef END_RUN
+
+  if(bestlen > 0) {
+    best[bestlen] = '\0';
+    *literal = best;
+    *len = bestlen;
+    best = NULL;
+  }
+
+  return 0;
+}
+
+int search_compile(search_t *search, alpm_list_t *targets)
+{
+  int r;
+
+  memset(search, 0, sizeof(*search));
+
+  search->terms = calloc(alpm_list_count(targets), sizeof(search_term_t));
+  if(search->terms == NULL && targets != NULL) {
+    return -ENOMEM;
+  }
+
+  for(alpm_list_t *i = targets; i; i = i->next) {
+    search_term_t *term = &search->terms[search->nterms];
+
+    if(i->data == NULL) {
+      continue;
+    }
+
+    term->target = i->data;
+    if(regcomp(&term->reg, term->target,
+          REG_EXTENDED | REG_NOSUB | REG_ICASE | REG_NEWLINE) != 0) {
+      search_reset(search);
+      return -EINVAL;
+    }
+    search->nterms++;
+
+    r = required_literal(term->target, &term->literal, &term->literal_len);
+    if(r < 0) {
+      search_reset(search);
+      return r;
+    }
+    search->prefilter |= term->literal != NULL;
+  }
+
+  return 0;
+}
+
+void search_reset(search_t *search)
+{
+  for(size_t i = 0; i < search->nterms; ++i) {
+    regfree(&search->terms[i].reg);
+    free(search->terms[i].literal);
+  }
+  free(search->terms);
+  free(search->folded);
+
+  memset(search, 0, sizeof(*search));
+}
+
+/* s, lowercased eight bytes at a time, and a newline */
+static int fold_append(search_t *search, size_t *len, const char *s)
+{
+  size_t n = strlen(s), i = 0;
+  char *dst;
+
+  if(*len + n + 1 > search->folded_capacity) {
+    size_t newcap = search->folded_capacity ? search->folded_capacity : 256;
+    char *ptr;
+
+    while(newcap < *len + n + 1) {
+      newcap *= 2;
+    }
+
+    ptr = realloc(search->folded, newcap);
+    if(ptr == NULL) {
+      return -ENOMEM;
+    }
+    search->folded = ptr;
+    search->folded_capacity = newcap;
+  }
+
+  dst = search->folded + *len;
+  for(; i + 8 <= n; i += 8) {
+    uint64_t w;
+    memcpy(&w, s + i, 8);
+    w = fold_word(w);
+    memcpy(dst + i, &w, 8);
+  }
+  for(; i < n; ++i) {
+    dst[i] = fold(s[i]);
+  }
+  *len += n;
+  search->folded[(*len)++] = '\n';
+
+  return 0;
+}
+
+/* everything a term's regex is run against, lowercased. A literal never
+ * holds a newline, so it can't be found straddling two fields. */
+static ssize_t fold_pkg(search_t *search, alpm_pkg_t *pkg)
+{
+  const char *name = alpm_pkg_get_name(pkg);
+  const char *desc = alpm_pkg_get_desc(pkg);
+  size_t len = 0;
+
+  if(name && fold_append(search, &len, name) < 0) {
+    return -ENOMEM;
+  }
+  if(desc && fold_append(search, &len, desc) < 0) {
+    return -ENOMEM;
+  }
+  for(alpm_list_t *i = alpm_pkg_get_provides(pkg); i; i = i->next) {
+    const alpm_depend_t *provide = i->data;
+    if(fold_append(search, &len, provide->name) < 0) {
+      return -ENOMEM;
+    }
+  }
+  for(alpm_list_t *i = alpm_pkg_get_groups(pkg); i; i = i->next) {
+    if(fold_append(search, &len, i->data) < 0) {
+      return -ENOMEM;
+    }
+  }
+
+  return len;
+}
+
+/* memmem, minus the setup that isn't worth it for haystacks as short as
+ * these */
+static bool contains(const char *hay, size_t len, const char *needle,
+    size_t needle_len)
+{
+  const char *end = hay + len - needle_len + 1;
+
+  if(needle_len > len) {
+    return false;
+  }
+
+  for(const char *p = hay; (p = memchr(p, needle[0], end - p)); ++p) {
+    if(memcmp(p + 1, needle + 1, needle_len - 1) == 0) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static bool term_match(const search_term_t *term, alpm_pkg_t *pkg,
+    const char *folded, ssize_t folded_len)
+{
+  const char *name = alpm_pkg_get_name(pkg);
+  const char *desc = alpm_pkg_get_desc(pkg);
+
+  if(name && strstr(name, term->target)) {
+    return true;
+  }
+
+  if(term->literal && folded_len >= 0 &&
+      !contains(folded, folded_len, term->literal, term->literal_len)) {
+    return false;
+  }
+
+  if(name && regexec(&term->reg, name, 0, NULL, 0) == 0) {
+    return true;
+  }
+  if(desc && regexec(&term->reg, desc, 0, NULL, 0) == 0) {
+    return true;
+  }
+  for(alpm_list_t *i = alpm_pkg_get_provides(pkg); i; i = i->next) {
+    const alpm_depend_t *provide = i->data;
+    if(regexec(&term->reg, provide->name, 0, NULL, 0) == 0) {
+      return true;
+    }
+  }
+  for(alpm_list_t *i = alpm_pkg_get_groups(pkg); i; i = i->next) {
+    if(regexec(&term->reg, i->data, 0, NULL, 0) == 0) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool search_match(search_t *search, alpm_pkg_t *pkg)
+{
+  /* without the folded fields, every term goes to its regex */
+  ssize_t folded_len = search->prefilter ? fold_pkg(search, pkg) : -1;
+
+  for(size_t i = 0; i < search->nterms; ++i) {
+    if(!term_match(&search->terms[i], pkg, search->folded, folded_len)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+alpm_list_t *search_db(search_t *search, alpm_db_t *db)
+{
+  alpm_list_t *results = NULL;
+  int usage = 0;
+
+  alpm_db_get_usage(db, &usage);
+  if(!(usage & ALPM_DB_USAGE_SEARCH)) {
+    return NULL;
+  }
+
+  /* no terms at all gives nothing, not everything */
+  if(search->nterms == 0) {
+    return NULL;
+  }
+
+  for(alpm_list_t *i = alpm_db_get_pkgcache(db); i; i = i->next) {
+    if(search_match(search, i->data)) {
+      results = alpm_list_add(results, i->data);
+    }
+  }
+
+  return results;
+}
+
+/* vim: set et ts=2 sw=2: */
@@ -0,0 +1,40 @@
+#ifndef _SEARCH_H
+#define _SEARCH_H
+
+#include <alpm.h>
+#include <regex.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct search_term_t {
+  const char *target;
+  regex_t reg;
+
+  /* lowercased, and contained in anything reg matches. NULL when nothing
+   * can be said for sure. */
+  char *literal;
+  size_t literal_len;
+} search_term_t;
+
+/* the targets of -s, compiled once. A package matches when each of them is
+ * found as is in its name, or as a regex in its name, description, provides
+ * or groups, just as alpm_db_search does it. */
+typedef struct search_t {
+  search_term_t *terms;
+  size_t nterms;
+  bool prefilter;
+
+  /* the fields of the package being looked at, lowercased, one per line */
+  char *folded;
+  size_t folded_capacity;
+} search_t;
+
+int search_compile(search_t *search, alpm_list_t *targets);
+void search_reset(search_t *search);
+
+bool search_match(search_t *search, alpm_pkg_t *pkg);
+alpm_list_t *search_db(search_t *search, alpm_db_t *db);
+
+#endif  /* _SEARCH_H */
+
+/* vim: set et ts=2 sw=2: */
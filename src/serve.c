@@ -0,0 +1,492 @@
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "serve.h"
+#include "util.h"
+
+/* DB updates come as a burst of events, wait for it to settle */
+#define RELOAD_DELAY_MS  250
+
+typedef struct client_t {
+  const server_t *server;
+  int fd;
+} client_t;
+
+typedef struct watch_t {
+  int fd;
+  int wd_root;
+  int wd_local;
+  int wd_sync;
+
+  int pending;
+  alpm_list_t *syncdbs;
+
+  /* when the pending reload is due, on the monotonic clock */
+  int64_t deadline_ms;
+} watch_t;
+
+static void *client_thread(void *arg)
+{
+  client_t *client = arg;
+
+  client->server->handle(client->server->ctx, client->fd);
+
+  close(client->fd);
+  free(client);
+
+  return NULL;
+}
+
+static int connect_unix(const char *path)
+{
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  int fd;
+
+  if(strlen(path) >= sizeof(addr.sun_path)) {
+    return -ENAMETOOLONG;
+  }
+  strcpy(addr.sun_path, path);
+
+  fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if(fd < 0) {
+    return -errno;
+  }
+
+  if(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    int r = -errno;
+    close(fd);
+    return r;
+  }
+
+  return fd;
+}
+
+/* a socket left behind by a server that's gone would make bind fail. Only
+ * that is removed: anything else at path, or a socket something still
+ * listens on, is left alone. */
+static int remove_stale_socket(const char *path)
+{
+  struct stat st;
+  int fd;
+
+  if(lstat(path, &st) < 0) {
+    return errno == ENOENT ? 0 : -errno;
+  }
+
+  if(!S_ISSOCK(st.st_mode)) {
+    return -EEXIST;
+  }
+
+  fd = connect_unix(path);
+  if(fd >= 0) {
+    close(fd);
+    return -EADDRINUSE;
+  }
+  if(fd != -ECONNREFUSED) {
+    return -EADDRINUSE;
+  }
+
+  if(unlink(path) < 0 && errno != ENOENT) {
+    return -errno;
+  }
+
+  return 0;
+}
+
+static int listen_unix(const char *path)
+{
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  int fd, r;
+
+  if(strlen(path) >= sizeof(addr.sun_path)) {
+    return -ENAMETOOLONG;
+  }
+  strcpy(addr.sun_path, path);
+
+  r = remove_stale_socket(path);
+  if(r < 0) {
+    return r;
+  }
+
+  fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if(fd < 0) {
+    return -errno;
+  }
+
+  if(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      listen(fd, SOMAXCONN) < 0) {
+    int r = -errno;
+    close(fd);
+    return r;
+  }
+
+  return fd;
+}
+
+static int64_t now_ms(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int add_watch(int fd, const char *dbpath, const char *subdir,
+    uint32_t mask)
+{
+  char path[PATH_MAX];
+
+  snprintf(path, sizeof(path), "%s/%s", dbpath, subdir);
+
+  return inotify_add_watch(fd, path, mask);
+}
+
+static int watch_init(watch_t *watch, const char *dbpath)
+{
+  memset(watch, 0, sizeof(*watch));
+
+  watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if(watch->fd < 0) {
+    return -errno;
+  }
+
+  /* pacman removes its lock when a transaction ends, which catches changes
+   * made inside of the per-package directories as well */
+  watch->wd_root = add_watch(watch->fd, dbpath, "", IN_DELETE);
+  watch->wd_local = add_watch(watch->fd, dbpath, "local",
+      IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO);
+  watch->wd_sync = add_watch(watch->fd, dbpath, "sync",
+      IN_CLOSE_WRITE | IN_DELETE | IN_MOVED_TO);
+
+  return 0;
+}
+
+static void watch_add_syncdb(watch_t *watch, const char *filename)
+{
+  const char *ext = strrchr(filename, '.');
+  char *name;
+
+  /* skip signatures, partial downloads and the like */
+  if(ext == NULL || ext == filename ||
+      (strcmp(ext, ".db") != 0 && strcmp(ext, ".files") != 0)) {
+    return;
+  }
+
+  name = strndup(filename, ext - filename);
+  if(name == NULL) {
+    return;
+  }
+
+  if(alpm_list_find_str(watch->syncdbs, name) != NULL) {
+    free(name);
+    return;
+  }
+
+  watch->syncdbs = alpm_list_add(watch->syncdbs, name);
+  watch->pending |= RELOAD_SYNC;
+}
+
+static void watch_read(watch_t *watch)
+{
+  char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+  for(;;) {
+    ssize_t len = read(watch->fd, buf, sizeof(buf));
+    if(len <= 0) {
+      break;
+    }
+
+    for(char *p = buf; p < buf + len;) {
+      const struct inotify_event *event = (const struct inotify_event *)p;
+      const char *name = event->len ? event->name : "";
+
+      if(event->mask & IN_Q_OVERFLOW) {
+        /* events were lost, so anything may have changed. A reload of the
+         * local DB starts over with a new handle, sync DBs and all. */
+        watch->pending |= RELOAD_LOCAL | RELOAD_SYNC;
+      } else if(event->wd == watch->wd_root && strcmp(name, "db.lck") == 0) {
+        watch->pending |= RELOAD_LOCAL;
+      } else if(event->wd == watch->wd_local) {
+        watch->pending |= RELOAD_LOCAL;
+      } else if(event->wd == watch->wd_sync) {
+        watch_add_syncdb(watch, name);
+      }
+
+      p += sizeof(struct inotify_event) + event->len;
+    }
+  }
+
+  /* counted from the first change, so that a steady stream of clients or
+   * events can't put it off forever */
+  if(watch->pending && watch->deadline_ms == 0) {
+    watch->deadline_ms = now_ms() + RELOAD_DELAY_MS;
+  }
+}
+
+/* how long poll may wait before the pending reload is due */
+static int watch_timeout(const watch_t *watch)
+{
+  int64_t left;
+
+  if(!watch->pending) {
+    return -1;
+  }
+
+  left = watch->deadline_ms - now_ms();
+
+  return left > 0 ? (int)left : 0;
+}
+
+static void watch_flush(watch_t *watch, const server_t *server)
+{
+  server->reload(server->ctx, watch->pending, watch->syncdbs);
+
+  alpm_list_free_inner(watch->syncdbs, free);
+  alpm_list_free(watch->syncdbs);
+  watch->syncdbs = NULL;
+  watch->pending = 0;
+  watch->deadline_ms = 0;
+}
+
+static void watch_reset(watch_t *watch)
+{
+  alpm_list_free_inner(watch->syncdbs, free);
+  alpm_list_free(watch->syncdbs);
+
+  if(watch->fd >= 0) {
+    close(watch->fd);
+  }
+}
+
+static int spawn_client(const server_t *server, int fd)
+{
+  pthread_attr_t attr;
+  pthread_t thread;
+  client_t *client;
+  int r;
+
+  client = malloc(sizeof(*client));
+  if(client == NULL) {
+    return -ENOMEM;
+  }
+
+  client->server = server;
+  client->fd = fd;
+
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  r = pthread_create(&thread, &attr, client_thread, client);
+  pthread_attr_destroy(&attr);
+
+  if(r != 0) {
+    free(client);
+    return -r;
+  }
+
+  return 0;
+}
+
+/* accepts clients on sockpath forever, handing each of them to a thread
+ * of its own, and tells the server when anything under dbpath changes */
+int server_run(const char *sockpath, const char *dbpath, const server_t *server)
+{
+  _cleanup_(watch_reset) watch_t watch;
+  struct pollfd fds[2];
+  int listenfd, r;
+
+  /* a client going away mid-response must not take the server with it */
+  signal(SIGPIPE, SIG_IGN);
+
+  r = watch_init(&watch, dbpath);
+  if(r < 0) {
+    fprintf(stderr, "warning: failed to watch %s for changes: %s\n", dbpath,
+        strerror(-r));
+  }
+
+  listenfd = listen_unix(sockpath);
+  if(listenfd < 0) {
+    fprintf(stderr, "error: failed to listen on %s: %s\n", sockpath,
+        strerror(-listenfd));
+    return listenfd;
+  }
+
+  fds[0] = (struct pollfd){ .fd = listenfd, .events = POLLIN };
+  fds[1] = (struct pollfd){ .fd = watch.fd, .events = POLLIN };
+
+  for(;;) {
+    int n;
+
+    n = poll(fds, 2, watch_timeout(&watch));
+    if(n < 0) {
+      if(errno == EINTR) {
+        continue;
+      }
+      r = -errno;
+      break;
+    }
+
+    if(n > 0 && (fds[1].revents & POLLIN)) {
+      watch_read(&watch);
+    }
+
+    if(watch.pending && watch_timeout(&watch) == 0) {
+      watch_flush(&watch, server);
+    }
+
+    if(n == 0) {
+      continue;
+    }
+
+    if(fds[0].revents & POLLIN) {
+      int fd = accept4(listenfd, NULL, NULL, SOCK_CLOEXEC);
+      if(fd < 0) {
+        continue;
+      }
+
+      if(spawn_client(server, fd) < 0) {
+        close(fd);
+      }
+    }
+  }
+
+  close(listenfd);
+
+  return r;
+}
+
+static int write_all(int fd, const char *buf, size_t len)
+{
+  while(len > 0) {
+    ssize_t n = write(fd, buf, len);
+    if(n < 0) {
+      if(errno == EINTR) {
+        continue;
+      }
+      return -errno;
+    }
+
+    buf += n;
+    len -= n;
+  }
+
+  return 0;
+}
+
+static int copy_payload(int from, int to, size_t len)
+{
+  char buf[65536];
+
+  while(len > 0) {
+    ssize_t n = read(from, buf, len < sizeof(buf) ? len : sizeof(buf));
+    if(n < 0) {
+      if(errno == EINTR) {
+        continue;
+      }
+      return -errno;
+    }
+    if(n == 0) {
+      return -EPIPE;
+    }
+
+    if(write_all(to, buf, n) < 0) {
+      return -errno;
+    }
+    len -= n;
+  }
+
+  return 0;
+}
+
+/* sends a single request to a server and copies its answer to stdout, or
+ * to stderr if it's an error. Returns 1 if the query had any results, 0 if
+ * it had none and -EREMOTEIO if the server reported an error. */
+int client_query(const char *sockpath, const char *request, size_t len)
+{
+  char header[64];
+  size_t hlen = 0;
+  size_t payload, count = 0;
+  bool ok;
+  int fd, r;
+
+  fd = connect_unix(sockpath);
+  if(fd < 0) {
+    fprintf(stderr, "error: failed to connect to %s: %s\n", sockpath,
+        strerror(-fd));
+    return fd;
+  }
+
+  r = write_all(fd, request, len);
+  if(r < 0) {
+    goto out;
+  }
+
+  /* no more requests on this connection */
+  shutdown(fd, SHUT_WR);
+
+  for(;;) {
+    ssize_t n = read(fd, &header[hlen], 1);
+    if(n < 0 && errno == EINTR) {
+      continue;
+    }
+    if(n <= 0 || hlen == sizeof(header) - 1) {
+      r = -EPROTO;
+      goto out;
+    }
+    if(header[hlen] == '\n') {
+      header[hlen] = '\0';
+      break;
+    }
+    ++hlen;
+  }
+
+  if(sscanf(header, "ok %zu %zu", &payload, &count) == 2) {
+    ok = true;
+  } else if(sscanf(header, "error %zu", &payload) == 1) {
+    ok = false;
+  } else {
+    r = -EPROTO;
+    goto out;
+  }
+
+  if(!ok) {
+    fputs("error: ", stderr);
+    fflush(stderr);
+  }
+
+  r = copy_payload(fd, ok ? STDOUT_FILENO : STDERR_FILENO, payload);
+  if(r < 0) {
+    goto out;
+  }
+
+  if(!ok) {
+    fputc('\n', stderr);
+    r = -EREMOTEIO;
+  } else {
+    r = count > 0;
+  }
+
+out:
+  if(r < 0 && r != -EREMOTEIO) {
+    fprintf(stderr, "error: failed to query %s: %s\n", sockpath, strerror(-r));
+  }
+
+  close(fd);
+
+  return r;
+}
+
+/* vim: set et ts=2 sw=2: */
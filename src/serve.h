@@ -0,0 +1,25 @@
+#ifndef _SERVE_H
+#define _SERVE_H
+
+#include <alpm.h>
+
+#define RELOAD_LOCAL  (1 << 0)
+#define RELOAD_SYNC   (1 << 1)
+
+typedef struct server_t {
+  /* answers requests on one client connection until it hangs up. Called
+   * on a thread of its own for each client. */
+  void (*handle)(void *ctx, int fd);
+
+  /* the local DB, and/or the named sync DBs, changed on disk */
+  void (*reload)(void *ctx, int what, alpm_list_t *syncdbs);
+
+  void *ctx;
+} server_t;
+
+int server_run(const char *sockpath, const char *dbpath, const server_t *server);
+int client_query(const char *sockpath, const char *request, size_t len);
+
+#endif  /* _SERVE_H */
+
+/* vim: set et ts=2 sw=2: */
@@ -0,0 +1,694 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hashmap.h"
+#include "snapshot.h"
+#include "util.h"
+
+#define SNAPSHOT_MAGIC  "expacsn1"
+#define SNAPSHOT_BOM    0x01020304u
+
+/* fields which are stored already rendered, either as a single string or as
+ * a list of them. Times and sizes depend on options given at query time and
+ * are kept as numbers. %N, %W and %M aren't properties of the package alone
+ * and can't be stored at all. */
+static char const str_tokens[] = "adefghinprsuvw";
+static char const num_tokens[] = "bklm";
+static char const list_tokens[] = "BCDEFGHJKLOoPRSTV";
+
+#define NSTR   (sizeof(str_tokens) - 1)
+#define NNUM   (sizeof(num_tokens) - 1)
+#define NLIST  (sizeof(list_tokens) - 1)
+
+struct snapshot_header_t {
+  char magic[8];
+  uint32_t bom;
+  uint32_t npkgs;
+
+  /* the DB this was built from */
+  uint64_t db_dev;
+  uint64_t db_ino;
+  uint64_t db_size;
+  int64_t db_mtime_ns;
+  uint64_t db_hash;
+
+  uint64_t pkgs_off;
+  uint64_t lists_off;
+  uint64_t nlists;
+  uint64_t buckets_off;
+  uint64_t nbuckets;
+  uint64_t strings_off;
+  uint64_t strings_len;
+};
+
+/* strings are offsets into the string table, where 0 is the empty string.
+ * Lists are indices into the list table, which holds a count followed by
+ * that many string offsets. Index 0 is the empty list. */
+struct snapshot_pkg_t {
+  int64_t num[NNUM];
+  uint32_t str[NSTR];
+  uint32_t list[NLIST];
+};
+
+typedef struct builder_t {
+  snapshot_pkg_t *pkgs;
+  size_t npkgs;
+
+  uint32_t *lists;
+  size_t nlists;
+  size_t lists_capacity;
+
+  outbuf_t strings;
+  hashmap_t interned;
+  char **keys;
+  size_t nkeys;
+  size_t keys_capacity;
+} builder_t;
+
+static size_t slot(const char *tokens, char token)
+{
+  return strchr(tokens, token) - tokens;
+}
+
+static size_t align8(size_t n)
+{
+  return (n + 7) & ~(size_t)7;
+}
+
+static int64_t stat_mtime_ns(const struct stat *st)
+{
+  return (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+}
+
+static int hash_file(const char *path, uint64_t *hash)
+{
+  struct stat st;
+  void *data;
+  int fd;
+
+  fd = open(path, O_RDONLY | O_CLOEXEC);
+  if(fd < 0) {
+    return -errno;
+  }
+
+  if(fstat(fd, &st) < 0) {
+    int r = -errno;
+    close(fd);
+    return r;
+  }
+
+  if(st.st_size == 0) {
+    close(fd);
+    *hash = hashmap_hash("", 0);
+    return 0;
+  }
+
+  data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(data == MAP_FAILED) {
+    return -errno;
+  }
+
+  *hash = hashmap_hash(data, st.st_size);
+  munmap(data, st.st_size);
+
+  return 0;
+}
+
+snapshot_field_t snapshot_field_type(char token)
+{
+  if(strchr(str_tokens, token) != NULL) {
+    return SNAPSHOT_FIELD_STR;
+  }
+  if(strchr(num_tokens, token) != NULL) {
+    return SNAPSHOT_FIELD_NUM;
+  }
+  if(strchr(list_tokens, token) != NULL) {
+    return SNAPSHOT_FIELD_LIST;
+  }
+
+  return SNAPSHOT_FIELD_NONE;
+}
+
+static bool region_fits(size_t len, uint64_t off, uint64_t count, size_t size)
+{
+  return off <= len && count <= (len - off) / size;
+}
+
+/* checks the header and that every table stays inside of the file. The
+ * offsets stored in packages and lists are checked as they're read. */
+static int snapshot_attach(snapshot_t *snap)
+{
+  const snapshot_header_t *h = snap->base;
+
+  if(snap->len < sizeof(*h) ||
+      memcmp(h->magic, SNAPSHOT_MAGIC, sizeof(h->magic)) != 0 ||
+      h->bom != SNAPSHOT_BOM) {
+    return -EINVAL;
+  }
+
+  if(!region_fits(snap->len, h->pkgs_off, h->npkgs, sizeof(snapshot_pkg_t)) ||
+      !region_fits(snap->len, h->lists_off, h->nlists, sizeof(uint32_t)) ||
+      !region_fits(snap->len, h->buckets_off, h->nbuckets, sizeof(uint32_t)) ||
+      !region_fits(snap->len, h->strings_off, h->strings_len, 1)) {
+    return -EINVAL;
+  }
+
+  if(h->nlists == 0 || h->strings_len == 0 || h->nbuckets <= h->npkgs ||
+      (h->nbuckets & (h->nbuckets - 1)) != 0) {
+    return -EINVAL;
+  }
+
+  snap->header = h;
+  snap->pkgs = (const snapshot_pkg_t *)((const char *)snap->base + h->pkgs_off);
+  snap->lists = (const uint32_t *)((const char *)snap->base + h->lists_off);
+  snap->buckets = (const uint32_t *)((const char *)snap->base + h->buckets_off);
+  snap->strings = (const char *)snap->base + h->strings_off;
+
+  /* every string ends inside of the table */
+  if(snap->strings[h->strings_len - 1] != '\0') {
+    return -EINVAL;
+  }
+
+  for(size_t i = 0; i < h->nbuckets; ++i) {
+    if(snap->buckets[i] > h->npkgs) {
+      return -EINVAL;
+    }
+  }
+
+  return 0;
+}
+
+static int snapshot_map(snapshot_t *snap, const char *filename)
+{
+  struct stat st;
+  int fd, r;
+
+  fd = open(filename, O_RDONLY | O_CLOEXEC);
+  if(fd < 0) {
+    return -errno;
+  }
+
+  if(fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(snapshot_header_t)) {
+    close(fd);
+    return -EINVAL;
+  }
+
+  snap->base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(snap->base == MAP_FAILED) {
+    snap->base = NULL;
+    return -errno;
+  }
+
+  snap->len = st.st_size;
+  snap->mapped = true;
+
+  r = snapshot_attach(snap);
+  if(r < 0) {
+    snapshot_reset(snap);
+    return r;
+  }
+
+  return 0;
+}
+
+static bool snapshot_matches(const snapshot_t *snap, const struct stat *st)
+{
+  const snapshot_header_t *h = snap->header;
+
+  return h->db_dev == (uint64_t)st->st_dev &&
+    h->db_ino == (uint64_t)st->st_ino &&
+    h->db_size == (uint64_t)st->st_size &&
+    h->db_mtime_ns == stat_mtime_ns(st);
+}
+
+/* the DB was replaced by an identical copy. Keep the snapshot, but record
+ * the new file so it isn't hashed again on the next run. */
+static int snapshot_touch(const char *filename, const struct stat *st)
+{
+  const size_t off = offsetof(snapshot_header_t, db_dev);
+  snapshot_header_t h;
+  ssize_t n;
+  int fd;
+
+  fd = open(filename, O_WRONLY | O_CLOEXEC);
+  if(fd < 0) {
+    return -errno;
+  }
+
+  h.db_dev = st->st_dev;
+  h.db_ino = st->st_ino;
+  h.db_size = st->st_size;
+  h.db_mtime_ns = stat_mtime_ns(st);
+
+  n = pwrite(fd, (char *)&h + off, offsetof(snapshot_header_t, db_hash) - off,
+      off);
+  close(fd);
+
+  return n < 0 ? -errno : 0;
+}
+
+static void builder_reset(builder_t *b)
+{
+  for(size_t i = 0; i < b->nkeys; ++i) {
+    free(b->keys[i]);
+  }
+
+  free(b->keys);
+  free(b->pkgs);
+  free(b->lists);
+  outbuf_reset(&b->strings);
+  hashmap_reset(&b->interned);
+}
+
+static int builder_add_list_item(builder_t *b, uint32_t value)
+{
+  if(b->nlists == b->lists_capacity) {
+    void *ptr;
+    const size_t newcap = b->lists_capacity ? b->lists_capacity * 2 : 1024;
+
+    ptr = realloc(b->lists, newcap * sizeof(uint32_t));
+    if(ptr == NULL) {
+      return -ENOMEM;
+    }
+
+    b->lists = ptr;
+    b->lists_capacity = newcap;
+  }
+
+  b->lists[b->nlists++] = value;
+
+  return 0;
+}
+
+static int builder_intern(builder_t *b, const char *str, uint32_t *offset)
+{
+  const size_t len = strlen(str);
+  void *found;
+  char *key;
+  size_t off;
+  int r;
+
+  found = hashmap_get(&b->interned, str);
+  if(found != NULL) {
+    *offset = (uintptr_t)found;
+    return 0;
+  }
+
+  off = b->strings.len;
+  if(off + len + 1 > UINT32_MAX) {
+    return -EFBIG;
+  }
+
+  outbuf_write(&b->strings, str, len + 1);
+  if(b->strings.error < 0) {
+    return b->strings.error;
+  }
+
+  if(b->nkeys == b->keys_capacity) {
+    void *ptr;
+    const size_t newcap = b->keys_capacity ? b->keys_capacity * 2 : 1024;
+
+    ptr = realloc(b->keys, newcap * sizeof(char *));
+    if(ptr == NULL) {
+      return -ENOMEM;
+    }
+
+    b->keys = ptr;
+    b->keys_capacity = newcap;
+  }
+
+  key = strdup(str);
+  if(key == NULL) {
+    return -ENOMEM;
+  }
+  b->keys[b->nkeys++] = key;
+
+  /* offsets start past the empty string, so they're never NULL */
+  r = hashmap_put(&b->interned, key, (void *)(uintptr_t)off);
+  if(r < 0) {
+    return r;
+  }
+
+  *offset = off;
+
+  return 0;
+}
+
+/* rendered lists come with a NUL between each element */
+static int builder_add_list(builder_t *b, char *rendered, size_t len,
+    uint32_t *index)
+{
+  size_t start, count = 1;
+  int r;
+
+  if(len == 0) {
+    *index = 0;
+    return 0;
+  }
+
+  for(size_t i = 0; i < len; ++i) {
+    count += rendered[i] == '\0';
+  }
+
+  start = b->nlists;
+  if(start + count + 1 > UINT32_MAX) {
+    return -EFBIG;
+  }
+
+  r = builder_add_list_item(b, count);
+  for(char *item = rendered; r == 0 && item <= rendered + len;
+      item += strlen(item) + 1) {
+    uint32_t off;
+
+    r = builder_intern(b, item, &off);
+    if(r == 0) {
+      r = builder_add_list_item(b, off);
+    }
+  }
+  if(r < 0) {
+    return r;
+  }
+
+  *index = start;
+
+  return 0;
+}
+
+static int builder_add_pkg(builder_t *b, alpm_pkg_t *pkg,
+    const format_t *formats, outbuf_t *out, snapshot_render_fn render)
+{
+  snapshot_pkg_t *rec = &b->pkgs[b->npkgs++];
+  int r;
+
+  for(size_t i = 0; i < NSTR + NLIST; ++i) {
+    out->len = 0;
+    render(out, pkg, &formats[i]);
+    outbuf_putc(out, '\0');
+    if(out->error < 0) {
+      return out->error;
+    }
+
+    if(i < NSTR) {
+      r = builder_intern(b, out->buf, &rec->str[i]);
+    } else {
+      r = builder_add_list(b, out->buf, out->len - 1, &rec->list[i - NSTR]);
+    }
+    if(r < 0) {
+      return r;
+    }
+  }
+
+  rec->num[slot(num_tokens, 'b')] = alpm_pkg_get_builddate(pkg);
+  rec->num[slot(num_tokens, 'l')] = alpm_pkg_get_installdate(pkg);
+  rec->num[slot(num_tokens, 'k')] = alpm_pkg_get_size(pkg);
+  rec->num[slot(num_tokens, 'm')] = alpm_pkg_get_isize(pkg);
+
+  return 0;
+}
+
+static int builder_run(builder_t *b, alpm_db_t *db, snapshot_render_fn render)
+{
+  format_t formats[NSTR + NLIST];
+  _cleanup_(outbuf_reset) outbuf_t out;
+  alpm_list_t *pkgcache;
+  size_t nformats = 0;
+  int r;
+
+  memset(&out, 0, sizeof(out));
+
+  pkgcache = alpm_db_get_pkgcache(db);
+
+  b->pkgs = calloc(alpm_list_count(pkgcache) + 1, sizeof(snapshot_pkg_t));
+  if(b->pkgs == NULL) {
+    return -ENOMEM;
+  }
+
+  r = outbuf_init(&b->strings, -1, 0);
+  if(r < 0) {
+    return r;
+  }
+
+  r = hashmap_init(&b->interned, 0);
+  if(r < 0) {
+    return r;
+  }
+
+  r = outbuf_init(&out, -1, 0);
+  if(r < 0) {
+    return r;
+  }
+
+  /* the empty string and the empty list */
+  outbuf_putc(&b->strings, '\0');
+  r = builder_add_list_item(b, 0);
+  if(r < 0) {
+    return r;
+  }
+
+  /* each field alone, with list elements split by NUL */
+  for(; nformats < NSTR + NLIST; ++nformats) {
+    char fmt[3] = { '%', 0, 0 };
+
+    fmt[1] = nformats < NSTR ? str_tokens[nformats] :
+      list_tokens[nformats - NSTR];
+
+    r = format_compile(&formats[nformats], fmt, "", "\\0");
+    if(r < 0) {
+      goto out;
+    }
+  }
+
+  for(alpm_list_t *i = pkgcache; i; i = i->next) {
+    r = builder_add_pkg(b, i->data, formats, &out, render);
+    if(r < 0) {
+      goto out;
+    }
+  }
+
+out:
+  for(size_t i = 0; i < nformats; ++i) {
+    format_reset(&formats[i]);
+  }
+
+  return r;
+}
+
+static int snapshot_layout(snapshot_t *snap, const builder_t *b,
+    const struct stat *st, uint64_t db_hash)
+{
+  snapshot_header_t *h;
+  uint32_t *buckets;
+  size_t nbuckets = 16, len;
+
+  while(nbuckets < b->npkgs * 2) {
+    nbuckets *= 2;
+  }
+
+  len = align8(sizeof(*h));
+  len += align8(b->npkgs * sizeof(snapshot_pkg_t));
+  len += align8(b->nlists * sizeof(uint32_t));
+  len += align8(nbuckets * sizeof(uint32_t));
+  len += b->strings.len;
+
+  snap->base = calloc(1, len);
+  if(snap->base == NULL) {
+    return -ENOMEM;
+  }
+  snap->len = len;
+  snap->mapped = false;
+
+  h = snap->base;
+  memcpy(h->magic, SNAPSHOT_MAGIC, sizeof(h->magic));
+  h->bom = SNAPSHOT_BOM;
+  h->npkgs = b->npkgs;
+  h->db_dev = st->st_dev;
+  h->db_ino = st->st_ino;
+  h->db_size = st->st_size;
+  h->db_mtime_ns = stat_mtime_ns(st);
+  h->db_hash = db_hash;
+
+  h->pkgs_off = align8(sizeof(*h));
+  h->lists_off = h->pkgs_off + align8(b->npkgs * sizeof(snapshot_pkg_t));
+  h->nlists = b->nlists;
+  h->buckets_off = h->lists_off + align8(b->nlists * sizeof(uint32_t));
+  h->nbuckets = nbuckets;
+  h->strings_off = h->buckets_off + align8(nbuckets * sizeof(uint32_t));
+  h->strings_len = b->strings.len;
+
+  memcpy((char *)snap->base + h->pkgs_off, b->pkgs,
+      b->npkgs * sizeof(snapshot_pkg_t));
+  memcpy((char *)snap->base + h->lists_off, b->lists,
+      b->nlists * sizeof(uint32_t));
+  memcpy((char *)snap->base + h->strings_off, b->strings.buf,
+      b->strings.len);
+
+  /* names, hashed into buckets holding the package's index plus one */
+  buckets = (uint32_t *)((char *)snap->base + h->buckets_off);
+  for(size_t i = 0; i < b->npkgs; ++i) {
+    const char *name = b->strings.buf + b->pkgs[i].str[slot(str_tokens, 'n')];
+    size_t k = hashmap_hash(name, strlen(name)) & (nbuckets - 1);
+
+    while(buckets[k] != 0) {
+      k = (k + 1) & (nbuckets - 1);
+    }
+    buckets[k] = i + 1;
+  }
+
+  return snapshot_attach(snap);
+}
+
+static int snapshot_build(snapshot_t *snap, alpm_db_t *db, const char *dbfile,
+    const struct stat *st, snapshot_render_fn render)
+{
+  builder_t b;
+  uint64_t db_hash;
+  int r;
+
+  memset(&b, 0, sizeof(b));
+
+  r = hash_file(dbfile, &db_hash);
+  if(r < 0) {
+    return r;
+  }
+
+  r = builder_run(&b, db, render);
+  if(r == 0) {
+    r = snapshot_layout(snap, &b, st, db_hash);
+  }
+
+  builder_reset(&b);
+
+  return r;
+}
+
+/* maps the snapshot of db from cachefile, rebuilding it first if dbfile has
+ * changed since. A snapshot that can't be saved is still usable. */
+int snapshot_open(snapshot_t *snap, alpm_db_t *db, const char *dbfile,
+    const char *cachefile, snapshot_render_fn render)
+{
+  struct stat st;
+  int r;
+
+  memset(snap, 0, sizeof(*snap));
+
+  if(stat(dbfile, &st) < 0) {
+    return -errno;
+  }
+
+  if(snapshot_map(snap, cachefile) == 0) {
+    uint64_t db_hash;
+
+    if(snapshot_matches(snap, &st)) {
+      return 0;
+    }
+
+    /* a DB that was downloaded again without changing can be kept */
+    if(snap->header->db_size == (uint64_t)st.st_size &&
+        hash_file(dbfile, &db_hash) == 0 && db_hash == snap->header->db_hash) {
+      snapshot_touch(cachefile, &st);
+      return 0;
+    }
+
+    snapshot_reset(snap);
+  }
+
+  r = snapshot_build(snap, db, dbfile, &st, render);
+  if(r < 0) {
+    snapshot_reset(snap);
+    return r;
+  }
+
+  write_file_atomic(cachefile, snap->base, snap->len);
+
+  return 0;
+}
+
+void snapshot_reset(snapshot_t *snap)
+{
+  if(snap == NULL) {
+    return;
+  }
+
+  if(snap->mapped) {
+    munmap(snap->base, snap->len);
+  } else {
+    free(snap->base);
+  }
+
+  memset(snap, 0, sizeof(*snap));
+}
+
+size_t snapshot_count(const snapshot_t *snap)
+{
+  return snap->header->npkgs;
+}
+
+ssize_t snapshot_find(const snapshot_t *snap, const char *name)
+{
+  const size_t mask = snap->header->nbuckets - 1;
+  const size_t name_slot = slot(str_tokens, 'n');
+  size_t k = hashmap_hash(name, strlen(name)) & mask;
+
+  for(size_t probes = 0; probes <= mask; ++probes, k = (k + 1) & mask) {
+    uint32_t b = snap->buckets[k];
+
+    if(b == 0) {
+      break;
+    }
+
+    if(strcmp(snapshot_string(snap, snap->pkgs[b - 1].str[name_slot]),
+          name) == 0) {
+      return b - 1;
+    }
+  }
+
+  return -1;
+}
+
+const char *snapshot_get_str(const snapshot_t *snap, size_t pkg, char token)
+{
+  return snapshot_string(snap, snap->pkgs[pkg].str[slot(str_tokens, token)]);
+}
+
+int64_t snapshot_get_num(const snapshot_t *snap, size_t pkg, char token)
+{
+  return snap->pkgs[pkg].num[slot(num_tokens, token)];
+}
+
+/* returns the number of elements in the list, pointing items at their
+ * string offsets. A list running past the table is read as empty. */
+size_t snapshot_get_list(const snapshot_t *snap, size_t pkg, char token,
+    const uint32_t **items)
+{
+  const uint64_t idx = snap->pkgs[pkg].list[slot(list_tokens, token)];
+  const uint64_t nlists = snap->header->nlists;
+
+  if(idx >= nlists || snap->lists[idx] > nlists - idx - 1) {
+    *items = snap->lists;
+    return 0;
+  }
+
+  *items = &snap->lists[idx + 1];
+
+  return snap->lists[idx];
+}
+
+/* an offset outside of the string table reads as the empty string */
+const char *snapshot_string(const snapshot_t *snap, uint32_t offset)
+{
+  if(offset >= snap->header->strings_len) {
+    return "";
+  }
+
+  return snap->strings + offset;
+}
+
+/* vim: set et ts=2 sw=2: */
@@ -0,0 +1,57 @@
+#ifndef _SNAPSHOT_H
+#define _SNAPSHOT_H
+
+#include <alpm.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "format.h"
+#include "output.h"
+
+/* prints pkg to out according to format, exactly as a query would */
+typedef void (*snapshot_render_fn)(outbuf_t *out, alpm_pkg_t *pkg,
+    const format_t *format);
+
+typedef enum snapshot_field_t {
+  SNAPSHOT_FIELD_NONE,
+  SNAPSHOT_FIELD_STR,
+  SNAPSHOT_FIELD_NUM,
+  SNAPSHOT_FIELD_LIST,
+} snapshot_field_t;
+
+typedef struct snapshot_header_t snapshot_header_t;
+typedef struct snapshot_pkg_t snapshot_pkg_t;
+
+/* a sync DB with every field already rendered, mapped from a file which is
+ * rebuilt whenever the DB changes */
+typedef struct snapshot_t {
+  void *base;
+  size_t len;
+  bool mapped;
+
+  const snapshot_header_t *header;
+  const snapshot_pkg_t *pkgs;
+  const uint32_t *lists;
+  const uint32_t *buckets;
+  const char *strings;
+} snapshot_t;
+
+snapshot_field_t snapshot_field_type(char token);
+
+int snapshot_open(snapshot_t *snap, alpm_db_t *db, const char *dbfile,
+    const char *cachefile, snapshot_render_fn render);
+void snapshot_reset(snapshot_t *snap);
+
+size_t snapshot_count(const snapshot_t *snap);
+ssize_t snapshot_find(const snapshot_t *snap, const char *name);
+
+const char *snapshot_get_str(const snapshot_t *snap, size_t pkg, char token);
+int64_t snapshot_get_num(const snapshot_t *snap, size_t pkg, char token);
+size_t snapshot_get_list(const snapshot_t *snap, size_t pkg, char token,
+    const uint32_t **items);
+const char *snapshot_string(const snapshot_t *snap, uint32_t offset);
+
+#endif  /* _SNAPSHOT_H */
+
+/* vim: set et ts=2 sw=2: */
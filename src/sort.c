@@ -0,0 +1,244 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sort.h"
+#include "util.h"
+
+/* a field's value as it's compared, extracted once per package */
+typedef union sort_value_t {
+  const char *str;
+  int64_t num;
+} sort_value_t;
+
+typedef struct sort_keys_t {
+  const sort_t *sort;
+  const sort_value_t *values;
+} sort_keys_t;
+
+int sort_compile(sort_t *sort, const char *fields, bool reverse, size_t limit,
+    const char **unknown, size_t *unknown_len)
+{
+  memset(sort, 0, sizeof(*sort));
+  sort->reverse = reverse;
+  sort->limit = limit;
+
+  for(const char *p = fields; p && *p; ) {
+    const size_t len = strcspn(p, ",");
+    const field_t *field = field_lookup(p, len);
+    const field_t **grown;
+
+    if(field == NULL) {
+      *unknown = p;
+      *unknown_len = len;
+      sort_reset(sort);
+      return -EINVAL;
+    }
+
+    grown = realloc(sort->fields, (sort->nfields + 1) * sizeof(field_t *));
+    if(grown == NULL) {
+      sort_reset(sort);
+      return -ENOMEM;
+    }
+    sort->fields = grown;
+    sort->fields[sort->nfields++] = field;
+    sort->deferred |= field->deferred;
+
+    p += len;
+    if(*p == ',') {
+      ++p;
+    }
+  }
+
+  return 0;
+}
+
+void sort_reset(sort_t *sort)
+{
+  free(sort->fields);
+  memset(sort, 0, sizeof(*sort));
+}
+
+bool sort_has_token(const sort_t *sort, char token)
+{
+  for(size_t k = 0; k < sort->nfields; ++k) {
+    if(sort->fields[k]->token == token) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static int value_cmp(const field_t *field, const sort_value_t *a,
+    const sort_value_t *b)
+{
+  switch (field->type) {
+    case FIELD_STR:
+      return strcmp(a->str, b->str);
+    case FIELD_VERSION:
+      return alpm_pkg_vercmp(a->str, b->str);
+    default:
+      return (a->num > b->num) - (a->num < b->num);
+  }
+}
+
+/* packages which compare equal stay in the order they were found in, even
+ * when reversed */
+static int row_cmp(const void *a, const void *b, void *arg)
+{
+  const sort_keys_t *keys = arg;
+  const sort_t *sort = keys->sort;
+  const uint32_t ra = *(const uint32_t *)a, rb = *(const uint32_t *)b;
+  const sort_value_t *va = keys->values + (size_t)ra * sort->nfields;
+  const sort_value_t *vb = keys->values + (size_t)rb * sort->nfields;
+
+  for(size_t k = 0; k < sort->nfields; ++k) {
+    int cmp = value_cmp(sort->fields[k], &va[k], &vb[k]);
+    if(cmp != 0) {
+      return sort->reverse ? -cmp : cmp;
+    }
+  }
+
+  return (ra > rb) - (ra < rb);
+}
+
+static void extract(const sort_t *sort, alpm_pkg_t *pkg, field_get_fn get,
+    void *ctx, sort_value_t *values)
+{
+  for(size_t k = 0; k < sort->nfields; ++k) {
+    const field_t *field = sort->fields[k];
+    field_value_t value;
+
+    memset(&value, 0, sizeof(value));
+    get(ctx, pkg, field, &value);
+
+    switch (field->type) {
+      case FIELD_STR:
+      case FIELD_VERSION:
+        values[k].str = value.str ? value.str : "";
+        break;
+      case FIELD_LIST:
+        /* lists go by their length, as they do in filters */
+        values[k].num = alpm_list_count(value.list);
+        break;
+      default:
+        values[k].num = value.num;
+        break;
+    }
+
+    field_value_reset(&value);
+  }
+}
+
+/* keeps the best limit rows in a heap with the worst of them on top, so
+ * that each row costs at most one comparison once the heap is full and
+ * doesn't beat the worst */
+static size_t select_rows(uint32_t *heap, size_t count, size_t limit,
+    sort_keys_t *keys)
+{
+  size_t size = 0;
+
+  for(uint32_t row = 0; row < count; ++row) {
+    size_t i;
+
+    if(size < limit) {
+      /* sift up */
+      for(i = size++; i > 0; i = (i - 1) / 2) {
+        const size_t parent = (i - 1) / 2;
+        if(row_cmp(&heap[parent], &row, keys) >= 0) {
+          break;
+        }
+        heap[i] = heap[parent];
+      }
+      heap[i] = row;
+      continue;
+    }
+
+    if(row_cmp(&row, &heap[0], keys) >= 0) {
+      continue;
+    }
+
+    /* sift down from the root */
+    for(i = 0;;) {
+      size_t child = 2 * i + 1;
+
+      if(child >= size) {
+        break;
+      }
+      if(child + 1 < size && row_cmp(&heap[child + 1], &heap[child], keys) > 0) {
+        ++child;
+      }
+      if(row_cmp(&heap[child], &row, keys) <= 0) {
+        break;
+      }
+      heap[i] = heap[child];
+      i = child;
+    }
+    heap[i] = row;
+  }
+
+  return size;
+}
+
+int sort_results(const sort_t *sort, alpm_list_t **results, field_get_fn get,
+    void *ctx)
+{
+  _cleanup_free_ alpm_pkg_t **pkgs = NULL;
+  _cleanup_free_ sort_value_t *values = NULL;
+  _cleanup_free_ uint32_t *rows = NULL;
+  sort_keys_t keys = { .sort = sort };
+  size_t count = alpm_list_count(*results), n = 0;
+  alpm_list_t *sorted = NULL;
+
+  if(sort->nfields == 0) {
+    /* nothing to order by, so the first few will do */
+    if(sort->limit > 0 && sort->limit < count) {
+      for(alpm_list_t *i = *results; n < sort->limit; i = i->next, ++n) {
+        sorted = alpm_list_add(sorted, i->data);
+      }
+      alpm_list_free(*results);
+      *results = sorted;
+    }
+    return 0;
+  }
+
+  if(count > UINT32_MAX) {
+    return -E2BIG;
+  }
+
+  pkgs = malloc(count * sizeof(alpm_pkg_t *));
+  values = malloc(count * sort->nfields * sizeof(sort_value_t));
+  rows = malloc(count * sizeof(uint32_t));
+  if(count > 0 && (pkgs == NULL || values == NULL || rows == NULL)) {
+    return -ENOMEM;
+  }
+  keys.values = values;
+
+  for(alpm_list_t *i = *results; i; i = i->next, ++n) {
+    pkgs[n] = i->data;
+    extract(sort, pkgs[n], get, ctx, values + n * sort->nfields);
+  }
+
+  if(sort->limit > 0 && sort->limit < count) {
+    count = select_rows(rows, count, sort->limit, &keys);
+  } else {
+    for(uint32_t row = 0; row < count; ++row) {
+      rows[row] = row;
+    }
+  }
+
+  qsort_r(rows, count, sizeof(uint32_t), row_cmp, &keys);
+
+  for(size_t i = 0; i < count; ++i) {
+    sorted = alpm_list_add(sorted, pkgs[rows[i]]);
+  }
+
+  alpm_list_free(*results);
+  *results = sorted;
+
+  return 0;
+}
+
+/* vim: set et ts=2 sw=2: */
@@ -0,0 +1,35 @@
+#ifndef _SORT_H
+#define _SORT_H
+
+#include <alpm.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "field.h"
+
+/* the order to print results in, and how many of them */
+typedef struct sort_t {
+  const field_t **fields;
+  size_t nfields;
+  bool reverse;
+
+  /* 0 for no limit */
+  size_t limit;
+
+  /* whether any of the fields is deferred */
+  bool deferred;
+} sort_t;
+
+int sort_compile(sort_t *sort, const char *fields, bool reverse, size_t limit,
+    const char **unknown, size_t *unknown_len);
+void sort_reset(sort_t *sort);
+bool sort_has_token(const sort_t *sort, char token);
+
+/* orders results, keeping only the first limit of them. The list is
+ * consumed, and the sorted one returned. */
+int sort_results(const sort_t *sort, alpm_list_t **results, field_get_fn get,
+    void *ctx);
+
+#endif  /* _SORT_H */
+
+/* vim: set et ts=2 sw=2: */
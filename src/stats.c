@@ -0,0 +1,168 @@
+#include <errno.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "output.h"
+#include "stats.h"
+
+static const char *phase_names[_STATS_PHASE_MAX] = {
+  [STATS_CONFIG_PARSE] = "config_parse",
+  [STATS_ALPM_INITIALIZE] = "alpm_initialize",
+  [STATS_REGISTER_SYNCDBS] = "register_syncdbs",
+  [STATS_SEARCH] = "search",
+  [STATS_PREPARE] = "prepare",
+  [STATS_FORMAT] = "format",
+  [STATS_OUTPUT] = "output",
+};
+
+static stats_clock_t phases[_STATS_PHASE_MAX];
+
+/* tokens are printed from several threads at once */
+static uint64_t token_calls[128];
+static uint64_t token_ns[128];
+
+static size_t total_packages;
+static size_t total_bytes;
+
+static uint64_t clock_ns(clockid_t id)
+{
+  struct timespec ts;
+
+  if(clock_gettime(id, &ts) < 0) {
+    return 0;
+  }
+
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+uint64_t stats_now(void)
+{
+  return clock_ns(CLOCK_MONOTONIC);
+}
+
+uint64_t stats_thread_cpu(void)
+{
+  return clock_ns(CLOCK_THREAD_CPUTIME_ID);
+}
+
+stats_clock_t stats_start(void)
+{
+  return (stats_clock_t){ stats_now(), clock_ns(CLOCK_PROCESS_CPUTIME_ID) };
+}
+
+void stats_stop(stats_phase_t phase, stats_clock_t start)
+{
+  const stats_clock_t now = stats_start();
+
+  phases[phase].wall += now.wall - start.wall;
+  phases[phase].cpu += now.cpu - start.cpu;
+}
+
+/* for time that was counted towards one phase, but belongs to another */
+void stats_move(stats_phase_t from, stats_phase_t to, stats_clock_t spent)
+{
+  phases[from].wall -= spent.wall;
+  phases[from].cpu -= spent.cpu;
+  phases[to].wall += spent.wall;
+  phases[to].cpu += spent.cpu;
+}
+
+void stats_token(char token, uint64_t ns)
+{
+  const unsigned char t = token & 0x7f;
+
+  __atomic_fetch_add(&token_calls[t], 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&token_ns[t], ns, __ATOMIC_RELAXED);
+}
+
+void stats_results(size_t packages, size_t bytes)
+{
+  total_packages += packages;
+  total_bytes += bytes;
+}
+
+static long peak_rss(void)
+{
+  struct rusage usage;
+
+  if(getrusage(RUSAGE_SELF, &usage) < 0) {
+    return 0;
+  }
+
+  /* in KiB on Linux */
+  return usage.ru_maxrss;
+}
+
+static void report_text(outbuf_t *out)
+{
+  outbuf_printf(out, "%-18s %12s %12s\n", "phase", "wall (ms)", "cpu (ms)");
+  for(int i = 0; i < _STATS_PHASE_MAX; ++i) {
+    outbuf_printf(out, "%-18s %12.3f %12.3f\n", phase_names[i],
+        phases[i].wall / 1e6, phases[i].cpu / 1e6);
+  }
+
+  outbuf_printf(out, "\n%-18s %12s %12s\n", "token", "calls", "wall (ms)");
+  for(int t = 0; t < 128; ++t) {
+    if(token_calls[t] > 0) {
+      outbuf_printf(out, "%%%-17c %12ju %12.3f\n", t,
+          (uintmax_t)token_calls[t], token_ns[t] / 1e6);
+    }
+  }
+
+  outbuf_printf(out, "\n%-18s %12zu\n", "packages", total_packages);
+  outbuf_printf(out, "%-18s %12zu\n", "bytes", total_bytes);
+  outbuf_printf(out, "%-18s %12ld\n", "peak rss (KiB)", peak_rss());
+}
+
+/* in integers, which don't depend on the locale */
+static void report_json(outbuf_t *out)
+{
+  const char *sep = "";
+
+  outbuf_puts(out, "{\"phases\":{");
+  for(int i = 0; i < _STATS_PHASE_MAX; ++i) {
+    outbuf_printf(out, "%s\"%s\":{\"wall_ns\":%ju,\"cpu_ns\":%ju}",
+        i ? "," : "", phase_names[i], (uintmax_t)phases[i].wall,
+        (uintmax_t)phases[i].cpu);
+  }
+
+  /* tokens are all letters, or '!', so need no escaping */
+  outbuf_puts(out, "},\"tokens\":{");
+  for(int t = 0; t < 128; ++t) {
+    if(token_calls[t] > 0) {
+      outbuf_printf(out, "%s\"%c\":{\"calls\":%ju,\"wall_ns\":%ju}", sep, t,
+          (uintmax_t)token_calls[t], (uintmax_t)token_ns[t]);
+      sep = ",";
+    }
+  }
+
+  outbuf_printf(out, "},\"packages\":%zu,\"bytes\":%zu,\"peak_rss_kib\":%ld}\n",
+      total_packages, total_bytes, peak_rss());
+}
+
+int stats_report(int fd, bool json)
+{
+  outbuf_t out;
+  int r;
+
+  r = outbuf_init(&out, fd, 0);
+  if(r < 0) {
+    return r;
+  }
+
+  if(json) {
+    report_json(&out);
+  } else {
+    report_text(&out);
+  }
+
+  r = outbuf_flush(&out);
+  if(r == 0 && out.error < 0) {
+    r = out.error;
+  }
+  outbuf_reset(&out);
+
+  return r;
+}
+
+/* vim: set et ts=2 sw=2: */
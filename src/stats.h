@@ -0,0 +1,39 @@
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum stats_phase_t {
+  STATS_CONFIG_PARSE,
+  STATS_ALPM_INITIALIZE,
+  STATS_REGISTER_SYNCDBS,
+  STATS_SEARCH,
+  STATS_PREPARE,
+  STATS_FORMAT,
+  STATS_OUTPUT,
+  _STATS_PHASE_MAX,
+} stats_phase_t;
+
+/* nanoseconds of wall clock and of CPU time */
+typedef struct stats_clock_t {
+  uint64_t wall;
+  uint64_t cpu;
+} stats_clock_t;
+
+uint64_t stats_now(void);
+uint64_t stats_thread_cpu(void);
+
+stats_clock_t stats_start(void);
+void stats_stop(stats_phase_t phase, stats_clock_t start);
+void stats_move(stats_phase_t from, stats_phase_t to, stats_clock_t spent);
+
+void stats_token(char token, uint64_t ns);
+void stats_results(size_t packages, size_t bytes);
+
+int stats_report(int fd, bool json);
+
+#endif  /* _STATS_H */
+
+/* vim: set et ts=2 sw=2: */
@@ -0,0 +1,210 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "timefmt.h"
+#include "util.h"
+
+#define CACHE_BITS  7
+#define CACHE_SIZE  (1 << CACHE_BITS)
+#define FMT_MAX     128
+
+/* the conversions render_fast knows, which are all locale independent */
+static char const fast_conversions[] = "YmdHMSFTzs%";
+
+typedef struct cached_time_t {
+  time_t timestamp;
+  bool valid;
+  unsigned char len;
+  char str[TIMEFMT_MAX];
+} cached_time_t;
+
+/* kept per thread, so that printing from several threads needs no lock.
+ * Everything cached belongs to the format it was made with. */
+static _Thread_local struct {
+  char fmt[FMT_MAX];
+  bool fast;
+  cached_time_t entries[CACHE_SIZE];
+} cache;
+
+static bool fast_supported(const char *fmt)
+{
+  for(const char *f = fmt; *f; ++f) {
+    if(*f != '%') {
+      continue;
+    }
+
+    ++f;
+    if(*f == '\0' || strchr(fast_conversions, *f) == NULL) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static char *put_digits(char *p, unsigned value, int width)
+{
+  for(int i = width - 1; i >= 0; --i) {
+    p[i] = '0' + value % 10;
+    value /= 10;
+  }
+
+  return p + width;
+}
+
+/* formats the same as strftime would, or returns -1 for strftime to do it
+ * after all */
+static ssize_t render_fast(const char *fmt, time_t timestamp, char *out)
+{
+  struct tm tm;
+  bool have_tm = false;
+  size_t len = 0;
+
+  for(const char *f = fmt; *f; ++f) {
+    char field[32], *p = field;
+    size_t n;
+
+    if(*f != '%') {
+      *p++ = *f;
+    } else if(*++f == '%') {
+      *p++ = '%';
+    } else {
+      if(!have_tm) {
+        if(localtime_r(&timestamp, &tm) == NULL) {
+          return -1;
+        }
+        /* strftime doesn't pad years outside of these */
+        if(tm.tm_year + 1900 < 1000 || tm.tm_year + 1900 > 9999) {
+          return -1;
+        }
+        have_tm = true;
+      }
+
+      switch (*f) {
+        case 's': {
+          /* not necessarily timestamp, where the local time is ambiguous */
+          struct tm copy = tm;
+          const time_t seconds = mktime(&copy);
+
+          if(seconds < 0) {
+            *p++ = '-';
+          }
+          p += uint_to_str(seconds < 0 ? -(uint64_t)seconds : (uint64_t)seconds, p);
+          break;
+        }
+        case 'F':
+        case 'Y':
+          p = put_digits(p, tm.tm_year + 1900, 4);
+          if(*f == 'Y') {
+            break;
+          }
+          *p++ = '-';
+          p = put_digits(p, tm.tm_mon + 1, 2);
+          *p++ = '-';
+          p = put_digits(p, tm.tm_mday, 2);
+          break;
+        case 'm':
+          p = put_digits(p, tm.tm_mon + 1, 2);
+          break;
+        case 'd':
+          p = put_digits(p, tm.tm_mday, 2);
+          break;
+        case 'T':
+          p = put_digits(p, tm.tm_hour, 2);
+          *p++ = ':';
+          p = put_digits(p, tm.tm_min, 2);
+          *p++ = ':';
+          p = put_digits(p, tm.tm_sec, 2);
+          break;
+        case 'H':
+          p = put_digits(p, tm.tm_hour, 2);
+          break;
+        case 'M':
+          p = put_digits(p, tm.tm_min, 2);
+          break;
+        case 'S':
+          p = put_digits(p, tm.tm_sec, 2);
+          break;
+        case 'z': {
+          long offset = tm.tm_gmtoff;
+
+          if(offset % 60 != 0) {
+            return -1;
+          }
+          *p++ = offset < 0 ? '-' : '+';
+          offset = (offset < 0 ? -offset : offset) / 60;
+          p = put_digits(p, offset / 60 % 100, 2);
+          p = put_digits(p, offset % 60, 2);
+          break;
+        }
+      }
+    }
+
+    /* as with strftime, a result which doesn't fit is no result at all */
+    n = p - field;
+    if(len + n >= TIMEFMT_MAX) {
+      return 0;
+    }
+    memcpy(out + len, field, n);
+    len += n;
+  }
+
+  return len;
+}
+
+static size_t render(const char *fmt, bool fast, time_t timestamp, char *out)
+{
+  struct tm tm;
+
+  if(fast) {
+    ssize_t len = render_fast(fmt, timestamp, out);
+    if(len >= 0) {
+      return len;
+    }
+  }
+
+  if(localtime_r(&timestamp, &tm) == NULL) {
+    return 0;
+  }
+
+  return strftime(out, TIMEFMT_MAX, fmt, &tm);
+}
+
+/* strftime(out, TIMEFMT_MAX, fmt, localtime(&timestamp)), without asking
+ * the C library for the times it was asked about recently. Returns the
+ * length, which is 0 if the result didn't fit. */
+size_t timefmt_format(const char *fmt, time_t timestamp, char *out)
+{
+  cached_time_t *entry;
+  size_t len;
+
+  if(strlen(fmt) >= sizeof(cache.fmt)) {
+    return render(fmt, fast_supported(fmt), timestamp, out);
+  }
+
+  if(strcmp(cache.fmt, fmt) != 0 || cache.fmt[0] == '\0') {
+    strcpy(cache.fmt, fmt);
+    cache.fast = fast_supported(fmt);
+    memset(cache.entries, 0, sizeof(cache.entries));
+  }
+
+  entry = &cache.entries[((uint64_t)timestamp * UINT64_C(0x9e3779b97f4a7c15)) >>
+    (64 - CACHE_BITS)];
+  if(entry->valid && entry->timestamp == timestamp) {
+    memcpy(out, entry->str, entry->len);
+    return entry->len;
+  }
+
+  len = render(cache.fmt, cache.fast, timestamp, out);
+
+  entry->timestamp = timestamp;
+  entry->len = len;
+  entry->valid = true;
+  memcpy(entry->str, out, len);
+
+  return len;
+}
+
+/* vim: set et ts=2 sw=2: */
@@ -0,0 +1,14 @@
+#ifndef _TIMEFMT_H
+#define _TIMEFMT_H
+
+#include <stddef.h>
+#include <time.h>
+
+/* the most strftime is allowed to write, including the NUL */
+#define TIMEFMT_MAX 64
+
+size_t timefmt_format(const char *fmt, time_t timestamp, char *out);
+
+#endif  /* _TIMEFMT_H */
+
+/* vim: set et ts=2 sw=2: */
@@ -0,0 +1,107 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "util.h"
+
+/* creates dir along with any missing parents, like mkdir -p */
+int mkdir_p(const char *dir)
+{
+  _cleanup_free_ char *path = NULL;
+
+  if(*dir == '\0') {
+    return -EINVAL;
+  }
+
+  path = strdup(dir);
+  if(path == NULL) {
+    return -ENOMEM;
+  }
+
+  for(char *p = path + 1;; ++p) {
+    if(*p == '/' || *p == '\0') {
+      char c = *p;
+
+      *p = '\0';
+      if(mkdir(path, 0755) < 0 && errno != EEXIST) {
+        return -errno;
+      }
+      *p = c;
+
+      if(c == '\0') {
+        break;
+      }
+    }
+  }
+
+  return 0;
+}
+
+/* replaces filename with len bytes of data, creating the directory it's in
+ * if need be. The new file is swapped in with a rename, so that concurrent
+ * readers never see a partial one. */
+int write_file_atomic(const char *filename, const void *data, size_t len)
+{
+  _cleanup_free_ char *dir = NULL;
+  _cleanup_free_ char *tmpname = NULL;
+  const char *slash;
+  size_t left = len;
+  int fd, r;
+
+  dir = strdup(filename);
+  if(dir == NULL) {
+    return -ENOMEM;
+  }
+  slash = strrchr(dir, '/');
+  if(slash != NULL && slash != dir) {
+    dir[slash - dir] = '\0';
+    r = mkdir_p(dir);
+    if(r < 0) {
+      return r;
+    }
+  }
+
+  if(asprintf(&tmpname, "%s.XXXXXX", filename) < 0) {
+    tmpname = NULL;
+    return -ENOMEM;
+  }
+
+  fd = mkstemp(tmpname);
+  if(fd < 0) {
+    return -errno;
+  }
+
+  for(const char *p = data; left > 0;) {
+    ssize_t n = write(fd, p, left);
+    if(n < 0) {
+      if(errno == EINTR) {
+        continue;
+      }
+      r = -errno;
+      close(fd);
+      unlink(tmpname);
+      return r;
+    }
+
+    p += n;
+    left -= n;
+  }
+
+  if(close(fd) < 0) {
+    unlink(tmpname);
+    return -EIO;
+  }
+
+  if(rename(tmpname, filename) < 0) {
+    r = -errno;
+    unlink(tmpname);
+    return r;
+  }
+
+  return 0;
+}
+
+/* vim: set et ts=2 sw=2: */
@@ -1,6 +1,8 @@
 #ifndef _UTIL_H
 #define _UTIL_H
 
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -9,4 +11,38 @@ static inline void fclosep(FILE **p) { if (*p) fclose(*p); }
 #define _cleanup_(x) __attribute__((cleanup(x)))
 #define _cleanup_free_ _cleanup_(freep)
 
+int mkdir_p(const char *dir);
+int write_file_atomic(const char *filename, const void *data, size_t len);
+
+/* n in decimal, without going through printf. out must have room for 21
+ * bytes. Returns the length, not counting the terminating NUL. */
+static inline size_t uint_to_str(uint64_t n, char *out)
+{
+  char digits[20];
+  size_t len = 0;
+
+  do {
+    digits[len++] = '0' + n % 10;
+    n /= 10;
+  } while(n > 0);
+
+  for(size_t i = 0; i < len; ++i) {
+    out[i] = digits[len - 1 - i];
+  }
+  out[len] = '\0';
+
+  return len;
+}
+
+/* as uint_to_str, with a leading '-' if n is negative */
+static inline size_t int_to_str(int64_t n, char *out)
+{
+  if(n < 0) {
+    *out = '-';
+    return uint_to_str(-(uint64_t)n, out + 1) + 1;
+  }
+
+  return uint_to_str(n, out);
+}
+
 #endif  /* _UTIL_H */